@@ -0,0 +1,454 @@
+﻿#include "Common.h"
+
+#include "FakeIrcServer.h"
+
+namespace SudaGureum
+{
+    namespace
+    {
+        const std::string ServerName = "fake.server";
+        const std::string Filler = "the quick brown fox jumps over the lazy dog while the bouncer takes notes";
+        constexpr std::chrono::milliseconds TickInterval(10);
+        constexpr size_t PingTicks = 1000;
+        constexpr size_t MaxOutboxSize = 16 * 1024 * 1024; // events are dropped above this
+        constexpr size_t MaxNamesLength = 400; // nicknames per RPL_NAMREPLY line, in bytes
+
+        int64_t steadyNanoseconds()
+        {
+            return std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+        }
+    }
+
+    class FakeIrcServer::Connection : public std::enable_shared_from_this<Connection>
+    {
+    private:
+        struct Channel
+        {
+            bool joined_ = false;
+            size_t names_ = 0; // including the client
+            size_t guestsBegin_ = 0; // guests in the channel are "guest<n>" for n in [guestsBegin_, guestsEnd_)
+            size_t guestsEnd_ = 0;
+            double budget_ = 0.0; // events owed to the channel
+        };
+
+    public:
+        Connection(FakeIrcServer &server, asio::ip::tcp::socket socket)
+            : server_(server)
+            , socket_(std::move(socket))
+            , strand_(server.ios_)
+            , tickTimer_(server.ios_)
+            , inWrite_(false)
+            , closing_(false)
+            , user_(false)
+            , capEnded_(false)
+            , registered_(false)
+            , channels_(server.options_.channels_)
+            , random_(std::random_device()())
+            , ticks_(0)
+        {
+        }
+
+    public:
+        void start()
+        {
+            read();
+            tickTimer_.expires_from_now(TickInterval);
+            tickTimer_.async_wait(strand_.wrap(std::bind(&Connection::tick, shared_from_this(), std::placeholders::_1)));
+        }
+
+    private:
+        void read()
+        {
+            socket_.async_read_some(asio::buffer(bufferToRead_),
+                strand_.wrap(std::bind(&Connection::handleRead, shared_from_this(), std::placeholders::_1, std::placeholders::_2)));
+        }
+
+        void handleRead(const std::error_code &ec, size_t bytesTransferred)
+        {
+            if(ec)
+            {
+                close();
+                return;
+            }
+
+            std::string_view data(bufferToRead_.data(), bytesTransferred);
+            for(size_t lfPos; (lfPos = data.find('\n')) != std::string_view::npos; )
+            {
+                partialLine_.append(data.substr(0, lfPos));
+                data.remove_prefix(lfPos + 1);
+                if(!partialLine_.empty() && partialLine_.back() == '\r')
+                {
+                    partialLine_.pop_back();
+                }
+                procLine(partialLine_);
+                partialLine_.clear();
+            }
+            partialLine_.append(data);
+
+            write();
+            if(socket_.is_open() && !closing_)
+            {
+                read();
+            }
+        }
+
+        // Clients never send a prefix.
+        void procLine(std::string_view line)
+        {
+            boost::container::small_vector<std::string_view, 8> params; // command first
+            while(!line.empty())
+            {
+                if(line[0] == ':')
+                {
+                    params.push_back(line.substr(1));
+                    break;
+                }
+
+                size_t spacePos = line.find(' ');
+                params.push_back(line.substr(0, spacePos));
+                line = spacePos == std::string_view::npos ? std::string_view() : line.substr(spacePos + 1);
+            }
+
+            if(params.empty())
+            {
+                return;
+            }
+
+            std::string_view command = params[0];
+            if(command == "CAP" && params.size() >= 2)
+            {
+                if(params[1] == "LS")
+                    send(std::format(":{} CAP * LS :", ServerName));
+                else if(params[1] == "REQ")
+                    send(std::format(":{} CAP * NAK :{}", ServerName, params.back()));
+                else if(params[1] == "END")
+                    capEnded_ = true;
+            }
+            else if(command == "NICK" && params.size() >= 2)
+            {
+                if(registered_)
+                {
+                    send(std::format(":{}!bench@fake.host NICK :{}", nickname_, params[1]));
+                }
+                nickname_ = params[1];
+            }
+            else if(command == "USER")
+            {
+                user_ = true;
+            }
+            else if(command == "PING" && params.size() >= 2)
+            {
+                send(std::format(":{} PONG {} :{}", ServerName, ServerName, params[1]));
+            }
+            else if(command == "JOIN" && params.size() >= 2 && registered_)
+            {
+                procJoin(params[1]);
+            }
+            else if(command == "PART" && params.size() >= 2 && registered_)
+            {
+                procPart(params[1]);
+            }
+            else if(command == "QUIT")
+            {
+                send("ERROR :Closing link (quit)");
+                closing_ = true;
+            }
+
+            if(!registered_ && !nickname_.empty() && user_ && capEnded_)
+            {
+                welcome();
+            }
+        }
+
+        void welcome()
+        {
+            registered_ = true;
+            send(std::format(":{} 001 {} :Welcome to the benchmark network {}", ServerName, nickname_, nickname_));
+            send(std::format(":{} 005 {} CHANTYPES=# PREFIX=(ov)@+ CHANMODES=b,k,l,imnst CASEMAPPING=rfc1459 NICKLEN=30"
+                " CHANNELLEN=50 :are supported by this server", ServerName, nickname_));
+            send(std::format(":{} 422 {} :MOTD File is missing", ServerName, nickname_));
+        }
+
+        void procJoin(std::string_view channels)
+        {
+            for(const auto &part: std::views::split(channels, ','))
+            {
+                std::string_view name(part.begin(), part.end());
+                auto index = channelIndex(name);
+                if(!index.has_value())
+                {
+                    send(std::format(":{} 403 {} {} :No such channel", ServerName, nickname_, name));
+                    continue;
+                }
+
+                Channel &channel = channels_[index.value()];
+                if(channel.joined_)
+                {
+                    continue;
+                }
+
+                channel = Channel();
+                channel.joined_ = true;
+                channel.names_ = std::max<size_t>(2, server_.options_.maxNames_ / (index.value() + 1));
+                send(std::format(":{}!bench@fake.host JOIN {}", nickname_, name));
+
+                std::string prefix = std::format(":{} 353 {} = {} :", ServerName, nickname_, name);
+                std::string line = prefix + nickname_;
+                for(size_t i = 0; i + 1 < channel.names_; ++ i)
+                {
+                    std::string nickname = std::format("{}user{}", i % 20 == 0 ? "@" : (i % 10 == 5 ? "+" : ""), i);
+                    if(line.size() + 1 + nickname.size() > prefix.size() + MaxNamesLength)
+                    {
+                        send(line);
+                        line = prefix;
+                    }
+                    else
+                    {
+                        line += ' ';
+                    }
+                    line += nickname;
+                }
+                send(line);
+                send(std::format(":{} 366 {} {} :End of /NAMES list.", ServerName, nickname_, name));
+            }
+        }
+
+        void procPart(std::string_view channels)
+        {
+            for(const auto &part: std::views::split(channels, ','))
+            {
+                std::string_view name(part.begin(), part.end());
+                auto index = channelIndex(name);
+                if(!index.has_value() || !channels_[index.value()].joined_)
+                {
+                    continue;
+                }
+
+                channels_[index.value()].joined_ = false;
+                send(std::format(":{}!bench@fake.host PART {}", nickname_, name));
+            }
+        }
+
+        std::optional<size_t> channelIndex(std::string_view name) const
+        {
+            static constexpr std::string_view ChannelPrefix = "#bench";
+            if(!name.starts_with(ChannelPrefix))
+            {
+                return std::nullopt;
+            }
+
+            size_t index;
+            const char *end = name.data() + name.size();
+            auto res = std::from_chars(name.data() + ChannelPrefix.size(), end, index);
+            if(res.ec != std::errc() || res.ptr != end || index >= channels_.size())
+            {
+                return std::nullopt;
+            }
+            return index;
+        }
+
+        void tick(const std::error_code &ec)
+        {
+            if(ec || !socket_.is_open() || closing_)
+            {
+                return;
+            }
+
+            if(++ ticks_ % PingTicks == 0 && registered_)
+            {
+                send(std::format("PING :{}", ServerName));
+            }
+
+            if(server_.loading_)
+            {
+                double owed = server_.options_.rate_ * std::chrono::duration<double>(TickInterval).count();
+                for(size_t i = 0; i < channels_.size(); ++ i)
+                {
+                    Channel &channel = channels_[i];
+                    if(!channel.joined_)
+                    {
+                        continue;
+                    }
+
+                    for(channel.budget_ += owed; channel.budget_ >= 1.0; channel.budget_ -= 1.0)
+                    {
+                        if(outbox_.size() > MaxOutboxSize)
+                            ++ server_.eventsDropped_;
+                        else
+                            generate(i, channel);
+                    }
+                }
+            }
+            write();
+
+            // on a fixed schedule, so a late tick catches up
+            tickTimer_.expires_at(tickTimer_.expires_at() + TickInterval);
+            tickTimer_.async_wait(strand_.wrap(std::bind(&Connection::tick, shared_from_this(), std::placeholders::_1)));
+        }
+
+        // 90% PRIVMSG, then JOIN, PART and MODE churn
+        void generate(size_t index, Channel &channel)
+        {
+            int kind = std::uniform_int_distribution<int>(0, 99)(random_);
+            size_t member = std::uniform_int_distribution<size_t>(0, channel.names_ - 2)(random_);
+            if(kind < 4)
+            {
+                send(std::format(":guest{}!guest@fake.host JOIN #bench{}", channel.guestsEnd_ ++, index));
+            }
+            else if(kind < 8 && channel.guestsBegin_ != channel.guestsEnd_)
+            {
+                send(std::format(":guest{}!guest@fake.host PART #bench{} :bye", channel.guestsBegin_ ++, index));
+            }
+            else if(kind < 10)
+            {
+                send(std::format(":{} MODE #bench{} {}v user{}", ServerName, index, kind % 2 == 0 ? '+' : '-', member));
+            }
+            else
+            {
+                send(std::format(":user{}!user@fake.host PRIVMSG #bench{} :{}{} {}",
+                    member, index, MessagePrefix, steadyNanoseconds(), Filler));
+                ++ server_.messagesSent_;
+            }
+        }
+
+        void send(std::string_view line)
+        {
+            outbox_.append(line);
+            outbox_ += "\r\n";
+        }
+
+        void write()
+        {
+            if(inWrite_ || outbox_.empty() || !socket_.is_open())
+            {
+                return;
+            }
+
+            inFlight_.swap(outbox_);
+            outbox_.clear();
+            inWrite_ = true;
+            asio::async_write(socket_, asio::buffer(inFlight_),
+                strand_.wrap(std::bind(&Connection::handleWrite, shared_from_this(), std::placeholders::_1, std::placeholders::_2)));
+        }
+
+        void handleWrite(const std::error_code &ec, size_t /*bytesTransferred*/)
+        {
+            inWrite_ = false;
+            inFlight_.clear();
+            if(ec || (closing_ && outbox_.empty()))
+            {
+                close();
+                return;
+            }
+            write();
+        }
+
+        void close()
+        {
+            tickTimer_.cancel();
+
+            std::error_code ec;
+            socket_.shutdown(asio::ip::tcp::socket::shutdown_both, ec);
+            socket_.close(ec);
+        }
+
+    private:
+        FakeIrcServer &server_;
+        asio::ip::tcp::socket socket_;
+        asio::io_service::strand strand_;
+        asio::basic_waitable_timer<std::chrono::steady_clock> tickTimer_;
+        std::array<char, 8192> bufferToRead_;
+        std::string partialLine_;
+        std::string outbox_; // lines queued while a write is in flight
+        std::string inFlight_;
+        bool inWrite_;
+        bool closing_; // QUIT received; closed once everything queued is written
+        std::string nickname_;
+        bool user_;
+        bool capEnded_;
+        bool registered_;
+        std::vector<Channel> channels_; // indexed by the number of "#bench<i>"
+        std::mt19937 random_;
+        size_t ticks_;
+    };
+
+    FakeIrcServer::FakeIrcServer(Options options)
+        : options_(options)
+        , loading_(false)
+        , messagesSent_(0)
+        , eventsDropped_(0)
+    {
+        acceptors_.reserve(options_.networks_);
+        for(size_t i = 0; i < options_.networks_; ++ i)
+        {
+            acceptors_.emplace_back(ios_, asio::ip::tcp::endpoint(asio::ip::address_v4::loopback(), 0));
+            accept(i);
+        }
+    }
+
+    FakeIrcServer::~FakeIrcServer()
+    {
+        stop();
+    }
+
+    uint16_t FakeIrcServer::port(size_t network) const
+    {
+        return acceptors_.at(network).local_endpoint().port();
+    }
+
+    void FakeIrcServer::run(uint16_t numThreads)
+    {
+        for(uint16_t i = 0; i < numThreads; ++ i)
+        {
+            threads_.emplace_back([this]() { ios_.run(); });
+        }
+    }
+
+    void FakeIrcServer::stop()
+    {
+        ios_.stop();
+        for(auto &thread: threads_)
+        {
+            thread.join();
+        }
+        threads_.clear();
+    }
+
+    void FakeIrcServer::startLoad()
+    {
+        loading_ = true;
+    }
+
+    void FakeIrcServer::stopLoad()
+    {
+        loading_ = false;
+    }
+
+    size_t FakeIrcServer::messagesSent() const
+    {
+        return messagesSent_;
+    }
+
+    size_t FakeIrcServer::eventsDropped() const
+    {
+        return eventsDropped_;
+    }
+
+    void FakeIrcServer::accept(size_t network)
+    {
+        auto socket = std::make_shared<asio::ip::tcp::socket>(ios_);
+        acceptors_[network].async_accept(*socket, [this, network, socket](const std::error_code &ec)
+        {
+            if(ec)
+            {
+                return;
+            }
+
+            std::error_code optionEc;
+            socket->set_option(asio::ip::tcp::no_delay(true), optionEc);
+            std::make_shared<Connection>(*this, std::move(*socket))->start();
+            accept(network);
+        });
+    }
+}
@@ -0,0 +1,59 @@
+﻿#pragma once
+
+namespace SudaGureum
+{
+    // Stand-in for IRC networks on the loopback interface, driving IrcClientPool in the benchmark.
+    // Each network listens on its own ephemeral port. A connection is registered at CAP END, may join "#bench<i>"
+    // for i below the channel count, and once the load is started receives generated traffic in every channel it
+    // joined: mostly PRIVMSGs carrying their send time, with some JOIN, PART and MODE churn.
+    class FakeIrcServer
+    {
+    public:
+        struct Options
+        {
+            size_t networks_;
+            size_t channels_; // per network
+            double rate_; // events per second per channel
+            size_t maxNames_; // roster of "#bench<i>" is maxNames_ / (i + 1), but at least 2, like real networks
+        };
+
+        static constexpr std::string_view MessagePrefix = "bench "; // then the send time in steady_clock nanoseconds
+
+    private:
+        class Connection;
+
+    private:
+        FakeIrcServer(const FakeIrcServer &) = delete;
+        FakeIrcServer &operator =(const FakeIrcServer &) = delete;
+
+    public:
+        explicit FakeIrcServer(Options options);
+        ~FakeIrcServer();
+
+    public:
+        uint16_t port(size_t network) const;
+
+        void run(uint16_t numThreads);
+        void stop(); // closes every connection and joins the threads
+
+        void startLoad();
+        void stopLoad();
+
+    public:
+        size_t messagesSent() const; // generated PRIVMSGs
+        size_t eventsDropped() const; // not generated because a client did not read fast enough
+
+    private:
+        void accept(size_t network);
+
+    private:
+        Options options_;
+        asio::io_service ios_;
+        std::vector<asio::ip::tcp::acceptor> acceptors_;
+        std::vector<std::thread> threads_;
+
+        std::atomic<bool> loading_;
+        std::atomic<size_t> messagesSent_;
+        std::atomic<size_t> eventsDropped_;
+    };
+}
@@ -0,0 +1,343 @@
+﻿#include "Common.h"
+
+#include "IrcBenchmark.h"
+
+#include "Configure.h"
+#include "DB.h"
+#include "FakeIrcServer.h"
+#include "HandlerAllocator.h"
+#include "IrcClient.h"
+#include "Log.h"
+#include "SocketEcho.h"
+#include "Utility.h"
+
+#ifdef _WIN32
+#   include <psapi.h>
+#   pragma comment(lib, "psapi.lib")
+#else
+#   include <unistd.h>
+#endif
+
+namespace SudaGureum
+{
+    namespace
+    {
+        const std::string BenchmarkUserId = "benchmark";
+
+        struct Percentiles
+        {
+            uint32_t p50_ = 0;
+            uint32_t p99_ = 0;
+            uint32_t max_ = 0;
+        };
+
+        Percentiles percentiles(std::vector<uint32_t> &samples)
+        {
+            Percentiles res;
+            if(samples.empty())
+            {
+                return res;
+            }
+
+            auto at = [&samples](size_t percent)
+            {
+                auto it = samples.begin() + std::min(samples.size() - 1, samples.size() * percent / 100);
+                std::nth_element(samples.begin(), it, samples.end());
+                return *it;
+            };
+            res.p50_ = at(50);
+            res.p99_ = at(99);
+            res.max_ = *std::max_element(samples.begin(), samples.end());
+            return res;
+        }
+
+        typedef std::array<HandlerAllocStats::Counters, static_cast<size_t>(AsyncOp::Count)> AllocCounters;
+
+        AllocCounters allocCounters()
+        {
+            AllocCounters counters;
+            for(size_t op = 0; op < counters.size(); ++ op)
+            {
+                counters[op] = HandlerAllocStats::instance().counters(static_cast<AsyncOp>(op));
+            }
+            return counters;
+        }
+
+        void printAllocations(const AllocCounters &begin, const AllocCounters &end)
+        {
+            for(size_t op = 0; op < end.size(); ++ op)
+            {
+                uint64_t recycled = end[op].recycled_ - begin[op].recycled_;
+                uint64_t allocated = end[op].allocated_ - begin[op].allocated_;
+                std::cout << std::format("{:<18} {} operations, {} allocated from the heap\n",
+                    std::format("{} ops", asyncOpName(static_cast<AsyncOp>(op))), recycled + allocated, allocated);
+            }
+        }
+    }
+
+    IrcBenchmark::IrcBenchmark()
+        : archive_(true)
+        , measuring_(false)
+        , synchronized_(0)
+    {
+    }
+
+    int IrcBenchmark::run(int argc, native_char_t **argv)
+    {
+        namespace boostpo = boost::program_options;
+
+        FakeIrcServer::Options serverOptions;
+        uint16_t threads, serverThreads;
+        size_t echoRoundTrips;
+        double warmup, duration, syncTimeout;
+
+        boostpo::options_description desc("Benchmark options");
+        desc.add_options()
+            ("help,h", "show help message")
+            ("config,c", boostpo::wvalue<std::wstring>(), "specify configure file (io shards, data path and such)")
+            ("networks,n", boostpo::value<size_t>(&serverOptions.networks_)->default_value(4), "networks, one connection each")
+            ("channels,m", boostpo::value<size_t>(&serverOptions.channels_)->default_value(50), "channels per network")
+            ("rate,k", boostpo::value<double>(&serverOptions.rate_)->default_value(2.0), "events per second per channel")
+            ("max-names", boostpo::value<size_t>(&serverOptions.maxNames_)->default_value(1000),
+                "roster of the largest channel; channel i has max-names / (i + 1)")
+            ("threads", boostpo::value<uint16_t>(&threads)->default_value(4), "IrcClientPool threads")
+            ("server-threads", boostpo::value<uint16_t>(&serverThreads)->default_value(2), "fake server threads")
+            ("warmup", boostpo::value<double>(&warmup)->default_value(2.0), "seconds of load before measuring")
+            ("duration", boostpo::value<double>(&duration)->default_value(10.0), "seconds to measure")
+            ("sync-timeout", boostpo::value<double>(&syncTimeout)->default_value(60.0), "seconds to wait for every roster")
+            ("no-archive", "do not insert messages into the archive")
+            ("echo", boostpo::value<size_t>(&echoRoundTrips),
+                "instead of IRC, only do this many loopback round trips with --threads threads and count allocations,"
+                " then stream as many lines through awaitable reads")
+            ;
+
+        boostpo::variables_map vm;
+        try
+        {
+            boostpo::store(boostpo::parse_command_line(argc, argv, desc), vm);
+            boostpo::notify(vm);
+        }
+        catch(const boostpo::error &ex)
+        {
+            std::cerr << ex.what() << std::endl;
+            return EXIT_FAILURE;
+        }
+
+        if(vm.find("help") != vm.end())
+        {
+            std::cout << desc << std::endl;
+            return EXIT_SUCCESS;
+        }
+
+        if(vm.find("config") != vm.end())
+        {
+            if(!Configure::instance().load(std::filesystem::path(vm["config"].as<std::wstring>())))
+            {
+                std::cerr << "Failed to load the configure file; ignore." << std::endl;
+            }
+        }
+
+        Log::instance();
+        if(vm.find("echo") != vm.end())
+        {
+            AllocCounters opsBegin = allocCounters();
+            size_t completed = SocketEcho::run(echoRoundTrips, threads);
+            AllocCounters opsEnd = allocCounters();
+
+            std::cout << std::format("echo               {} of {} round trips on {} threads\n",
+                completed, echoRoundTrips, threads);
+            printAllocations(opsBegin, opsEnd);
+
+            // the awaitable reads of the WebSocket read loop
+            size_t streamBytes = echoRoundTrips * SocketEcho::Line.size();
+            size_t streamed = SocketEcho::stream(streamBytes, false);
+            size_t streamedWaiting = SocketEcho::stream(streamBytes, true);
+            std::cout << std::format("awaitable reads    {} and {} (waiting until readable) of {} bytes until EOF\n",
+                streamed, streamedWaiting, streamBytes);
+            std::cout.flush();
+
+            return completed == echoRoundTrips && streamed == streamBytes && streamedWaiting == streamBytes ?
+                EXIT_SUCCESS : EXIT_FAILURE;
+        }
+
+        archive_ = (vm.find("no-archive") == vm.end());
+        if(archive_)
+        {
+            ArchiveDB::instance(); // opened before measuring
+        }
+
+        size_t channelCount = serverOptions.networks_ * serverOptions.channels_;
+        FakeIrcServer server(serverOptions);
+        server.run(serverThreads);
+
+        size_t memoryBefore = residentMemory();
+        auto connectBegin = std::chrono::steady_clock::now();
+
+        std::vector<std::unique_ptr<NetworkStats>> stats;
+        IrcClientPool pool;
+        for(size_t i = 0; i < serverOptions.networks_; ++ i)
+        {
+            NetworkStats &networkStats = *stats.emplace_back(std::make_unique<NetworkStats>());
+            networkStats.serverName_ = std::format("bench{}", i);
+
+            pool.connect("127.0.0.1", server.port(i), "UTF-8", {networkStats.serverName_}, false, {}, IrcClient::Sasl(),
+                [this, &networkStats, &serverOptions](IrcClient &client)
+                {
+                    client.onConnect += [&serverOptions](std::weak_ptr<IrcClient> ircClient)
+                    {
+                        auto ircClientLock = ircClient.lock();
+                        for(size_t i = 0; ircClientLock && i < serverOptions.channels_; ++ i)
+                        {
+                            ircClientLock->join(std::format("#bench{}", i));
+                        }
+                    };
+                    client.onChannelSynchronized += [this](const IrcClient::ChannelSynchronizedArgs &)
+                    {
+                        ++ synchronized_;
+                    };
+                    client.onChannelMessage += [this, &networkStats](const IrcClient::ChannelMessageArgs &args)
+                    {
+                        onChannelMessage(networkStats, args);
+                    };
+                });
+        }
+        pool.run(threads);
+
+        auto syncDeadline = connectBegin + std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+            std::chrono::duration<double>(syncTimeout));
+        while(synchronized_ < channelCount && std::chrono::steady_clock::now() < syncDeadline)
+        {
+            std::this_thread::sleep_for(std::chrono::milliseconds(50));
+        }
+        auto syncTime = std::chrono::duration<double>(std::chrono::steady_clock::now() - connectBegin).count();
+        size_t memorySynchronized = residentMemory(); // the fake server holds a few counters per channel only
+
+        if(synchronized_ < channelCount)
+        {
+            std::cerr << std::format("Only {} of {} channels synchronized in {} s; giving up.",
+                synchronized_.load(), channelCount, syncTimeout) << std::endl;
+            pool.closeAll();
+            pool.stop();
+            pool.join();
+            return EXIT_FAILURE;
+        }
+
+        server.startLoad();
+        std::this_thread::sleep_for(std::chrono::duration<double>(warmup));
+
+        size_t sentBegin = server.messagesSent();
+        size_t droppedBegin = server.eventsDropped();
+        AllocCounters opsBegin = allocCounters();
+        auto measureBegin = std::chrono::steady_clock::now();
+        measuring_ = true;
+        std::this_thread::sleep_for(std::chrono::duration<double>(duration));
+        measuring_ = false;
+        AllocCounters opsEnd = allocCounters();
+        double measured = std::chrono::duration<double>(std::chrono::steady_clock::now() - measureBegin).count();
+        size_t sent = server.messagesSent() - sentBegin;
+        size_t dropped = server.eventsDropped() - droppedBegin;
+        server.stopLoad();
+
+        pool.closeAll();
+        std::this_thread::sleep_for(std::chrono::milliseconds(200)); // for QUITs to go out
+        pool.stop();
+        pool.join();
+        server.stop();
+
+        // the pool is stopped; the stats are no longer touched
+        size_t delivered = 0;
+        std::vector<uint32_t> deliveryLatencies, archiveLatencies;
+        for(auto &networkStats: stats)
+        {
+            delivered += networkStats->delivered_;
+            deliveryLatencies.insert(deliveryLatencies.end(),
+                networkStats->deliveryLatencies_.begin(), networkStats->deliveryLatencies_.end());
+            archiveLatencies.insert(archiveLatencies.end(),
+                networkStats->archiveLatencies_.begin(), networkStats->archiveLatencies_.end());
+        }
+
+        Percentiles delivery = percentiles(deliveryLatencies);
+        Percentiles archive = percentiles(archiveLatencies);
+
+        std::cout << std::format("networks {}, channels {} per network, {} events/s per channel, largest roster {}\n",
+            serverOptions.networks_, serverOptions.channels_, serverOptions.rate_, serverOptions.maxNames_);
+        std::cout << std::format("synchronized       {} channels in {:.2f} s\n", channelCount, syncTime);
+        if(memoryBefore != 0 && memorySynchronized >= memoryBefore)
+        {
+            std::cout << std::format("memory per channel {} bytes (resident {} -> {} KiB)\n",
+                (memorySynchronized - memoryBefore) / channelCount, memoryBefore / 1024, memorySynchronized / 1024);
+        }
+        std::cout << std::format("messages           {} sent, {} delivered in {:.2f} s; {} events dropped by the server\n",
+            sent, delivered, measured, dropped);
+        std::cout << std::format("throughput         {:.0f} messages/s\n", delivered / measured);
+        std::cout << std::format("send -> event      p50 {} us, p99 {} us, max {} us\n", delivery.p50_, delivery.p99_, delivery.max_);
+        if(archive_)
+        {
+            std::cout << std::format("send -> archive    p50 {} us, p99 {} us, max {} us\n", archive.p50_, archive.p99_, archive.max_);
+        }
+        printAllocations(opsBegin, opsEnd); // operations of the IRC connections while measuring
+        std::cout.flush();
+
+        return EXIT_SUCCESS;
+    }
+
+    void IrcBenchmark::onChannelMessage(NetworkStats &stats, const IrcClient::ChannelMessageArgs &args)
+    {
+        std::string_view message = args.message_;
+        if(!message.starts_with(FakeIrcServer::MessagePrefix))
+        {
+            return;
+        }
+
+        int64_t sentAt;
+        message.remove_prefix(FakeIrcServer::MessagePrefix.size());
+        if(std::from_chars(message.data(), message.data() + message.size(), sentAt).ec != std::errc())
+        {
+            return;
+        }
+
+        auto sinceSent = [sentAt]()
+        {
+            int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                std::chrono::steady_clock::now().time_since_epoch()).count();
+            return static_cast<uint32_t>(std::clamp<int64_t>((now - sentAt) / 1000, 0, std::numeric_limits<uint32_t>::max()));
+        };
+
+        bool measuring = measuring_;
+        if(measuring)
+        {
+            ++ stats.delivered_;
+            stats.deliveryLatencies_.push_back(sinceSent());
+        }
+
+        if(archive_)
+        {
+            ArchiveDB::instance().insertLog(BenchmarkUserId, stats.serverName_, args.channel_.str(),
+                LogLine{args.time_, args.nickname_, LogLine::PRIVMSG, args.message_});
+            if(measuring)
+            {
+                stats.archiveLatencies_.push_back(sinceSent());
+            }
+        }
+    }
+
+    size_t IrcBenchmark::residentMemory()
+    {
+#ifdef _WIN32
+        PROCESS_MEMORY_COUNTERS counters;
+        if(!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters)))
+        {
+            return 0;
+        }
+        return counters.WorkingSetSize;
+#else
+        std::ifstream statm("/proc/self/statm"); // Linux only
+        size_t pages, resident;
+        if(!(statm >> pages >> resident))
+        {
+            return 0;
+        }
+        return resident * static_cast<size_t>(sysconf(_SC_PAGESIZE));
+#endif
+    }
+}
@@ -0,0 +1,38 @@
+﻿#pragma once
+
+#include "IrcClient.h"
+#include "Singleton.h"
+
+namespace SudaGureum
+{
+    // Drives IrcClientPool against FakeIrcServer and reports throughput, event latency and memory per channel.
+    class IrcBenchmark : public Singleton<IrcBenchmark>
+    {
+    private:
+        // Touched only on the strand of the network's IrcClient while the pool runs.
+        struct NetworkStats
+        {
+            std::string serverName_;
+            size_t delivered_ = 0;
+            std::vector<uint32_t> deliveryLatencies_; // microseconds from the server's write to onChannelMessage
+            std::vector<uint32_t> archiveLatencies_; // microseconds from the server's write to the end of Archive insert
+        };
+
+    private:
+        IrcBenchmark();
+
+    public:
+        int run(int argc, native_char_t **argv);
+
+    private:
+        void onChannelMessage(NetworkStats &stats, const IrcClient::ChannelMessageArgs &args);
+        static size_t residentMemory(); // 0 if unknown
+
+    private:
+        bool archive_;
+        std::atomic<bool> measuring_;
+        std::atomic<size_t> synchronized_; // channels whose roster arrived
+
+        friend class Singleton<IrcBenchmark>;
+    };
+}
@@ -0,0 +1,10 @@
+﻿#include "Common.h"
+
+#include "SudaGureum.h"
+
+#include "IrcBenchmark.h"
+
+int NATIVE_MAIN_NAME(int argc, native_char_t **argv)
+{
+    return SudaGureum::IrcBenchmark::instance().run(argc, argv);
+}
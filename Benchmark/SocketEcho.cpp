@@ -0,0 +1,191 @@
+﻿#include "Common.h"
+
+#include "SocketEcho.h"
+
+namespace SudaGureum
+{
+    SocketEcho::SocketEcho(asio::io_service &ios, size_t roundTrips)
+        : strand_(ios)
+        , client_(ios)
+        , server_(ios)
+        , clientReceived_(0)
+        , roundTrips_(roundTrips)
+        , completed_(0)
+    {
+    }
+
+    size_t SocketEcho::run(size_t roundTrips, uint16_t numThreads)
+    {
+        asio::io_service ios;
+        auto echo = std::make_shared<SocketEcho>(ios, roundTrips);
+
+        // connected before the threads run; the backlog of the acceptor completes the connect
+        asio::ip::tcp::acceptor acceptor(ios, asio::ip::tcp::endpoint(asio::ip::address_v4::loopback(), 0));
+        echo->client_.socket().connect(acceptor.local_endpoint());
+        acceptor.accept(echo->server_.socket());
+        acceptor.close();
+
+        echo->start();
+
+        std::vector<std::thread> threads;
+        for(uint16_t i = 1; i < std::max<uint16_t>(numThreads, 1); ++ i)
+        {
+            threads.emplace_back([&ios]() { ios.run(); });
+        }
+        ios.run();
+        for(auto &thread: threads)
+        {
+            thread.join();
+        }
+
+        return echo->completed_;
+    }
+
+    size_t SocketEcho::stream(size_t bytes, bool waitReadable)
+    {
+        asio::io_service ios;
+        auto client = std::make_shared<TcpSocket>(ios);
+        std::shared_ptr<SocketBase> server = std::make_shared<TcpSocket>(ios);
+
+        asio::ip::tcp::acceptor acceptor(ios, asio::ip::tcp::endpoint(asio::ip::address_v4::loopback(), 0));
+        client->socket().connect(acceptor.local_endpoint());
+        acceptor.accept(std::static_pointer_cast<TcpSocket>(server)->socket());
+        acceptor.close();
+
+        std::string data(bytes, 'x');
+        client->asyncWriteDirect(asio::buffer(data), [client](const std::error_code &, size_t)
+        {
+            client->socket().shutdown(asio::ip::tcp::socket::shutdown_send);
+        });
+
+        size_t received = 0;
+        asio::co_spawn(ios,
+            [](std::shared_ptr<SocketBase> server, bool waitReadable, size_t &received) -> asio::awaitable<void>
+            {
+                std::array<char, 4096> buffer;
+                for(;;)
+                {
+                    std::error_code ec;
+                    if(waitReadable)
+                    {
+                        co_await server->waitReadable(ec);
+                    }
+                    if(!ec)
+                    {
+                        received += co_await server->readSome(asio::buffer(buffer), ec);
+                    }
+                    if(ec) // EOF once every byte is read
+                    {
+                        co_return;
+                    }
+                }
+            }(server, waitReadable, received),
+            [](std::exception_ptr e)
+            {
+                if(e)
+                {
+                    std::rethrow_exception(e); // out of ios.run
+                }
+            });
+        ios.run();
+
+        return received;
+    }
+
+    void SocketEcho::start()
+    {
+        if(roundTrips_ == 0)
+        {
+            return;
+        }
+
+        serverWait();
+        clientWrite();
+        clientRead();
+    }
+
+    void SocketEcho::clientWrite()
+    {
+        clientReceived_ = 0;
+        client_.asyncWriteDirect(asio::buffer(Line),
+            asio::bind_executor(strand_, [self = shared_from_this()](const std::error_code &, size_t) {}));
+    }
+
+    void SocketEcho::clientRead()
+    {
+        client_.asyncReadSomeDirect(asio::buffer(clientBuffer_),
+            asio::bind_executor(strand_, std::bind(
+                std::mem_fn(&SocketEcho::handleClientRead),
+                shared_from_this(),
+                StdAsioPlaceholders::error,
+                StdAsioPlaceholders::bytesTransferred
+            )));
+    }
+
+    void SocketEcho::handleClientRead(const std::error_code &ec, size_t bytesTransferred)
+    {
+        if(ec)
+        {
+            return;
+        }
+
+        // the line may come back in pieces
+        clientReceived_ += bytesTransferred;
+        if(clientReceived_ >= Line.size())
+        {
+            if(++ completed_ == roundTrips_)
+            {
+                client_.close();
+                server_.close();
+                return;
+            }
+            clientWrite();
+        }
+        clientRead();
+    }
+
+    void SocketEcho::serverWait()
+    {
+        server_.asyncWaitReadableDirect(asio::bind_executor(strand_,
+            [self = shared_from_this()](const std::error_code &ec)
+            {
+                if(ec)
+                {
+                    return;
+                }
+
+                self->server_.asyncReadSomeDirect(asio::buffer(self->serverBuffer_),
+                    asio::bind_executor(self->strand_, std::bind(
+                        std::mem_fn(&SocketEcho::handleServerRead),
+                        self,
+                        StdAsioPlaceholders::error,
+                        StdAsioPlaceholders::bytesTransferred
+                    )));
+            }));
+    }
+
+    void SocketEcho::handleServerRead(const std::error_code &ec, size_t bytesTransferred)
+    {
+        if(ec)
+        {
+            return;
+        }
+
+        server_.asyncWriteDirect(asio::buffer(serverBuffer_.data(), bytesTransferred),
+            asio::bind_executor(strand_, std::bind(
+                std::mem_fn(&SocketEcho::handleServerWrite),
+                shared_from_this(),
+                StdAsioPlaceholders::error
+            )));
+    }
+
+    void SocketEcho::handleServerWrite(const std::error_code &ec)
+    {
+        if(ec)
+        {
+            return;
+        }
+
+        serverWait(); // serverBuffer_ is free again
+    }
+}
@@ -0,0 +1,50 @@
+﻿#pragma once
+
+#include "Socket.h"
+
+namespace SudaGureum
+{
+    // Round trips of one line between two sockets on the loopback interface, through the templated socket operations
+    // only, so that HandlerAllocStats can be checked without IRC in the way. The client writes the line and reads its
+    // echo; the server waits until readable, reads and writes it back. Every handler is bound to one strand.
+    // stream checks the awaitable reads of SocketBase the same way, with a coroutine reading until EOF.
+    class SocketEcho : public std::enable_shared_from_this<SocketEcho>
+    {
+    public:
+        static constexpr std::string_view Line = "PRIVMSG #echo :round trip\r\n";
+
+    private:
+        SocketEcho(const SocketEcho &) = delete;
+        SocketEcho &operator =(const SocketEcho &) = delete;
+
+    public:
+        SocketEcho(asio::io_service &ios, size_t roundTrips);
+
+    public:
+        // Runs the round trips on numThreads threads; returns how many completed.
+        static size_t run(size_t roundTrips, uint16_t numThreads);
+
+        // Writes bytes and closes; returns how many a co_spawn'ed loop read through SocketBase::readSome until EOF,
+        // with SocketBase::waitReadable before every read if waitReadable.
+        static size_t stream(size_t bytes, bool waitReadable);
+
+    private:
+        void start();
+        void clientWrite();
+        void clientRead();
+        void handleClientRead(const std::error_code &ec, size_t bytesTransferred);
+        void serverWait();
+        void handleServerRead(const std::error_code &ec, size_t bytesTransferred);
+        void handleServerWrite(const std::error_code &ec);
+
+    private:
+        asio::io_service::strand strand_;
+        TcpSocket client_;
+        TcpSocket server_;
+        std::array<char, 512> clientBuffer_;
+        std::array<char, 512> serverBuffer_;
+        size_t clientReceived_; // of the line in this round trip
+        size_t roundTrips_;
+        size_t completed_;
+    };
+}
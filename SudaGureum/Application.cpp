@@ -5,6 +5,7 @@
 #include "Archive.h"
 #include "Configure.h"
 #include "Default.h"
+#include "Handoff.h"
 #include "IrcClient.h"
 #include "Log.h"
 #include "SCrypt.h"
@@ -113,44 +114,123 @@ namespace SudaGureum
         try // after logger setup
         {
             IrcClientPool pool;
+
+            // take over the connections of the running process, if any; it frees the listening port before this returns
+            std::string handoffPath = Configure::instance().getAs<std::string>("irc_handoff_path");
+            if(!handoffPath.empty())
+            {
+                auto payload = Handoff::receive(handoffPath);
+                if(payload.has_value())
+                {
+                    pool.adopt(std::move(payload.value()));
+                }
+            }
+
             HttpServer server(44444, true);
             registerHttpResourceProcessors(server);
 
             // auto client1 = pool.connect("altirc.ozinger.org", 80, "UTF-8", {"SudaGureum1", "SudaGureum2"});
             Users::instance().load(pool);
+            pool.discardAdopted();
 
             pool.run(4);
             server.run(4);
 
+            // set by the console when it ends, or by the handoff once the connections are passed on
+            struct Quit
+            {
+                std::mutex lock_;
+                std::condition_variable condition_;
+                bool quit_ = false;
+                bool handedOff_ = false;
+            };
+            auto quit = std::make_shared<Quit>();
+
+            std::unique_ptr<Handoff> handoff;
+            if(!handoffPath.empty())
+            {
+                handoff = std::make_unique<Handoff>(handoffPath,
+                    [&pool]()
+                    {
+                        return pool.detachAll();
+                    },
+                    [&pool, &server, quit]()
+                    {
+                        server.stop();
+                        server.join();
+                        pool.stop();
+                        pool.join();
+
+                        std::lock_guard<std::mutex> lock(quit->lock_);
+                        quit->quit_ = true;
+                        quit->handedOff_ = true;
+                        quit->condition_.notify_all();
+                    });
+            }
+
             // Sleep(100);
 
             auto user = Users::instance().user("SudaGureum");
             auto servers = user->servers();
             auto client1 = servers.find("Ozinger")->ircClient_;
 
-            while(std::cin)
+            // on its own thread, so that a handoff can end the main thread while the console waits for a line
+            std::thread console([quit, client1]()
             {
-                std::string line;
-                std::getline(std::cin, line);
+                while(std::cin)
+                {
+                    std::string line;
+                    std::getline(std::cin, line);
 
-                boost::algorithm::trim(line);
+                    boost::algorithm::trim(line);
 
-                if(line.empty())
-                {
-                    break;
-                }
+                    if(line.empty())
+                    {
+                        break;
+                    }
+
+                    auto client = client1.lock();
+                    if(!client)
+                    {
+                        continue;
+                    }
 
 #ifdef _WIN32
-                size_t wlen = static_cast<size_t>(MultiByteToWideChar(CP_ACP, 0,
-                    line.c_str(), static_cast<int>(line.size() + 1), nullptr, 0));
-                std::vector<wchar_t> wbuf(wlen);
-                MultiByteToWideChar(CP_ACP, 0,
-                    line.c_str(), static_cast<int>(line.size() + 1), wbuf.data(), static_cast<int>(wlen));
+                    size_t wlen = static_cast<size_t>(MultiByteToWideChar(CP_ACP, 0,
+                        line.c_str(), static_cast<int>(line.size() + 1), nullptr, 0));
+                    std::vector<wchar_t> wbuf(wlen);
+                    MultiByteToWideChar(CP_ACP, 0,
+                        line.c_str(), static_cast<int>(line.size() + 1), wbuf.data(), static_cast<int>(wlen));
 
-                client1.lock()->privmsg("#HNO3", encodeUtf8(wbuf.data()));
+                    client->privmsg("#HNO3", encodeUtf8(wbuf.data()));
 #else
-                client1.lock()->privmsg("#HNO3", boost::locale::conv::to_utf<char>(line, std::locale()));
+                    client->privmsg("#HNO3", boost::locale::conv::to_utf<char>(line, std::locale()));
 #endif
+                }
+
+                std::lock_guard<std::mutex> lock(quit->lock_);
+                quit->quit_ = true;
+                quit->condition_.notify_all();
+            });
+
+            {
+                std::unique_lock<std::mutex> lock(quit->lock_);
+                quit->condition_.wait(lock, [&quit]() { return quit->quit_; });
+            }
+
+            if(quit->handedOff_)
+            {
+                console.detach(); // may still be blocked on a read; it only holds quit and a weak pointer
+            }
+            else
+            {
+                console.join();
+            }
+            handoff.reset(); // waits for a handoff in progress, and no handoff from now on
+
+            if(quit->handedOff_) // the server and the pool are already stopped
+            {
+                return EXIT_SUCCESS;
             }
 
             pool.closeAll();
@@ -174,7 +254,7 @@ namespace SudaGureum
             [](HttpConnection &conn, const HttpRequest &request, HttpResponse &response)
             {
                 static const std::string Content = "Index page";
-                response.body_.assign(Content.begin(), Content.end());
+                response.body_ = IoBuffer::copyOf(Content);
                 return true;
             });
 
@@ -182,7 +262,7 @@ namespace SudaGureum
             [](HttpConnection &conn, const HttpRequest &request, HttpResponse &response)
             {
                 static const std::string Content = "Test page";
-                response.body_.assign(Content.begin(), Content.end());
+                response.body_ = IoBuffer::copyOf(Content);
                 return true;
             });
     }
@@ -18,14 +18,14 @@ namespace SudaGureum
     std::vector<LogLine> Archive::read(const std::string &serverName, const std::string &channel,
         std::chrono::system_clock::time_point begin, std::chrono::system_clock::time_point end)
     {
-        return ArchiveDB::instance().fetchLogs(userId_, serverName, channel, begin, end);
+        return ArchiveDB::instance().fetchLogs(userId_, serverName, channel, begin, end, nicknames_);
     }
 
     // [end - lines, end] if includeEnd, [end - lines, end) otherwise
     std::vector<LogLine> Archive::read(const std::string &serverName, const std::string &channel,
         std::chrono::system_clock::time_point end, size_t lines, bool includeEnd)
     {
-        return ArchiveDB::instance().fetchLogs(userId_, serverName, channel, end, lines, includeEnd);
+        return ArchiveDB::instance().fetchLogs(userId_, serverName, channel, end, lines, includeEnd, nicknames_);
     }
 
     bool Archive::insert(const std::string &serverName, const std::string &channel,
@@ -33,4 +33,10 @@ namespace SudaGureum
     {
         return ArchiveDB::instance().insertLog(userId_, serverName, channel, logLine);
     }
+
+    bool Archive::insert(const std::string &serverName, const std::string &channel,
+        const std::vector<LogLine> &logLines)
+    {
+        return ArchiveDB::instance().insertLogs(userId_, serverName, channel, logLines);
+    }
 }
@@ -1,5 +1,6 @@
 #pragma once
 
+#include "InternedString.h"
 #include "Singleton.h"
 
 namespace SudaGureum
@@ -17,9 +18,10 @@ namespace SudaGureum
         };
 
         std::chrono::system_clock::time_point time_;
-        std::string nickname_;
+        InternedString nickname_;
         LogType logType_;
         std::string message_;
+        std::string msgid_; // msgid tag, empty if the server gave none
     };
 
     class Archive
@@ -33,9 +35,11 @@ namespace SudaGureum
         std::vector<LogLine> read(const std::string &serverName, const std::string &channel,
             std::chrono::system_clock::time_point end, size_t lines, bool includeEnd);
         bool insert(const std::string &serverName, const std::string &channel, const LogLine &logLine);
+        bool insert(const std::string &serverName, const std::string &channel, const std::vector<LogLine> &logLines);
 
     private:
         std::string userId_;
+        InternPool nicknames_; // shared by the lines read
 
         friend class User;
     };
@@ -27,14 +27,19 @@
 
 #include <algorithm>
 #include <atomic>
+#include <bit>
 #include <bitset>
+#include <charconv>
 #include <chrono>
 #include <codecvt>
+#include <condition_variable>
+#include <cstring>
 #include <deque>
 #include <filesystem>
 #include <format>
 #include <fstream>
 #include <functional>
+#include <future>
 #include <iostream>
 #include <locale>
 #include <memory>
@@ -42,6 +47,7 @@
 #include <random>
 #include <ranges>
 #include <set>
+#include <span>
 #include <sstream>
 #include <stdexcept>
 #include <string>
@@ -50,12 +56,19 @@
 #include <unordered_map>
 #include <unordered_set>
 
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#    define SUDAGUREUM_SSE2
+#    include <emmintrin.h>
+#endif
+
 #define BOOST_NO_AUTO_PTR
 
 #include <boost/algorithm/string.hpp>
 #include <boost/archive/iterators/base64_from_binary.hpp>
 #include <boost/archive/iterators/binary_from_base64.hpp>
 #include <boost/archive/iterators/transform_width.hpp>
+#include <boost/container/small_vector.hpp>
+#include <boost/container/static_vector.hpp>
 #include <boost/date_time/c_time.hpp>
 #include <boost/date_time/gregorian/gregorian_types.hpp>
 #include <boost/date_time/posix_time/posix_time.hpp>
@@ -70,6 +83,7 @@
 #include <boost/regex.hpp>
 #include <boost/serialization/serialization.hpp>
 #include <boost/signals2.hpp>
+#include <boost/smart_ptr/intrusive_ptr.hpp>
 #include <boost/uuid/uuid.hpp>
 #include <boost/uuid/uuid_io.hpp>
 #include <boost/uuid/random_generator.hpp>
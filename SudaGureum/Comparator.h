@@ -2,19 +2,219 @@
 
 namespace SudaGureum
 {
+    // Case mappings of IRC names, as advertised by the CASEMAPPING ISUPPORT token.
+    enum class CaseMapping : uint8_t
+    {
+        Ascii, // A-Z only
+        Rfc1459, // also []\^ as the upper case of {}|~; the default
+        StrictRfc1459 // also []\ as the upper case of {}|
+    };
+
+    inline std::optional<CaseMapping> caseMappingFromName(std::string_view name)
+    {
+        if(name == "ascii")
+            return CaseMapping::Ascii;
+        if(name == "rfc1459")
+            return CaseMapping::Rfc1459;
+        if(name == "strict-rfc1459")
+            return CaseMapping::StrictRfc1459;
+        return std::nullopt;
+    }
+
+    // Folds to lower case; indexed by CaseMapping, then by byte.
+    inline constexpr std::array<std::array<uint8_t, 256>, 3> CaseFoldTables = []()
+    {
+        std::array<std::array<uint8_t, 256>, 3> tables = {};
+        for(auto &table: tables)
+        {
+            for(int ch = 0; ch < 256; ++ ch)
+            {
+                table[ch] = static_cast<uint8_t>((ch >= 'A' && ch <= 'Z') ? ch - 'A' + 'a' : ch);
+            }
+        }
+
+        auto &strict = tables[static_cast<size_t>(CaseMapping::StrictRfc1459)];
+        strict['['] = '{';
+        strict[']'] = '}';
+        strict['\\'] = '|';
+
+        auto &rfc1459 = tables[static_cast<size_t>(CaseMapping::Rfc1459)];
+        rfc1459 = strict;
+        rfc1459['^'] = '~';
+        return tables;
+    }();
+
+    inline const std::array<uint8_t, 256> &caseFoldTable(CaseMapping mapping)
+    {
+        return CaseFoldTables[static_cast<size_t>(mapping)];
+    }
+
+    namespace detail
+    {
+#ifdef SUDAGUREUM_SSE2
+        // Every mapping folds a single range, from 'A' to 'Z', ']' or '^', by adding 0x20.
+        inline __m128i foldBlock(const char *block, __m128i beforeFirst, __m128i afterLast)
+        {
+            __m128i value = _mm_loadu_si128(reinterpret_cast<const __m128i *>(block));
+            // bytes over 0x7F are negative, so they never fall in the range
+            __m128i upper = _mm_and_si128(_mm_cmpgt_epi8(value, beforeFirst), _mm_cmplt_epi8(value, afterLast));
+            return _mm_or_si128(value, _mm_and_si128(upper, _mm_set1_epi8(0x20)));
+        }
+
+        inline __m128i lastUpperCaseAfter(CaseMapping mapping)
+        {
+            switch(mapping)
+            {
+            case CaseMapping::Rfc1459:
+                return _mm_set1_epi8('^' + 1);
+            case CaseMapping::StrictRfc1459:
+                return _mm_set1_epi8(']' + 1);
+            default:
+                return _mm_set1_epi8('Z' + 1);
+            }
+        }
+#endif
+
+        // Index of the first byte that differs after folding, or the length of the shorter one.
+        inline size_t foldedMismatch(std::string_view lhs, std::string_view rhs, CaseMapping mapping)
+        {
+            const auto &table = caseFoldTable(mapping);
+            size_t length = std::min(lhs.size(), rhs.size());
+            size_t i = 0;
+#ifdef SUDAGUREUM_SSE2
+            if(length >= 16)
+            {
+                __m128i beforeFirst = _mm_set1_epi8('A' - 1);
+                __m128i afterLast = lastUpperCaseAfter(mapping);
+                for(; i + 16 <= length; i += 16)
+                {
+                    __m128i equal = _mm_cmpeq_epi8(
+                        foldBlock(lhs.data() + i, beforeFirst, afterLast), foldBlock(rhs.data() + i, beforeFirst, afterLast));
+                    unsigned int mask = static_cast<unsigned int>(_mm_movemask_epi8(equal));
+                    if(mask != 0xFFFF)
+                        return i + std::countr_one(mask);
+                }
+            }
+#endif
+            for(; i < length; ++ i)
+            {
+                if(table[static_cast<uint8_t>(lhs[i])] != table[static_cast<uint8_t>(rhs[i])])
+                    break;
+            }
+            return i;
+        }
+    }
+
+    // Locale-free comparisons of folded strings; long strings are compared 16 bytes at a time with SSE2.
+    inline bool equalsFolded(std::string_view lhs, std::string_view rhs, CaseMapping mapping)
+    {
+        return lhs.size() == rhs.size() && detail::foldedMismatch(lhs, rhs, mapping) == lhs.size();
+    }
+
+    // folded must already be folded under mapping; only str is folded here.
+    inline bool equalsPrefolded(std::string_view folded, std::string_view str, CaseMapping mapping)
+    {
+        if(folded.size() != str.size())
+            return false;
+
+        const auto &table = caseFoldTable(mapping);
+        for(size_t i = 0; i < folded.size(); ++ i)
+        {
+            if(static_cast<uint8_t>(folded[i]) != table[static_cast<uint8_t>(str[i])])
+                return false;
+        }
+        return true;
+    }
+
+    inline int compareFolded(std::string_view lhs, std::string_view rhs, CaseMapping mapping)
+    {
+        size_t pos = detail::foldedMismatch(lhs, rhs, mapping);
+        if(pos < lhs.size() && pos < rhs.size())
+        {
+            const auto &table = caseFoldTable(mapping);
+            return table[static_cast<uint8_t>(lhs[pos])] < table[static_cast<uint8_t>(rhs[pos])] ? -1 : 1;
+        }
+        return lhs.size() < rhs.size() ? -1 : (lhs.size() == rhs.size() ? 0 : 1);
+    }
+
+    inline size_t hashFolded(std::string_view str, CaseMapping mapping) // FNV-1a
+    {
+        const auto &table = caseFoldTable(mapping);
+        size_t hash = sizeof(size_t) == 8 ? static_cast<size_t>(14695981039346656037ull) : 2166136261u;
+        size_t prime = sizeof(size_t) == 8 ? static_cast<size_t>(1099511628211ull) : 16777619u;
+        for(char ch: str)
+        {
+            hash ^= table[static_cast<uint8_t>(ch)];
+            hash *= prime;
+        }
+        return hash;
+    }
+
+    // ASCII case-insensitive; for protocol tokens such as HTTP header names.
     struct LessCaseInsensitive
     {
-        bool operator()(const std::string &lhs, const std::string &rhs) const
+        typedef void is_transparent;
+
+        bool operator()(std::string_view lhs, std::string_view rhs) const
         {
-            return boost::algorithm::ilexicographical_compare(lhs, rhs);
+            return compareFolded(lhs, rhs, CaseMapping::Ascii) < 0;
         }
     };
 
     struct EqualToCaseInsensitive
     {
-        bool operator()(const std::string &lhs, const std::string &rhs) const
+        typedef void is_transparent;
+
+        bool operator()(std::string_view lhs, std::string_view rhs) const
+        {
+            return equalsFolded(lhs, rhs, CaseMapping::Ascii);
+        }
+    };
+
+    struct HashCaseInsensitive
+    {
+        typedef void is_transparent;
+
+        size_t operator()(std::string_view str) const
+        {
+            return hashFolded(str, CaseMapping::Ascii);
+        }
+    };
+
+    // IRC names (nicknames, channels) under the case mapping of a server.
+    struct LessCaseMapping
+    {
+        typedef void is_transparent;
+
+        CaseMapping caseMapping_ = CaseMapping::Rfc1459;
+
+        bool operator()(std::string_view lhs, std::string_view rhs) const
+        {
+            return compareFolded(lhs, rhs, caseMapping_) < 0;
+        }
+    };
+
+    struct EqualToCaseMapping
+    {
+        typedef void is_transparent;
+
+        CaseMapping caseMapping_ = CaseMapping::Rfc1459;
+
+        bool operator()(std::string_view lhs, std::string_view rhs) const
+        {
+            return equalsFolded(lhs, rhs, caseMapping_);
+        }
+    };
+
+    struct HashCaseMapping
+    {
+        typedef void is_transparent;
+
+        CaseMapping caseMapping_ = CaseMapping::Rfc1459;
+
+        size_t operator()(std::string_view str) const
         {
-            return boost::algorithm::iequals(lhs, rhs);
+            return hashFolded(str, caseMapping_);
         }
     };
 }
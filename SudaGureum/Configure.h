@@ -16,10 +16,8 @@ namespace SudaGureum
     private:
         ConfigureMap::const_iterator find(const std::string &name) const;
 
-    private:
-        bool load(const std::filesystem::path &file);
-
     public:
+        bool load(const std::filesystem::path &file); // from the command line, before anything reads the configure
         bool exists(const std::string &name) const;
         std::optional<std::string> get(const std::string &name) const;
         template<typename T>
@@ -38,6 +36,5 @@ namespace SudaGureum
         ConfigureMap confMap_;
 
         friend class Singleton<Configure>;
-        friend class Application;
     };
 }
@@ -38,6 +38,46 @@ namespace SudaGureum
 
             return (dataPath / (dbName + ".db")).string();
         }
+
+        // column is a column definition, e.g. "msgid TEXT"
+        void addColumnIfMissing(SQLite::Database &db, const std::string &table, std::string_view column)
+        {
+            std::string_view name = column.substr(0, column.find(' '));
+            SQLite::Statement query(db, "SELECT COUNT(*) FROM pragma_table_info(@table) WHERE name = @name");
+            query.bind("@table", table);
+            query.bind("@name", std::string(name));
+            if(query.executeStep() && query.getColumn(0).getInt() == 0)
+            {
+                db.exec(std::format("ALTER TABLE {} ADD COLUMN {}", table, column));
+            }
+        }
+
+        std::vector<std::string> splitList(std::string_view str)
+        {
+            std::vector<std::string> items;
+            while(!str.empty())
+            {
+                size_t space = str.find(' ');
+                if(space != 0)
+                {
+                    items.emplace_back(str.substr(0, space));
+                }
+                if(space == std::string_view::npos)
+                {
+                    break;
+                }
+                str.remove_prefix(space + 1);
+            }
+            return items;
+        }
+
+        void bindMsgId(SQLite::Statement &query, const std::string &msgid)
+        {
+            if(msgid.empty())
+                query.bind("@msgid"); // NULL
+            else
+                query.bind("@msgid", msgid);
+        }
     }
 
     const std::string ArchiveDB::DBName = "Archive";
@@ -56,18 +96,24 @@ namespace SudaGureum
             "    logTime INTEGER NOT NULL,"
             "    nickname TEXT,"
             "    logType INTEGER NOT NULL,"
-            "    message TEXT"
+            "    message TEXT,"
+            "    msgid TEXT"
             ")"
             );
+        addColumnIfMissing(db_, "Log", "msgid TEXT"); // created before msgid was stored
         db_.exec(
             "CREATE INDEX IF NOT EXISTS LogIndex ON Log (userId, serverName, channel, logTime DESC)"
             );
+        // a line fetched again by CHATHISTORY is ignored; lines without msgid (NULL) never conflict
+        db_.exec(
+            "CREATE UNIQUE INDEX IF NOT EXISTS LogMsgIdIndex ON Log (userId, serverName, channel, msgid)"
+            );
 
         tran.commit();
     }
 
     std::vector<LogLine> ArchiveDB::fetchLogs(const std::string &userId, const std::string &serverName, const std::string &channel,
-        std::chrono::system_clock::time_point begin, std::chrono::system_clock::time_point end)
+        std::chrono::system_clock::time_point begin, std::chrono::system_clock::time_point end, InternPool &nicknames)
     {
         if(begin >= end)
             return {};
@@ -79,7 +125,7 @@ namespace SudaGureum
         // boost::gregorian::date endDate = boost::posix_time::from_time_t(endEpoch).date();
 
         SQLite::Statement query(db_,
-            "SELECT idx, userId, serverName, channel, logTime, nickname, logType, message FROM Log"
+            "SELECT idx, userId, serverName, channel, logTime, nickname, logType, message, msgid FROM Log"
             " WHERE userId = @userId AND serverName = @serverName AND channel = @channel"
             " AND logTime >= @logTimeBegin AND logTime < @logTimeEnd"
             " ORDER BY idx ASC"
@@ -91,11 +137,11 @@ namespace SudaGureum
         query.bind("@logTimeBegin", beginEpoch);
         query.bind("@logTimeEnd", endEpoch);
 
-        return fetchLogs(query);
+        return fetchLogs(query, nicknames);
     }
 
     std::vector<LogLine> ArchiveDB::fetchLogs(const std::string &userId, const std::string &serverName, const std::string &channel,
-        std::chrono::system_clock::time_point end, size_t count, bool includeEnd)
+        std::chrono::system_clock::time_point end, size_t count, bool includeEnd, InternPool &nicknames)
     {
         if(count == 0)
             return {};
@@ -104,7 +150,7 @@ namespace SudaGureum
         // boost::gregorian::date endDate = boost::posix_time::from_time_t(endEpoch).date();
 
         SQLite::Statement query(db_,
-            "SELECT idx, userId, serverName, channel, logTime, nickname, logType, message FROM Log"
+            "SELECT idx, userId, serverName, channel, logTime, nickname, logType, message, msgid FROM Log"
             " WHERE userId = @userId AND serverName = @serverName AND channel = @channel"
             " AND logTime < @logTimeEnd"
             " ORDER BY idx DESC"
@@ -117,13 +163,13 @@ namespace SudaGureum
         query.bind("@logTimeEnd", endEpoch + (includeEnd ? 1 : 0));
         query.bind("@count", static_cast<int64_t>(count));
 
-        std::vector<LogLine> logs = fetchLogs(query);
+        std::vector<LogLine> logs = fetchLogs(query, nicknames);
         std::reverse(logs.begin(), logs.end());
 
         return logs;
     }
 
-    std::vector<LogLine> ArchiveDB::fetchLogs(SQLite::Statement &query)
+    std::vector<LogLine> ArchiveDB::fetchLogs(SQLite::Statement &query, InternPool &nicknames)
     {
         std::vector<LogLine> logs;
 
@@ -134,9 +180,10 @@ namespace SudaGureum
             logs.push_back(LogLine
             {
                 std::chrono::system_clock::from_time_t(logTimeEpoch),
-                query.getColumn("nickname"),
+                nicknames.intern(query.getColumn("nickname").getText()),
                 static_cast<LogLine::LogType>(query.getColumn("logType").getInt()),
                 query.getColumn("message"),
+                query.getColumn("msgid").isNull() ? std::string() : query.getColumn("msgid").getString(),
             });
         }
 
@@ -149,21 +196,56 @@ namespace SudaGureum
         time_t epoch = std::chrono::system_clock::to_time_t(logLine.time_);
 
         SQLite::Statement query(db_,
-            "INSERT INTO Log (userId, serverName, channel, logTime, nickname, logType, message)"
-            " VALUES (@userId, @serverName, @channel, @logTime, @nickname, @logType, @message)"
+            "INSERT OR IGNORE INTO Log (userId, serverName, channel, logTime, nickname, logType, message, msgid)"
+            " VALUES (@userId, @serverName, @channel, @logTime, @nickname, @logType, @message, @msgid)"
             );
 
         query.bind("@userId", userId);
         query.bind("@serverName", serverName);
         query.bind("@channel", channel);
         query.bind("@logTime", epoch);
-        query.bind("@nickname", logLine.nickname_);
+        query.bind("@nickname", logLine.nickname_.str());
         query.bind("@logType", logLine.logType_);
         query.bind("@message", logLine.message_);
+        bindMsgId(query, logLine.msgid_);
 
         return (query.exec() > 0);
     }
 
+    // All in one transaction with one statement, e.g. for a chathistory batch.
+    bool ArchiveDB::insertLogs(const std::string &userId, const std::string &serverName, const std::string &channel,
+        const std::vector<LogLine> &logLines)
+    {
+        if(logLines.empty())
+            return true;
+
+        SQLite::Transaction tran(db_);
+
+        SQLite::Statement query(db_,
+            "INSERT OR IGNORE INTO Log (userId, serverName, channel, logTime, nickname, logType, message, msgid)"
+            " VALUES (@userId, @serverName, @channel, @logTime, @nickname, @logType, @message, @msgid)"
+            );
+
+        query.bind("@userId", userId);
+        query.bind("@serverName", serverName);
+        query.bind("@channel", channel);
+
+        for(const LogLine &logLine: logLines)
+        {
+            query.bind("@logTime", std::chrono::system_clock::to_time_t(logLine.time_));
+            query.bind("@nickname", logLine.nickname_.str());
+            query.bind("@logType", logLine.logType_);
+            query.bind("@message", logLine.message_);
+            bindMsgId(query, logLine.msgid_);
+
+            query.exec(); // 0 if already archived
+            query.reset();
+        }
+
+        tran.commit();
+        return true;
+    }
+
     const std::string UserDB::DBName = "User";
 
     UserDB::UserDB()
@@ -191,20 +273,78 @@ namespace SudaGureum
             "    port INTEGER NOT NULL"
             ")"
             );
+        // lists are separated by spaces; saslMechanism is PLAIN, EXTERNAL or empty
+        for(std::string_view column: {
+            "encoding TEXT NOT NULL DEFAULT 'UTF-8'",
+            "nicknames TEXT NOT NULL DEFAULT ''",
+            "ssl INTEGER NOT NULL DEFAULT 0",
+            "channels TEXT NOT NULL DEFAULT ''",
+            "caps TEXT NOT NULL DEFAULT ''",
+            "saslMechanism TEXT NOT NULL DEFAULT ''",
+            "saslAccount TEXT NOT NULL DEFAULT ''",
+            "saslPassword TEXT NOT NULL DEFAULT ''",
+            "saslCertificateFile TEXT NOT NULL DEFAULT ''",
+            "saslPrivateKeyFile TEXT NOT NULL DEFAULT ''"})
+        {
+            addColumnIfMissing(db_, "UserServer", column);
+        }
 
         tran.commit();
     }
 
     std::vector<UserEntry> UserDB::fetchUserEntries()
     {
-        SQLite::Statement query(db_, "SELECT userId FROM User");
+        SQLite::Statement query(db_,
+            "SELECT User.userId, UserServer.* FROM User"
+            " LEFT JOIN UserServer ON UserServer.userIdx = User.idx"
+            " ORDER BY User.idx"
+            );
 
+        std::vector<UserEntry> entries;
         while(query.executeStep())
         {
             std::string userId = query.getColumn("userId");
+            if(entries.empty() || entries.back().userId_ != userId)
+            {
+                entries.push_back(UserEntry{std::move(userId), {}});
+            }
+
+            if(query.getColumn("serverName").isNull()) // no server yet
+            {
+                continue;
+            }
+
+            UserServerInfo info;
+            info.name_ = query.getColumn("serverName").getString();
+            info.host_ = query.getColumn("host").getString();
+            info.port_ = static_cast<uint16_t>(query.getColumn("port").getInt());
+            info.encoding_ = query.getColumn("encoding").getString();
+            info.nicknames_ = splitList(query.getColumn("nicknames").getString());
+            info.ssl_ = query.getColumn("ssl").getInt() != 0;
+            info.channels_ = splitList(query.getColumn("channels").getString());
+            info.caps_ = splitList(query.getColumn("caps").getString());
+
+            std::string mechanism = query.getColumn("saslMechanism");
+            if(mechanism == "PLAIN")
+            {
+                info.sasl_.mechanism_ = IrcClient::Sasl::Mechanism::Plain;
+            }
+            else if(mechanism == "EXTERNAL")
+            {
+                info.sasl_.mechanism_ = IrcClient::Sasl::Mechanism::External;
+            }
+            info.sasl_.account_ = query.getColumn("saslAccount").getString();
+            info.sasl_.password_ = query.getColumn("saslPassword").getString();
+            info.sasl_.certificateFile_ = query.getColumn("saslCertificateFile").getString();
+            info.sasl_.privateKeyFile_ = query.getColumn("saslPrivateKeyFile").getString();
+
+            if(!entries.back().servers_.insert(std::move(info)).second)
+            {
+                Log::instance().warn("UserDB: duplicated server of user {}", entries.back().userId_);
+            }
         }
 
-        return {};
+        return entries;
     }
 
     std::string UserDB::fetchPasswordHash(const std::string &userId)
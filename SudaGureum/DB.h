@@ -16,14 +16,16 @@ namespace SudaGureum
 
     public:
         std::vector<LogLine> fetchLogs(const std::string &userId, const std::string &serverName, const std::string &channel,
-            std::chrono::system_clock::time_point begin, std::chrono::system_clock::time_point end);
+            std::chrono::system_clock::time_point begin, std::chrono::system_clock::time_point end, InternPool &nicknames);
         std::vector<LogLine> fetchLogs(const std::string &userId, const std::string &serverName, const std::string &channel,
-            std::chrono::system_clock::time_point end, size_t count, bool includeEnd);
+            std::chrono::system_clock::time_point end, size_t count, bool includeEnd, InternPool &nicknames);
         bool insertLog(const std::string &userId, const std::string &serverName, const std::string &channel,
             const LogLine &logLine);
+        bool insertLogs(const std::string &userId, const std::string &serverName, const std::string &channel,
+            const std::vector<LogLine> &logLines);
 
     private:
-        std::vector<LogLine> fetchLogs(SQLite::Statement &query);
+        std::vector<LogLine> fetchLogs(SQLite::Statement &query, InternPool &nicknames);
 
     private:
         SQLite::Database db_;
@@ -12,5 +12,23 @@ namespace SudaGureum
         const long WebSocketServerCloseTimeoutSec = 5;
         const long HttpServerKeepAliveTimeoutSec = 5;
         const size_t HttpServerKeepAliveMaxCount = 20;
+        const long IrcResolverCacheTtlSec = 300;
+        const long IrcConnectionAttemptDelayMs = 250; // RFC 8305
+        const long IrcReconnectBaseDelayMs = 2000;
+        const long IrcReconnectMaxDelaySec = 300;
+        const size_t IrcReconnectPerHostLimit = 4; // concurrent reconnects to one server
+        const double IrcReconnectBurst = 10; // reconnects of the whole pool
+        const double IrcReconnectRatePerSec = 2;
+        const double IrcFloodBurst = 8; // lines
+        const double IrcFloodRatePerSec = 1; // lines; 0 disables flood control
+        const bool IrcTrafficTap = false;
+        const size_t IrcTrafficTapCapacity = 4096; // records per connection; more are dropped until the writer catches up
+        const size_t IrcTrafficTapSampleRate = 1; // record every message
+        const long IrcTrafficTapFlushIntervalMs = 1000;
+        const size_t IrcChatHistoryLines = 100; // per channel joined; 0 disables
+        const long IrcHandoffTimeoutMs = 3000; // for all connections to stop and save their state
+        const size_t SocketReadBufferMinSize = 1024; // bytes; what an idle connection keeps
+        const size_t SocketReadBufferMaxSize = 65536; // bytes; reached only while reads keep filling the buffer
+        const bool SocketReadWaitReadable = false; // idle connections keep their read buffers
     }
 }
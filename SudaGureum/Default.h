@@ -10,5 +10,23 @@ namespace SudaGureum
         extern const long WebSocketServerCloseTimeoutSec;
         extern const long HttpServerKeepAliveTimeoutSec;
         extern const size_t HttpServerKeepAliveMaxCount;
+        extern const long IrcResolverCacheTtlSec;
+        extern const long IrcConnectionAttemptDelayMs;
+        extern const long IrcReconnectBaseDelayMs;
+        extern const long IrcReconnectMaxDelaySec;
+        extern const size_t IrcReconnectPerHostLimit;
+        extern const double IrcReconnectBurst;
+        extern const double IrcReconnectRatePerSec;
+        extern const double IrcFloodBurst;
+        extern const double IrcFloodRatePerSec;
+        extern const bool IrcTrafficTap;
+        extern const size_t IrcTrafficTapCapacity;
+        extern const size_t IrcTrafficTapSampleRate;
+        extern const long IrcTrafficTapFlushIntervalMs;
+        extern const size_t IrcChatHistoryLines;
+        extern const long IrcHandoffTimeoutMs;
+        extern const size_t SocketReadBufferMinSize;
+        extern const size_t SocketReadBufferMaxSize;
+        extern const bool SocketReadWaitReadable;
     }
 }
@@ -0,0 +1,132 @@
+﻿#include "Common.h"
+
+#include "HandlerAllocator.h"
+
+namespace SudaGureum
+{
+    const char *asyncOpName(AsyncOp op)
+    {
+        switch(op)
+        {
+        case AsyncOp::Read:
+            return "read";
+        case AsyncOp::Write:
+            return "write";
+        case AsyncOp::Wait:
+            return "wait";
+        default:
+            return "unknown";
+        }
+    }
+
+    HandlerAllocStats::HandlerAllocStats()
+    {
+    }
+
+    void HandlerAllocStats::record(AsyncOp op, bool recycled)
+    {
+        auto &counter = (recycled ? local().recycled_ : local().allocated_)[static_cast<size_t>(op)];
+        counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+    }
+
+    HandlerAllocStats::Counters HandlerAllocStats::counters(AsyncOp op) const
+    {
+        Counters sum;
+        std::lock_guard<std::mutex> lock(lock_);
+        for(const auto &thread: threads_)
+        {
+            sum.recycled_ += thread->recycled_[static_cast<size_t>(op)].load(std::memory_order_relaxed);
+            sum.allocated_ += thread->allocated_[static_cast<size_t>(op)].load(std::memory_order_relaxed);
+        }
+        return sum;
+    }
+
+    HandlerAllocStats::ThreadCounters &HandlerAllocStats::local()
+    {
+        thread_local ThreadCounters *counters = nullptr;
+        if(counters == nullptr)
+        {
+            auto registered = std::make_shared<ThreadCounters>();
+            std::lock_guard<std::mutex> lock(lock_);
+            threads_.push_back(registered);
+            counters = registered.get();
+        }
+        return *counters;
+    }
+
+    HandlerMemory::HandlerMemory()
+    {
+    }
+
+    HandlerMemory::~HandlerMemory()
+    {
+        for(Slot &slot: slots_)
+        {
+            ::operator delete(slot.storage_.load(std::memory_order_relaxed));
+        }
+    }
+
+    void *HandlerMemory::allocate(AsyncOp op, size_t size)
+    {
+        // a free slot large enough first, then any free slot (grown)
+        for(bool grow: {false, true})
+        {
+            for(Slot &slot: slots_)
+            {
+                if(!grow && slot.capacity_.load(std::memory_order_relaxed) < size)
+                {
+                    continue; // only a hint; checked again once the slot is taken
+                }
+
+                if(slot.inUse_.exchange(true, std::memory_order_acquire))
+                {
+                    continue;
+                }
+
+                if(slot.capacity_.load(std::memory_order_relaxed) >= size)
+                {
+                    HandlerAllocStats::instance().record(op, true);
+                    return slot.storage_.load(std::memory_order_relaxed);
+                }
+
+                if(!grow)
+                {
+                    slot.inUse_.store(false, std::memory_order_release);
+                    continue;
+                }
+
+                void *storage = nullptr;
+                try
+                {
+                    storage = ::operator new(size);
+                }
+                catch(...)
+                {
+                    slot.inUse_.store(false, std::memory_order_release);
+                    throw;
+                }
+                ::operator delete(slot.storage_.exchange(storage, std::memory_order_relaxed));
+                slot.capacity_.store(size, std::memory_order_relaxed);
+                HandlerAllocStats::instance().record(op, false);
+                return storage;
+            }
+        }
+
+        HandlerAllocStats::instance().record(op, false);
+        return ::operator new(size);
+    }
+
+    void HandlerMemory::deallocate(void *pointer)
+    {
+        for(Slot &slot: slots_)
+        {
+            if(slot.storage_.load(std::memory_order_relaxed) == pointer)
+            {
+                slot.inUse_.store(false, std::memory_order_release);
+                return;
+            }
+        }
+
+        ::operator delete(pointer);
+    }
+}
@@ -0,0 +1,198 @@
+﻿#pragma once
+
+#include "Singleton.h"
+
+namespace SudaGureum
+{
+    enum class AsyncOp : uint8_t
+    {
+        Read,
+        Write,
+        Wait,
+        Count
+    };
+
+    const char *asyncOpName(AsyncOp op);
+
+    // Where the memory of asynchronous operations came from, per kind of operation and summed over all threads.
+    // In steady state only recycled_ should grow.
+    class HandlerAllocStats : public Singleton<HandlerAllocStats>
+    {
+    public:
+        struct Counters
+        {
+            uint64_t recycled_ = 0; // served from a slot of the connection
+            uint64_t allocated_ = 0; // from the heap: a slot grown or every slot in use
+        };
+
+    private:
+        struct ThreadCounters // written only by its thread, so no read-modify-write is needed
+        {
+            std::array<std::atomic<uint64_t>, static_cast<size_t>(AsyncOp::Count)> recycled_ = {};
+            std::array<std::atomic<uint64_t>, static_cast<size_t>(AsyncOp::Count)> allocated_ = {};
+        };
+
+    private:
+        HandlerAllocStats();
+        HandlerAllocStats(const HandlerAllocStats &) = delete;
+        HandlerAllocStats &operator =(const HandlerAllocStats &) = delete;
+
+    public:
+        void record(AsyncOp op, bool recycled);
+        Counters counters(AsyncOp op) const;
+
+    private:
+        ThreadCounters &local();
+
+    private:
+        mutable std::mutex lock_;
+        std::vector<std::shared_ptr<ThreadCounters>> threads_; // kept after their threads exit
+
+        friend class Singleton<HandlerAllocStats>;
+    };
+
+    // Memory of the asynchronous operations of one socket. Each operation in flight takes a slot, which keeps its
+    // storage when the operation completes, so a connection doing the same reads and writes over and over stops
+    // allocating after the first ones. It must outlive every operation using it; handlers keep their connection,
+    // and so the socket owning this, alive until they are run.
+    class HandlerMemory
+    {
+    private:
+        static constexpr size_t SlotCount = 3; // a read (or wait) and a write in flight, and the timer of a TLS stream
+
+        struct Slot
+        {
+            std::atomic<bool> inUse_{false};
+            std::atomic<void *> storage_{nullptr}; // written only while in use, but read to find a slot
+            std::atomic<size_t> capacity_{0};
+        };
+
+    private:
+        HandlerMemory(const HandlerMemory &) = delete;
+        HandlerMemory &operator =(const HandlerMemory &) = delete;
+
+    public:
+        HandlerMemory();
+        ~HandlerMemory();
+
+    public:
+        void *allocate(AsyncOp op, size_t size);
+        void deallocate(void *pointer);
+
+    private:
+        std::array<Slot, SlotCount> slots_;
+    };
+
+    // Allocator associated with a handler by AllocHandler; asio allocates the operation holding the handler with it.
+    template<typename T>
+    class HandlerAllocator
+    {
+    public:
+        typedef T value_type;
+
+    public:
+        HandlerAllocator(HandlerMemory &memory, AsyncOp op) noexcept
+            : memory_(&memory)
+            , op_(op)
+        {
+        }
+
+        template<typename U>
+        HandlerAllocator(const HandlerAllocator<U> &other) noexcept
+            : memory_(other.memory_)
+            , op_(other.op_)
+        {
+        }
+
+    public:
+        T *allocate(size_t n) const
+        {
+            return static_cast<T *>(memory_->allocate(op_, sizeof(T) * n));
+        }
+
+        void deallocate(T *pointer, size_t) const
+        {
+            memory_->deallocate(pointer);
+        }
+
+    public:
+        template<typename U>
+        bool operator ==(const HandlerAllocator<U> &other) const noexcept
+        {
+            return memory_ == other.memory_;
+        }
+
+        template<typename U>
+        bool operator !=(const HandlerAllocator<U> &other) const noexcept
+        {
+            return memory_ != other.memory_;
+        }
+
+    private:
+        HandlerMemory *memory_;
+        AsyncOp op_;
+
+        template<typename U>
+        friend class HandlerAllocator;
+    };
+
+    // Completion handler carrying a HandlerAllocator; the handler itself is stored in the operation as it is,
+    // without type erasure. The associated executor of the handler (e.g. a strand given by asio::bind_executor)
+    // is kept.
+    template<typename Handler>
+    class AllocHandler
+    {
+    public:
+        typedef HandlerAllocator<Handler> allocator_type;
+
+    public:
+        AllocHandler(HandlerMemory &memory, AsyncOp op, Handler handler)
+            : memory_(memory)
+            , op_(op)
+            , handler_(std::move(handler))
+        {
+        }
+
+    public:
+        allocator_type get_allocator() const noexcept
+        {
+            return allocator_type(memory_, op_);
+        }
+
+        template<typename ...Args>
+        void operator ()(Args &&...args)
+        {
+            handler_(std::forward<Args>(args)...);
+        }
+
+        const Handler &handler() const
+        {
+            return handler_;
+        }
+
+    private:
+        HandlerMemory &memory_;
+        AsyncOp op_;
+        Handler handler_;
+    };
+
+    template<typename Handler>
+    AllocHandler<std::decay_t<Handler>> makeAllocHandler(HandlerMemory &memory, AsyncOp op, Handler &&handler)
+    {
+        return AllocHandler<std::decay_t<Handler>>(memory, op, std::forward<Handler>(handler));
+    }
+}
+
+namespace asio
+{
+    template<typename Handler, typename Executor>
+    struct associated_executor<SudaGureum::AllocHandler<Handler>, Executor>
+    {
+        typedef typename associated_executor<Handler, Executor>::type type;
+
+        static type get(const SudaGureum::AllocHandler<Handler> &handler, const Executor &executor = Executor()) noexcept
+        {
+            return associated_executor<Handler, Executor>::get(handler.handler(), executor);
+        }
+    };
+}
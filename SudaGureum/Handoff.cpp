@@ -0,0 +1,318 @@
+﻿#include "Common.h"
+
+#include "Handoff.h"
+
+#include "Log.h"
+#include "Snapshot.h"
+
+#ifndef _WIN32
+#   include <sys/socket.h>
+#   include <sys/un.h>
+#   include <unistd.h>
+#endif
+
+namespace SudaGureum
+{
+#ifndef _WIN32
+    namespace
+    {
+        bool makeAddress(const std::string &path, sockaddr_un &address)
+        {
+            address = {};
+            address.sun_family = AF_UNIX;
+            if(path.size() >= sizeof(address.sun_path))
+            {
+                Log::instance().error("Handoff: socket path is too long: {}", path);
+                return false;
+            }
+            std::memcpy(address.sun_path, path.c_str(), path.size() + 1);
+            return true;
+        }
+
+        bool writeAll(int fd, std::string_view data)
+        {
+            while(!data.empty())
+            {
+                ssize_t written = ::send(fd, data.data(), data.size(), MSG_NOSIGNAL);
+                if(written < 0 && errno == EINTR)
+                    continue;
+                if(written <= 0)
+                    return false;
+                data.remove_prefix(static_cast<size_t>(written));
+            }
+            return true;
+        }
+
+        bool readAll(int fd, char *data, size_t size)
+        {
+            while(size > 0)
+            {
+                ssize_t received = ::recv(fd, data, size, 0);
+                if(received < 0 && errno == EINTR)
+                    continue;
+                if(received <= 0)
+                    return false;
+                data += received;
+                size -= static_cast<size_t>(received);
+            }
+            return true;
+        }
+
+        // One byte of data carries the descriptors.
+        bool sendFds(int fd, std::span<const int> fds)
+        {
+            char byte = 0;
+            iovec iov = {&byte, 1};
+            std::vector<char> control(CMSG_SPACE(sizeof(int) * fds.size()));
+
+            msghdr message = {};
+            message.msg_iov = &iov;
+            message.msg_iovlen = 1;
+            message.msg_control = control.data();
+            message.msg_controllen = control.size();
+
+            cmsghdr *header = CMSG_FIRSTHDR(&message);
+            header->cmsg_level = SOL_SOCKET;
+            header->cmsg_type = SCM_RIGHTS;
+            header->cmsg_len = CMSG_LEN(sizeof(int) * fds.size());
+            std::memcpy(CMSG_DATA(header), fds.data(), sizeof(int) * fds.size());
+
+            ssize_t sent;
+            do
+            {
+                sent = ::sendmsg(fd, &message, MSG_NOSIGNAL);
+            }
+            while(sent < 0 && errno == EINTR);
+            return sent == 1;
+        }
+
+        bool receiveFds(int fd, size_t count, std::vector<int> &fds)
+        {
+            char byte;
+            iovec iov = {&byte, 1};
+            std::vector<char> control(CMSG_SPACE(sizeof(int) * count));
+
+            msghdr message = {};
+            message.msg_iov = &iov;
+            message.msg_iovlen = 1;
+            message.msg_control = control.data();
+            message.msg_controllen = control.size();
+
+            ssize_t received;
+            do
+            {
+                received = ::recvmsg(fd, &message, 0);
+            }
+            while(received < 0 && errno == EINTR);
+            if(received != 1)
+                return false;
+
+            for(cmsghdr *header = CMSG_FIRSTHDR(&message); header != nullptr; header = CMSG_NXTHDR(&message, header))
+            {
+                if(header->cmsg_level != SOL_SOCKET || header->cmsg_type != SCM_RIGHTS)
+                    continue;
+
+                size_t count = (header->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+                const unsigned char *data = CMSG_DATA(header);
+                for(size_t i = 0; i < count; ++ i)
+                {
+                    int receivedFd;
+                    std::memcpy(&receivedFd, data + i * sizeof(int), sizeof(int));
+                    fds.push_back(receivedFd);
+                }
+            }
+            return (message.msg_flags & MSG_CTRUNC) == 0;
+        }
+    }
+
+    std::optional<Handoff::Payload> Handoff::receive(const std::string &path)
+    {
+        sockaddr_un address;
+        if(!makeAddress(path, address))
+        {
+            return std::nullopt;
+        }
+
+        int fd = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if(fd < 0)
+        {
+            return std::nullopt;
+        }
+
+        if(::connect(fd, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) != 0)
+        {
+            ::close(fd); // no old process; a cold start
+            return std::nullopt;
+        }
+
+        Payload payload;
+        auto fail = [fd, &payload](const char *what) -> std::optional<Payload>
+        {
+            Log::instance().error("Handoff: cannot receive {}", what);
+            for(int received: payload.fds_)
+            {
+                ::close(received);
+            }
+            ::close(fd);
+            return std::nullopt;
+        };
+
+        std::string headerData(16, '\0');
+        if(!readAll(fd, headerData.data(), headerData.size()))
+        {
+            return fail("the header");
+        }
+
+        SnapshotReader header(headerData);
+        uint32_t magic = header.readUInt32();
+        uint32_t version = header.readUInt32();
+        uint32_t fdCount = header.readUInt32();
+        uint32_t snapshotSize = header.readUInt32();
+        if(magic != Magic || version != Version)
+        {
+            return fail("a compatible header");
+        }
+
+        payload.fds_.reserve(fdCount);
+        while(payload.fds_.size() < fdCount)
+        {
+            if(!receiveFds(fd, std::min<size_t>(fdCount - payload.fds_.size(), MaxFdsPerMessage), payload.fds_))
+            {
+                return fail("the sockets");
+            }
+        }
+
+        payload.snapshot_.resize(snapshotSize);
+        if(!readAll(fd, payload.snapshot_.data(), payload.snapshot_.size()))
+        {
+            return fail("the snapshot");
+        }
+
+        // the old process closes the connection after releasing its resources
+        for(;;)
+        {
+            char byte;
+            ssize_t received = ::recv(fd, &byte, 1, 0);
+            if(received == 0 || (received < 0 && errno != EINTR))
+                break;
+        }
+        ::close(fd);
+
+        Log::instance().info("Handoff: received {} sockets and {} bytes of state", payload.fds_.size(), payload.snapshot_.size());
+        return payload;
+    }
+
+    Handoff::Handoff(std::string path, std::function<Payload ()> produce, std::function<void ()> release)
+        : path_(std::move(path))
+        , produce_(std::move(produce))
+        , release_(std::move(release))
+        , listenFd_(-1)
+    {
+        sockaddr_un address;
+        if(!makeAddress(path_, address))
+        {
+            return;
+        }
+
+        listenFd_ = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if(listenFd_ < 0)
+        {
+            throw(std::system_error(errno, std::system_category(), "cannot create the handoff socket"));
+        }
+
+        ::unlink(path_.c_str()); // left by the previous process
+        if(::bind(listenFd_, reinterpret_cast<const sockaddr *>(&address), sizeof(address)) != 0
+            || ::listen(listenFd_, 1) != 0)
+        {
+            int error = errno;
+            ::close(listenFd_);
+            listenFd_ = -1;
+            throw(std::system_error(error, std::system_category(), "cannot listen on the handoff socket"));
+        }
+
+        thread_ = std::thread(std::bind(&Handoff::run, this));
+    }
+
+    Handoff::~Handoff()
+    {
+        if(listenFd_ >= 0)
+        {
+            ::shutdown(listenFd_, SHUT_RDWR); // wakes accept up
+        }
+        if(thread_.joinable())
+        {
+            thread_.join();
+        }
+        if(listenFd_ >= 0)
+        {
+            ::close(listenFd_);
+        }
+    }
+
+    void Handoff::run()
+    {
+        int fd;
+        do
+        {
+            fd = ::accept4(listenFd_, nullptr, nullptr, SOCK_CLOEXEC);
+        }
+        while(fd < 0 && errno == EINTR);
+        if(fd < 0)
+        {
+            return; // shut down
+        }
+
+        Log::instance().info("Handoff: a new process connected; handing connections over");
+
+        Payload payload = produce_();
+
+        SnapshotWriter header;
+        header.writeUInt32(Magic);
+        header.writeUInt32(Version);
+        header.writeUInt32(static_cast<uint32_t>(payload.fds_.size()));
+        header.writeUInt32(static_cast<uint32_t>(payload.snapshot_.size()));
+
+        bool sent = writeAll(fd, header.data());
+        for(size_t pos = 0; sent && pos < payload.fds_.size(); pos += MaxFdsPerMessage)
+        {
+            sent = sendFds(fd, std::span<const int>(payload.fds_).subspan(pos, std::min(MaxFdsPerMessage, payload.fds_.size() - pos)));
+        }
+        sent = sent && writeAll(fd, payload.snapshot_);
+        if(!sent)
+        {
+            Log::instance().error("Handoff: transfer failed; the new process reconnects by itself");
+        }
+
+        // ours are closed; the new process holds its own copies now
+        for(int handedOff: payload.fds_)
+        {
+            ::close(handedOff);
+        }
+
+        release_();
+        ::close(fd);
+    }
+#else
+    std::optional<Handoff::Payload> Handoff::receive(const std::string &/*path*/)
+    {
+        return std::nullopt;
+    }
+
+    Handoff::Handoff(std::string path, std::function<Payload ()> produce, std::function<void ()> release)
+        : path_(std::move(path))
+        , produce_(std::move(produce))
+        , release_(std::move(release))
+        , listenFd_(-1)
+    {
+        Log::instance().warn("Handoff: not supported on this platform");
+    }
+
+    Handoff::~Handoff()
+    {
+    }
+
+    void Handoff::run()
+    {
+    }
+#endif
+}
@@ -0,0 +1,47 @@
+﻿#pragma once
+
+namespace SudaGureum
+{
+    // Hands IRC connections over to a new process of the bouncer through a Unix domain socket, so a restart neither
+    // drops the connections nor rejoins the channels. The old process listens; the new one connects on startup and
+    // receives a state snapshot with the sockets themselves (SCM_RIGHTS). POSIX only; a no-op on Windows.
+    class Handoff
+    {
+    public:
+        struct Payload
+        {
+            std::string snapshot_;
+            std::vector<int> fds_; // referred to by index from the snapshot
+        };
+
+    private:
+        static constexpr uint32_t Magic = 0x4F484753; // "SGHO"
+        static constexpr uint32_t Version = 3; // 2: two send lanes, 3: membership modes by PREFIX rank
+        static constexpr size_t MaxFdsPerMessage = 250; // below SCM_MAX_FD of Linux
+
+    public:
+        // Connects to the old process; nullopt if nobody listens on path or the transfer fails.
+        // Returns once the old process has released its resources (listening ports and such).
+        static std::optional<Payload> receive(const std::string &path);
+
+    private:
+        Handoff(const Handoff &) = delete;
+        Handoff &operator =(const Handoff &) = delete;
+
+    public:
+        // Listens on path. When a new process connects, produce is called on the handoff thread, and release once
+        // the payload is sent; the connection is closed after release returns.
+        Handoff(std::string path, std::function<Payload ()> produce, std::function<void ()> release);
+        ~Handoff();
+
+    private:
+        void run();
+
+    private:
+        std::string path_;
+        std::function<Payload ()> produce_;
+        std::function<void ()> release_;
+        int listenFd_;
+        std::thread thread_;
+    };
+}
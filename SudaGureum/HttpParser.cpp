@@ -67,7 +67,7 @@ namespace SudaGureum
     }
 
     std::pair<bool /* succeeded */, size_t /* upgradedPos */> HttpParser::parse(
-        const std::vector<uint8_t> &data, std::function<bool (const HttpRequest &)> cb)
+        const IoBuffer &data, std::function<bool (const HttpRequest &)> cb)
     {
         currentCallback_ = std::move(cb);
 
@@ -1,5 +1,6 @@
 ﻿#pragma once
 
+#include "IoBuffer.h"
 #include "Utility.h"
 
 namespace SudaGureum
@@ -42,7 +43,7 @@ namespace SudaGureum
     {
         uint16_t status_;
         CaseInsensitiveMap<std::string> headers_;
-        std::vector<uint8_t> body_;
+        IoBuffer body_;
 
         HttpResponse()
             : status_(0)
@@ -64,7 +65,7 @@ namespace SudaGureum
 
     public:
         std::pair<bool /* succeeded */, size_t /* upgradedPos */> parse(
-            const std::vector<uint8_t> &data, std::function<bool (const HttpRequest &)> cb);
+            const IoBuffer &data, std::function<bool (const HttpRequest &)> cb);
 
     private:
         void appendTarget(const char *str, size_t length);
@@ -15,7 +15,7 @@ namespace SudaGureum
 
     HttpConnection::HttpConnection(HttpServer &server, bool ssl)
         : server_(server)
-        , ios_(server.ios_)
+        , ios_(server.assignIoService())
         , continueRead_(true)
         , bufferToRead_()
         , upgradeWebSocket_(false)
@@ -34,7 +34,7 @@ namespace SudaGureum
         Log::instance().info("HttpConnection[{}]: connection closed", static_cast<void *>(this));
     }
 
-    void HttpConnection::sendRaw(std::vector<uint8_t> data)
+    void HttpConnection::sendRaw(IoChain data)
     {
         socket_->asyncWrite(std::move(data),
             std::bind(
@@ -44,11 +44,6 @@ namespace SudaGureum
                 StdAsioPlaceholders::bytesTransferred));
     }
 
-    void HttpConnection::sendString(const std::string &str)
-    {
-        sendRaw(std::vector<uint8_t>(str.begin(), str.end()));
-    }
-
     namespace
     {
         const char *httpStatusMessage(uint16_t status)
@@ -107,7 +102,8 @@ namespace SudaGureum
 
     void HttpConnection::sendHttpResponse(HttpResponse &&response)
     {
-        std::string headerField = std::format(
+        IoBuffer headerField(IoBuffer::SizeClasses[1]);
+        std::format_to(std::back_inserter(headerField),
             "HTTP/1.1 {} {}\r\n"
             "Server: SudaGureum HTTP Server\r\n"
             "Date: {}\r\n"
@@ -117,12 +113,11 @@ namespace SudaGureum
             response.body_.size());
         for(const auto &header : response.headers_)
         {
-            headerField += std::format("{}: {}\r\n", header.first, header.second);
+            std::format_to(std::back_inserter(headerField), "{}: {}\r\n", header.first, header.second);
         }
-        headerField += "\r\n";
+        headerField.append("\r\n");
 
-        sendString(headerField);
-        sendRaw(std::move(response.body_));
+        sendRaw(IoChain{std::move(headerField), std::move(response.body_)});
     }
 
     void HttpConnection::sendHttpResponse(const HttpRequest &request, HttpResponse &&response)
@@ -139,7 +134,7 @@ namespace SudaGureum
         if(useDeflate)
         {
             unsigned long bufLen = static_cast<unsigned long>(response.body_.size() + 32);
-            std::vector<uint8_t> buf(bufLen);
+            IoBuffer buf(bufLen);
             compress2(buf.data(), &bufLen, response.body_.data(), static_cast<unsigned long>(response.body_.size()), Z_BEST_COMPRESSION);
 
             if(bufLen < response.body_.size())
@@ -156,7 +151,8 @@ namespace SudaGureum
 
         response.headers_.insert({"Connection", "close"});
 
-        std::string headerField = std::format(
+        IoBuffer headerField(IoBuffer::SizeClasses[1]);
+        std::format_to(std::back_inserter(headerField),
             "HTTP/{} {} {}\r\n"
             "Server: SudaGureum HTTP Server\r\n"
             "Date: {}\r\n"
@@ -166,12 +162,11 @@ namespace SudaGureum
             response.body_.size());
         for(const auto &header : response.headers_)
         {
-            headerField += std::format("{}: {}\r\n", header.first, header.second);
+            std::format_to(std::back_inserter(headerField), "{}: {}\r\n", header.first, header.second);
         }
-        headerField += "\r\n";
+        headerField.append("\r\n");
 
-        sendString(headerField);
-        sendRaw(std::move(response.body_));
+        sendRaw(IoChain{std::move(headerField), std::move(response.body_)}); // header and body in one write
     }
 
     void HttpConnection::sendBadRequestResponse()
@@ -184,7 +179,7 @@ namespace SudaGureum
         {
             {"Content-Type", "text/plain"},
         };
-        response.body_.assign(Body.begin(), Body.end());
+        response.body_ = IoBuffer::copyOf(Body);
 
         sendHttpResponse(std::move(response));
     }
@@ -205,13 +200,46 @@ namespace SudaGureum
             return;
         }
 
-        socket_->asyncReadSome(
-            asio::buffer(bufferToRead_),
-            std::bind(
-                std::mem_fn(&HttpConnection::handleRead),
-                shared_from_this(),
-                StdAsioPlaceholders::error,
-                StdAsioPlaceholders::bytesTransferred));
+        bool waiting = false;
+        if(bufferToRead_.waitReadable())
+        {
+            visitSocket(*socket_, [this, &waiting](auto &socket)
+            {
+                if constexpr(std::remove_reference_t<decltype(socket)>::WaitsReadable)
+                {
+                    socket.asyncWaitReadableDirect(
+                        std::bind(
+                            std::mem_fn(&HttpConnection::handleReadable),
+                            shared_from_this(),
+                            StdAsioPlaceholders::error));
+                    waiting = true;
+                }
+            });
+        }
+
+        if(!waiting)
+        {
+            readSome();
+        }
+    }
+
+    void HttpConnection::readSome()
+    {
+        if(!socket_)
+        {
+            return;
+        }
+
+        visitSocket(*socket_, [this](auto &socket)
+        {
+            socket.asyncReadSomeDirect(
+                bufferToRead_.prepare(),
+                std::bind(
+                    std::mem_fn(&HttpConnection::handleRead),
+                    shared_from_this(),
+                    StdAsioPlaceholders::error,
+                    StdAsioPlaceholders::bytesTransferred));
+        });
     }
 
     void HttpConnection::close()
@@ -249,6 +277,17 @@ namespace SudaGureum
         read();
     }
 
+    void HttpConnection::handleReadable(const std::error_code &ec)
+    {
+        if(ec)
+        {
+            handleRead(ec, 0);
+            return;
+        }
+
+        readSome();
+    }
+
     void HttpConnection::handleRead(const std::error_code &ec, size_t bytesTransferred)
     {
         if(!continueRead_)
@@ -265,10 +304,9 @@ namespace SudaGureum
             return;
         }
 
-        std::vector<uint8_t> data(bufferToRead_.begin(), bufferToRead_.begin() + bytesTransferred);
+        IoBuffer data = bufferToRead_.commit(bytesTransferred);
 
-        auto res = parser_.parse(std::vector<uint8_t>(bufferToRead_.begin(), bufferToRead_.begin() + bytesTransferred),
-            std::bind(&HttpConnection::procHttpRequest, this, std::placeholders::_1));
+        auto res = parser_.parse(data, std::bind(&HttpConnection::procHttpRequest, this, std::placeholders::_1));
         if(!res.first)
         {
             Log::instance().warn("HttpConnection[{}]: read: invalid data received", static_cast<void *>(this));
@@ -281,9 +319,8 @@ namespace SudaGureum
             if(upgradeWebSocket_)
             {
                 Log::instance().info("HttpConnection[{}]: read: upgrade to web socket", static_cast<void *>(this));
-                data.erase(data.begin(), data.begin() + res.second);
-                std::shared_ptr<WebSocketConnection> wsConn(new WebSocketConnection(server_, std::move(socket_), data));
-                wsConn->handleRead(std::error_code(), data.size());
+                std::shared_ptr<WebSocketConnection> wsConn(new WebSocketConnection(server_, ios_, std::move(socket_)));
+                wsConn->start(data.slice(res.second, data.size() - res.second));
             }
             else
             {
@@ -356,9 +393,10 @@ namespace SudaGureum
             auto hash = hashSha1(std::vector<uint8_t>(accept.begin(), accept.end()));
             std::string acceptHashed = encodeBase64(std::vector<uint8_t>(hash.begin(), hash.end()));
 
-            std::string response = std::format(responseFormat,
+            IoBuffer response(IoBuffer::SizeClasses.front());
+            std::format_to(std::back_inserter(response), responseFormat,
                 generateHttpDateTime(std::chrono::system_clock::now()), acceptHashed);
-            sendRaw(std::vector<uint8_t>(response.begin(), response.end()));
+            sendRaw(std::move(response));
 
             upgradeWebSocket_ = true;
             return true;
@@ -379,7 +417,7 @@ namespace SudaGureum
             response.headers_ = {
                 {"Content-Type", "text/plain; charset=UTF-8"}
             };
-            response.body_.assign(Content.begin(), Content.end());
+            response.body_ = IoBuffer::copyOf(Content);
         }
 
         if(keepAlive)
@@ -412,7 +450,8 @@ namespace SudaGureum
     }
 
     HttpServer::HttpServer(uint16_t port, bool ssl)
-        : ssl_(ssl)
+        : MtIoService("http_server")
+        , ssl_(ssl)
         , acceptor_(ios_)
     {
         try
@@ -2,6 +2,7 @@
 
 #include "HttpParser.h"
 #include "MtIoService.h"
+#include "ReadBuffer.h"
 #include "Socket.h"
 
 namespace SudaGureum
@@ -27,8 +28,8 @@ namespace SudaGureum
     private:
         void startSsl();
         void read();
-        void sendRaw(std::vector<uint8_t> data);
-        void sendString(const std::string &str);
+        void readSome();
+        void sendRaw(IoChain data);
         void close();
         void setKeepAliveTimeout();
         void cancelKeepAliveTimeout();
@@ -40,6 +41,7 @@ namespace SudaGureum
 
     private:
         void handleHandshake(const std::error_code &ec);
+        void handleReadable(const std::error_code &ec);
         void handleRead(const std::error_code &ec, size_t bytesTransferred);
         void handleWrite(const std::error_code &ec, size_t bytesTransferred);
         void handleKeepAliveTimeout(const std::error_code &ec);
@@ -52,7 +54,7 @@ namespace SudaGureum
 
         HttpParser parser_;
         std::atomic<bool> continueRead_;
-        std::array<uint8_t, 65536> bufferToRead_;
+        ReadBuffer bufferToRead_;
 
         bool upgradeWebSocket_;
 
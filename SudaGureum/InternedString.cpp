@@ -0,0 +1,85 @@
+﻿#include "Common.h"
+
+#include "InternedString.h"
+
+namespace SudaGureum
+{
+    struct InternPool::State
+    {
+        std::atomic<size_t> refs_;
+        mutable std::mutex lock_;
+        std::unordered_map<std::string_view, InternedString::Node *> entries_; // keys view Node::str_
+    };
+
+    void intrusive_ptr_add_ref(InternPool::State *state)
+    {
+        state->refs_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void intrusive_ptr_release(InternPool::State *state)
+    {
+        if(state->refs_.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            delete state;
+    }
+
+    void intrusive_ptr_add_ref(InternedString::Node *node)
+    {
+        node->refs_.fetch_add(1, std::memory_order_relaxed);
+    }
+
+    void intrusive_ptr_release(InternedString::Node *node)
+    {
+        if(node->refs_.fetch_sub(1, std::memory_order_acq_rel) != 1)
+            return;
+
+        {
+            // intern may have already replaced the dead entry with a new one
+            std::lock_guard<std::mutex> lock(node->pool_->lock_);
+            auto it = node->pool_->entries_.find(node->str_);
+            if(it != node->pool_->entries_.end() && it->second == node)
+                node->pool_->entries_.erase(it);
+        }
+        delete node;
+    }
+
+    InternPool::InternPool()
+        : state_(new State{{0}, {}, {}})
+    {
+    }
+
+    InternedString InternPool::intern(std::string_view str)
+    {
+        if(str.empty())
+            return InternedString();
+
+        std::lock_guard<std::mutex> lock(state_->lock_);
+        auto it = state_->entries_.find(str);
+        if(it != state_->entries_.end())
+        {
+            // revive the entry only if it is still alive; one that reached 0 is being freed by its last owner
+            InternedString::Node *node = it->second;
+            size_t refs = node->refs_.load(std::memory_order_relaxed);
+            while(refs != 0)
+            {
+                if(node->refs_.compare_exchange_weak(refs, refs + 1, std::memory_order_relaxed))
+                    return InternedString(node);
+            }
+            state_->entries_.erase(it);
+        }
+
+        auto node = new InternedString::Node{{1}, state_, std::string(str)};
+        state_->entries_.emplace(node->str_, node);
+        return InternedString(node);
+    }
+
+    size_t InternPool::size() const
+    {
+        std::lock_guard<std::mutex> lock(state_->lock_);
+        return state_->entries_.size();
+    }
+
+    InternedString::InternedString(Node *node)
+        : node_(node, false)
+    {
+    }
+}
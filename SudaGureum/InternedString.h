@@ -0,0 +1,92 @@
+﻿#pragma once
+
+namespace SudaGureum
+{
+    class InternedString;
+
+    // Reference-counted intern table; copies of a pool share the same table.
+    // Entries are freed as soon as the last InternedString pointing at them goes away, and handles may
+    // outlive the pool. Thread-safe.
+    class InternPool
+    {
+    private:
+        struct State;
+
+    public:
+        InternPool();
+
+    public:
+        InternedString intern(std::string_view str);
+        size_t size() const; // number of live entries
+
+    private:
+        boost::intrusive_ptr<State> state_;
+
+        friend class InternedString;
+        friend void intrusive_ptr_add_ref(State *state);
+        friend void intrusive_ptr_release(State *state);
+    };
+
+    // Immutable string stored once in an InternPool; copying a handle only bumps a reference count.
+    // Handles from the same pool are equal if and only if they point at the same entry.
+    // A default-constructed handle is the empty string, as is the result of interning one.
+    class InternedString
+    {
+    private:
+        struct Node
+        {
+            std::atomic<size_t> refs_; // never goes back up once it reaches 0
+            boost::intrusive_ptr<InternPool::State> pool_;
+            std::string str_;
+        };
+
+    public:
+        InternedString() = default;
+
+    public:
+        const std::string &str() const
+        {
+            static const std::string Empty;
+            return node_ ? node_->str_ : Empty;
+        }
+
+        operator std::string_view() const
+        {
+            return str();
+        }
+
+        bool empty() const
+        {
+            return !node_;
+        }
+
+        size_t size() const
+        {
+            return str().size();
+        }
+
+        friend bool operator ==(const InternedString &lhs, const InternedString &rhs)
+        {
+            if(lhs.node_ == rhs.node_)
+                return true;
+            if(!lhs.node_ || !rhs.node_ || lhs.node_->pool_ == rhs.node_->pool_)
+                return false;
+            return lhs.node_->str_ == rhs.node_->str_;
+        }
+
+        friend bool operator ==(const InternedString &lhs, std::string_view rhs)
+        {
+            return lhs.str() == rhs;
+        }
+
+    private:
+        explicit InternedString(Node *node); // adopts a reference
+
+    private:
+        boost::intrusive_ptr<Node> node_;
+
+        friend class InternPool;
+        friend void intrusive_ptr_add_ref(Node *node);
+        friend void intrusive_ptr_release(Node *node);
+    };
+}
@@ -0,0 +1,303 @@
+﻿#include "Common.h"
+
+#include "IoBuffer.h"
+
+namespace SudaGureum
+{
+    namespace
+    {
+        constexpr size_t MaxFreeBytesPerClass = 1024 * 1024; // per thread
+        constexpr size_t MinFreeBlocksPerClass = 4;
+
+        thread_local bool freeListsDestroyed = false; // trivially destructible, so still readable at thread exit
+    }
+
+    struct IoBuffer::FreeLists
+    {
+        std::array<Block *, SizeClasses.size()> heads_ = {};
+        std::array<size_t, SizeClasses.size()> counts_ = {};
+
+        ~FreeLists()
+        {
+            for(Block *head: heads_)
+            {
+                while(head != nullptr)
+                {
+                    Block *next = head->nextFree_;
+                    head->~Block();
+                    ::operator delete(head);
+                    head = next;
+                }
+            }
+            freeListsDestroyed = true;
+        }
+
+        static FreeLists &instance()
+        {
+            thread_local FreeLists lists;
+            return lists;
+        }
+    };
+
+    IoBuffer::Block *IoBuffer::allocate(size_t capacity)
+    {
+        auto sizeClassIt = std::lower_bound(SizeClasses.begin(), SizeClasses.end(), capacity);
+        uint8_t sizeClass = sizeClassIt == SizeClasses.end() ? NoSizeClass : static_cast<uint8_t>(sizeClassIt - SizeClasses.begin());
+
+        if(sizeClass != NoSizeClass && !freeListsDestroyed)
+        {
+            FreeLists &lists = FreeLists::instance();
+            if(Block *block = lists.heads_[sizeClass])
+            {
+                lists.heads_[sizeClass] = block->nextFree_;
+                -- lists.counts_[sizeClass];
+                block->refs_.store(1, std::memory_order_relaxed);
+                return block;
+            }
+            capacity = *sizeClassIt;
+        }
+
+        void *memory = ::operator new(sizeof(Block) + capacity);
+        return new(memory) Block{{1}, sizeClass, capacity, nullptr};
+    }
+
+    void IoBuffer::release(Block *block)
+    {
+        if(block->refs_.fetch_sub(1, std::memory_order_acq_rel) != 1)
+        {
+            return;
+        }
+
+        if(block->sizeClass_ != NoSizeClass && !freeListsDestroyed)
+        {
+            FreeLists &lists = FreeLists::instance();
+            size_t limit = std::max(MinFreeBlocksPerClass, MaxFreeBytesPerClass / block->capacity_);
+            if(lists.counts_[block->sizeClass_] < limit)
+            {
+                block->nextFree_ = lists.heads_[block->sizeClass_];
+                lists.heads_[block->sizeClass_] = block;
+                ++ lists.counts_[block->sizeClass_];
+                return;
+            }
+        }
+
+        block->~Block();
+        ::operator delete(block);
+    }
+
+    IoBuffer::IoBuffer() noexcept
+        : block_(nullptr)
+        , offset_(0)
+        , size_(0)
+    {
+    }
+
+    IoBuffer::IoBuffer(size_t capacity)
+        : block_(capacity > 0 ? allocate(capacity) : nullptr)
+        , offset_(0)
+        , size_(0)
+    {
+    }
+
+    IoBuffer::IoBuffer(const IoBuffer &other) noexcept
+        : block_(other.block_)
+        , offset_(other.offset_)
+        , size_(other.size_)
+    {
+        if(block_)
+        {
+            block_->refs_.fetch_add(1, std::memory_order_relaxed);
+        }
+    }
+
+    IoBuffer::IoBuffer(IoBuffer &&other) noexcept
+        : block_(std::exchange(other.block_, nullptr))
+        , offset_(std::exchange(other.offset_, 0))
+        , size_(std::exchange(other.size_, 0))
+    {
+    }
+
+    IoBuffer::~IoBuffer()
+    {
+        if(block_)
+        {
+            release(block_);
+        }
+    }
+
+    IoBuffer &IoBuffer::operator =(IoBuffer other) noexcept
+    {
+        std::swap(block_, other.block_);
+        std::swap(offset_, other.offset_);
+        std::swap(size_, other.size_);
+        return *this;
+    }
+
+    IoBuffer IoBuffer::copyOf(std::span<const uint8_t> data)
+    {
+        IoBuffer buffer(data.size());
+        buffer.append(data.data(), data.size());
+        return buffer;
+    }
+
+    IoBuffer IoBuffer::copyOf(std::string_view data)
+    {
+        IoBuffer buffer(data.size());
+        buffer.append(data);
+        return buffer;
+    }
+
+    const uint8_t *IoBuffer::data() const
+    {
+        return block_ ? block_->data() + offset_ : nullptr;
+    }
+
+    uint8_t *IoBuffer::data()
+    {
+        return block_ ? block_->data() + offset_ : nullptr;
+    }
+
+    size_t IoBuffer::size() const
+    {
+        return size_;
+    }
+
+    bool IoBuffer::empty() const
+    {
+        return size_ == 0;
+    }
+
+    size_t IoBuffer::capacity() const
+    {
+        return block_ ? block_->capacity_ - offset_ : 0;
+    }
+
+    std::span<const uint8_t> IoBuffer::span() const
+    {
+        return {data(), size_};
+    }
+
+    asio::const_buffer IoBuffer::buffer() const
+    {
+        return asio::const_buffer(data(), size_);
+    }
+
+    IoBuffer IoBuffer::slice(size_t offset, size_t length) const
+    {
+        if(offset > size_ || length > size_ - offset)
+        {
+            throw(std::out_of_range("IoBuffer::slice out of range"));
+        }
+
+        IoBuffer sliced(*this);
+        sliced.offset_ += offset;
+        sliced.size_ = length;
+        return sliced;
+    }
+
+    void IoBuffer::clear()
+    {
+        size_ = 0;
+    }
+
+    void IoBuffer::reserve(size_t capacity)
+    {
+        if(capacity <= this->capacity() && !shared())
+        {
+            return;
+        }
+
+        // grow geometrically so appending a byte at a time stays amortized
+        IoBuffer grown(std::max({capacity, size_ * 2, SizeClasses.front()}));
+        if(size_ > 0)
+        {
+            std::memcpy(grown.data(), data(), size_);
+        }
+        grown.size_ = size_;
+        *this = std::move(grown);
+    }
+
+    void IoBuffer::resize(size_t size)
+    {
+        if(size > size_)
+        {
+            reserve(size);
+        }
+        size_ = size;
+    }
+
+    void IoBuffer::append(const void *data, size_t length)
+    {
+        if(length == 0)
+        {
+            return;
+        }
+
+        if(size_ + length > capacity() || shared())
+        {
+            reserve(size_ + length);
+        }
+        std::memcpy(this->data() + size_, data, length);
+        size_ += length;
+    }
+
+    void IoBuffer::append(std::string_view str)
+    {
+        append(str.data(), str.size());
+    }
+
+    void IoBuffer::push_back(char ch)
+    {
+        append(&ch, 1);
+    }
+
+    bool IoBuffer::shared() const
+    {
+        return block_ && block_->refs_.load(std::memory_order_acquire) > 1;
+    }
+
+    IoChain::IoChain()
+    {
+    }
+
+    IoChain::IoChain(IoBuffer buffer)
+    {
+        push_back(std::move(buffer));
+    }
+
+    IoChain::IoChain(std::initializer_list<IoBuffer> buffers)
+    {
+        for(const IoBuffer &buffer: buffers)
+        {
+            push_back(buffer);
+        }
+    }
+
+    void IoChain::push_back(IoBuffer buffer)
+    {
+        if(!buffer.empty())
+        {
+            buffers_.push_back(std::move(buffer));
+        }
+    }
+
+    const IoChain::Buffers &IoChain::buffers() const
+    {
+        return buffers_;
+    }
+
+    size_t IoChain::size() const
+    {
+        size_t size = 0;
+        for(const IoBuffer &buffer: buffers_)
+        {
+            size += buffer.size();
+        }
+        return size;
+    }
+
+    bool IoChain::empty() const
+    {
+        return buffers_.empty();
+    }
+}
@@ -0,0 +1,96 @@
+﻿#pragma once
+
+namespace SudaGureum
+{
+    // Reference-counted byte buffer for I/O. Copies and slices share the storage, so one payload can be queued to
+    // several sockets or wrapped by a header without copying it. Storage comes in size classes and is recycled through
+    // freelists of the thread that releases it; a buffer larger than every class is allocated on its own.
+    // Growing a buffer (resize, append) reallocates if the storage is shared, but writing through data() is seen by
+    // every sharer; fill a buffer before handing it out.
+    class IoBuffer
+    {
+    public:
+        typedef char value_type; // for std::back_inserter, e.g. with std::format_to
+
+        static constexpr std::array<size_t, 5> SizeClasses = {256, 1024, 4096, 16384, 65536};
+
+    private:
+        static constexpr uint8_t NoSizeClass = 0xFF;
+
+        struct alignas(16) Block // followed by the data
+        {
+            std::atomic<uint32_t> refs_;
+            uint8_t sizeClass_; // index into SizeClasses, or NoSizeClass
+            size_t capacity_;
+            Block *nextFree_;
+
+            uint8_t *data() { return reinterpret_cast<uint8_t *>(this + 1); }
+        };
+
+        struct FreeLists;
+
+    private:
+        static Block *allocate(size_t capacity);
+        static void release(Block *block);
+
+    public:
+        IoBuffer() noexcept;
+        explicit IoBuffer(size_t capacity); // empty, with room for capacity bytes
+        IoBuffer(const IoBuffer &other) noexcept;
+        IoBuffer(IoBuffer &&other) noexcept;
+        ~IoBuffer();
+
+        IoBuffer &operator =(IoBuffer other) noexcept;
+
+    public:
+        static IoBuffer copyOf(std::span<const uint8_t> data);
+        static IoBuffer copyOf(std::string_view data);
+
+    public:
+        const uint8_t *data() const;
+        uint8_t *data();
+        size_t size() const;
+        bool empty() const;
+        size_t capacity() const; // from data()
+
+        std::span<const uint8_t> span() const;
+        asio::const_buffer buffer() const;
+
+        IoBuffer slice(size_t offset, size_t length) const; // shares the storage
+
+        void clear();
+        void reserve(size_t capacity);
+        void resize(size_t size);
+        void append(const void *data, size_t length);
+        void append(std::string_view str);
+        void push_back(char ch);
+
+        bool shared() const; // another IoBuffer refers to the same storage
+
+    private:
+        Block *block_; // nullptr if empty and never allocated
+        size_t offset_;
+        size_t size_;
+    };
+
+    // Buffers written back to back, e.g. a header and a shared payload; written with one gather write.
+    class IoChain
+    {
+    public:
+        typedef boost::container::small_vector<IoBuffer, 2> Buffers;
+
+    public:
+        IoChain();
+        IoChain(IoBuffer buffer);
+        IoChain(std::initializer_list<IoBuffer> buffers);
+
+    public:
+        void push_back(IoBuffer buffer); // empty buffers are dropped
+        const Buffers &buffers() const;
+        size_t size() const; // in bytes
+        bool empty() const;
+
+    private:
+        Buffers buffers_;
+    };
+}
@@ -6,7 +6,11 @@
 #include "Configure.h"
 #include "Default.h"
 #include "Log.h"
+#include "Resolver.h"
+#include "Snapshot.h"
 #include "Socket.h"
+#include "TokenBucket.h"
+#include "TrafficTap.h"
 #include "Utility.h"
 
 namespace SudaGureum
@@ -29,9 +33,28 @@ namespace SudaGureum
         {
             std::string line;
 
+            if(!message.tags_.empty())
+            {
+                line = "@";
+                for(auto it = message.tags_.begin(); it != message.tags_.end(); ++ it)
+                {
+                    if(it != message.tags_.begin())
+                    {
+                        line += ";";
+                    }
+                    line += it->first;
+                    if(!it->second.empty())
+                    {
+                        line += "=";
+                        line += escapeTagValue(it->second);
+                    }
+                }
+                line += " ";
+            }
+
             if(!message.prefix_.empty())
             {
-                line = ":";
+                line += ":";
                 line += message.prefix_;
                 line += " ";
             }
@@ -53,59 +76,102 @@ namespace SudaGureum
             return line;
         }
 
-        static size_t participantModeFromPermission(char permission)
+        // Bit of Participant::modes_ for a membership mode advertised by PREFIX.
+        size_t participantModeFromPermission(const ServerCapabilities &capabilities, char permission)
+        {
+            uint8_t rank = capabilities.prefixRank(permission);
+            return rank != 0 ? rank - 1 : std::numeric_limits<size_t>::max();
+        }
+
+        std::chrono::system_clock::time_point messageTime(const IrcMessageView &message)
         {
-            switch(permission)
+            auto time = message.tags_.find("time");
+            if(time.has_value())
             {
-            case 'q':
-                return IrcClient::Participant::Owner;
-            case 'a':
-                return IrcClient::Participant::Admin;
-            case 'o':
-                return IrcClient::Participant::Op;
-            case 'h':
-                return IrcClient::Participant::HalfOp;
-            case 'v':
-                return IrcClient::Participant::Voice;
+                auto parsed = parseIsoDateTime(time.value());
+                if(parsed.has_value())
+                    return parsed.value();
             }
-            return std::numeric_limits<size_t>::max();
+            return std::chrono::system_clock::now();
+        }
+
+        bool isHistoryBatchType(std::string_view type)
+        {
+            return type == "chathistory" || type == "draft/chathistory";
         }
     }
 
-    const IrcClient::NicknamePrefixMap IrcClient::DefaultNicknamePrefixMap =
+    // Dictionary order.
+    const std::array<std::string_view, 7> IrcClient::SupportedCaps =
     {
-        {'~', 'q'}, {'&', 'a'}, {'@', 'o'}, {'%', 'h'}, {'+', 'v'}
+        "batch", "chathistory", "draft/chathistory", "echo-message", "message-tags", "multi-prefix", "server-time"
     };
 
-    std::string IrcClient::getNicknameFromPrefix(std::string prefix)
+    const std::array<IrcClient::ProcFn, IrcClient::CommandSlotCount> IrcClient::ProcTable = []()
     {
-        size_t userPrefixPos = prefix.find("!");
-        if(userPrefixPos != std::string::npos)
-        {
-            return std::move(prefix.erase(userPrefixPos, std::string::npos));
-        }
-
-        size_t hostPrefixPos = prefix.find("@");
-        if(hostPrefixPos != std::string::npos)
-        {
-            return std::move(prefix.erase(hostPrefixPos, std::string::npos));
-        }
-
-        return prefix;
-    }
+        std::array<ProcFn, CommandSlotCount> table = {};
+        auto slot = [](IrcCommand command) { return static_cast<size_t>(command); };
 
-    IrcClient::IrcClient(IrcClientPool &pool, size_t connectionId)
+        // Dictionary order; letters first.
+        table[slot(IrcCommand::Authenticate)] = &IrcClient::procAuthenticate;
+        table[slot(IrcCommand::Batch)] = &IrcClient::procBatch;
+        table[slot(IrcCommand::Cap)] = &IrcClient::procCap;
+        table[slot(IrcCommand::Error)] = &IrcClient::procError;
+        table[slot(IrcCommand::Join)] = &IrcClient::procJoin;
+        table[slot(IrcCommand::Mode)] = &IrcClient::procMode;
+        table[slot(IrcCommand::Nick)] = &IrcClient::procNick;
+        table[slot(IrcCommand::Notice)] = &IrcClient::procNotice;
+        table[slot(IrcCommand::Part)] = &IrcClient::procPart;
+        table[slot(IrcCommand::Ping)] = &IrcClient::procPing;
+        table[slot(IrcCommand::Privmsg)] = &IrcClient::procPrivmsg;
+        table[slot(IrcCommand::RplWelcome)] = &IrcClient::procWelcome;
+        table[slot(IrcCommand::RplISupport)] = &IrcClient::procISupport;
+        table[slot(IrcCommand::RplNoTopic)] = &IrcClient::procNoTopic;
+        table[slot(IrcCommand::RplTopic)] = &IrcClient::procTopic;
+        table[slot(IrcCommand::RplTopicWhoTime)] = &IrcClient::procTopicWhoTime;
+        table[slot(IrcCommand::RplNamReply)] = &IrcClient::procNamReply;
+        table[slot(IrcCommand::RplEndOfNames)] = &IrcClient::procEndOfNames;
+        table[slot(IrcCommand::ErrErroneusNickname)] = &IrcClient::procNicknameUnavailable;
+        table[slot(IrcCommand::ErrNicknameInUse)] = &IrcClient::procNicknameUnavailable;
+        table[slot(IrcCommand::ErrNickCollision)] = &IrcClient::procNicknameUnavailable;
+        table[slot(IrcCommand::ErrUnavailResource)] = &IrcClient::procNicknameUnavailable;
+        table[slot(IrcCommand::RplLoggedIn)] = &IrcClient::procLoggedIn;
+        table[slot(IrcCommand::RplSaslSuccess)] = &IrcClient::procSaslEnd;
+        table[slot(IrcCommand::ErrSaslFail)] = &IrcClient::procSaslEnd;
+        table[slot(IrcCommand::ErrSaslTooLong)] = &IrcClient::procSaslEnd;
+        table[slot(IrcCommand::ErrSaslAborted)] = &IrcClient::procSaslEnd;
+        table[slot(IrcCommand::ErrSaslAlready)] = &IrcClient::procSaslEnd;
+
+        return table;
+    }();
+
+    IrcClient::IrcClient(IrcClientPool &pool, size_t connectionId, asio::io_service &ios)
         : pool_(pool)
         , connectionId_(connectionId)
-        , ios_(pool.ios_)
+        , ios_(ios)
+        , strand_(ios_)
+        , tap_(TrafficTapWriter::instance().create(std::format("IrcClient-{}", connectionId)))
         , bufferToRead_()
+        , writeBatchCount_(0)
         , inWrite_(false)
-        , nicknamePrefixMap_(DefaultNicknamePrefixMap)
+        , floodBucket_(
+            Configure::instance().getAs("irc_flood_burst", DefaultConfigureValue::IrcFloodBurst),
+            Configure::instance().getAs("irc_flood_rate_per_sec", DefaultConfigureValue::IrcFloodRatePerSec))
+        , floodTimer_(ios_)
+        , floodTimerArmed_(false)
+        , port_(0)
+        , ssl_(false)
+        , caseMapping_(CaseMapping::Rfc1459)
+        , capState_(CapState::Done)
         , connectBeginning_(false)
         , currentNicknameIndex_(0)
         , quitReady_(false)
         , closeTimer_(ios_)
         , clearMe_(false)
+        , reconnectAttempt_(0)
+        , reconnecting_(false)
+        , reconnectTimer_(ios_)
+        , detachReadDone_(false)
     {
     }
 
@@ -114,600 +180,1779 @@ namespace SudaGureum
         return connectionId_;
     }
 
+    IrcClient::WriteStats IrcClient::writeStats() const
+    {
+        return {
+            writeStats_.batches_.load(std::memory_order_relaxed),
+            writeStats_.messages_.load(std::memory_order_relaxed),
+            writeStats_.bytes_.load(std::memory_order_relaxed)
+        };
+    }
+
+    Event<const IrcClient::CommandArgs &> &IrcClient::onCommand(IrcCommand command)
+    {
+        return commandEvents_.try_emplace(command).first->second;
+    }
+
     // self
     void IrcClient::nickname(const std::string &nickname)
     {
-        nickname_ = nickname;
+        runInStrand([this, nickname]()
+        {
+            if(!capabilities_.isValidNickname(nickname))
+            {
+                Log::instance().warn("IrcClient[{}]: invalid nickname not sent: {}", static_cast<void *>(this), nickname);
+                if(connectBeginning_) // registering; the server would answer ERR_ERRONEUSNICKNAME
+                {
+                    tryNextNickname();
+                }
+                return;
+            }
+
+            setNickname(nickname);
 
-        sendMessage(IrcMessage("NICK", {nickname}));
+            sendMessage(IrcMessage("NICK", {nickname}));
+        });
     }
 
     void IrcClient::mode(const std::string &modifier)
     {
-        sendMessage(IrcMessage("MODE", {nickname_, modifier}));
+        runInStrand([this, modifier]()
+        {
+            sendMessage(IrcMessage("MODE", {nickname_, modifier}));
+        });
     }
 
     // channel-specific
     void IrcClient::join(const std::string &channel)
     {
-        sendMessage(IrcMessage("JOIN", {channel}));
+        runInStrand(std::bind(&IrcClient::sendMessage, this, IrcMessage("JOIN", {channel})));
     }
 
     void IrcClient::join(const std::string &channel, const std::string &key)
     {
-        sendMessage(IrcMessage("JOIN", {channel, key}));
+        runInStrand(std::bind(&IrcClient::sendMessage, this, IrcMessage("JOIN", {channel, key})));
     }
 
     void IrcClient::part(const std::string &channel, const std::string &message)
     {
-        sendMessage(IrcMessage("PART", {channel, message}));
+        runInStrand(std::bind(&IrcClient::sendMessage, this, IrcMessage("PART", {channel, message})));
     }
 
     void IrcClient::mode(const std::string &channel, const std::string &nickname, const std::string &modifier)
     {
-        sendMessage(IrcMessage("MODE", {channel, nickname, modifier}));
+        runInStrand(std::bind(&IrcClient::sendMessage, this, IrcMessage("MODE", {channel, nickname, modifier})));
     }
 
     void IrcClient::privmsg(const std::string &target, const std::string &message)
     {
-        sendMessage(IrcMessage("PRIVMSG", {target, message}));
+        runInStrand(std::bind(&IrcClient::sendMessage, this, IrcMessage("PRIVMSG", {target, message})));
+    }
+
+    void IrcClient::runInStrand(std::function<void ()> fn)
+    {
+        if(strand_.running_in_this_thread())
+        {
+            fn();
+            return;
+        }
+
+        strand_.post([self = shared_from_this(), fn = std::move(fn)]()
+        {
+            fn();
+        });
     }
 
     void IrcClient::connect(const std::string &host, uint16_t port, std::string encoding,
-        std::vector<std::string> nicknames, bool ssl)
+        std::vector<std::string> nicknames, bool ssl, std::vector<std::string> caps, Sasl sasl,
+        std::optional<HandedOff> handedOff)
     {
         if(nicknames.empty() || nicknames[0].empty())
         {
             return;
         }
 
+        if(caps.empty())
+        {
+            caps.assign(SupportedCaps.begin(), SupportedCaps.end());
+        }
+        std::sort(caps.begin(), caps.end());
+        requestedCaps_ = std::move(caps);
+        sasl_ = std::move(sasl);
+
+        host_ = host;
+        port_ = port;
+        ssl_ = ssl;
+        sslContext_ = ssl ? makeSslContext() : nullptr;
+        if(!ssl && sasl_.mechanism_ == Sasl::Mechanism::External)
+        {
+            Log::instance().warn("IrcClient[{}]: SASL EXTERNAL needs ssl; not authenticating", static_cast<void *>(this));
+            sasl_.mechanism_ = Sasl::Mechanism::None;
+        }
         encoding_ = std::move(encoding);
+        handoffKey_ = handoffKey(host, port, nicknames);
         nicknameCandidates_ = std::move(nicknames);
         currentNicknameIndex_ = 0;
 
-        asio::ip::tcp::resolver resolver(ios_);
-        asio::ip::tcp::resolver::query query(host, fmt::format_int(port).str());
-        auto endpointIt = resolver.resolve(query);
+        if(handedOff.has_value())
+        {
+            restore(std::move(handedOff.value()));
+            return;
+        }
 
-        if(ssl)
-            socket_ = std::make_shared<TcpSslSocket>(ios_);
-        else
-            socket_ = std::make_shared<TcpSocket>(ios_);
-        socket_->asyncConnect(endpointIt,
-            [&](const std::error_code &ec, asio::ip::tcp::resolver::iterator resolverIt)
-            {
-                if(ec)
-                {
-                    Log::instance().warn("IrcClient[{}]: connect failed: {}", static_cast<void *>(this), ec.message());
-                    // TODO: retry
-                }
-                else
-                {
-                    connectBeginning_ = true;
-                    sendMessage(IrcMessage("USER", {nicknameCandidates_[0], "0", "*", nicknameCandidates_[0]}));
-                    nickname(nicknameCandidates_[0]);
-                    read();
-                }
-            });
+        startConnect();
     }
 
-    void IrcClient::tryNextNickname()
+    std::shared_ptr<asio::ssl::context> IrcClient::makeSslContext()
     {
-        ++ currentNicknameIndex_;
-        if(nicknameCandidates_.size() <= currentNicknameIndex_)
+        auto context = std::make_shared<asio::ssl::context>(asio::ssl::context::sslv23); // Generic SSL/TLS
+        if(sasl_.mechanism_ != Sasl::Mechanism::External)
         {
-            close();
-            // XXX: or random nickname?
-            return;
+            return context;
         }
 
-        nickname(nicknameCandidates_[currentNicknameIndex_]);
+        if(sasl_.certificateFile_.empty())
+        {
+            Log::instance().warn("IrcClient[{}]: SASL EXTERNAL without a client certificate; not authenticating",
+                static_cast<void *>(this));
+            sasl_.mechanism_ = Sasl::Mechanism::None;
+            return context;
+        }
+
+        std::vector<uint8_t> certificate = readFileIntoVector(std::filesystem::path(decodeUtf8(sasl_.certificateFile_)));
+        // the key may be in the certificate file
+        std::vector<uint8_t> privateKey = sasl_.privateKeyFile_.empty() ? certificate :
+            readFileIntoVector(std::filesystem::path(decodeUtf8(sasl_.privateKeyFile_)));
+
+        std::error_code ec;
+        if(certificate.empty() || privateKey.empty())
+        {
+            ec = std::make_error_code(std::errc::no_such_file_or_directory);
+        }
+        else
+        {
+            context->use_certificate_chain(asio::buffer(certificate), ec);
+            if(!ec)
+            {
+                context->use_private_key(asio::buffer(privateKey), asio::ssl::context::pem, ec);
+            }
+        }
+
+        if(ec)
+        {
+            Log::instance().warn("IrcClient[{}]: cannot load the client certificate for SASL EXTERNAL: {}",
+                static_cast<void *>(this), ec.message());
+            sasl_.mechanism_ = Sasl::Mechanism::None;
+            return std::make_shared<asio::ssl::context>(asio::ssl::context::sslv23);
+        }
+        return context;
     }
 
-    void IrcClient::read()
+    std::string IrcClient::handoffKey(const std::string &host, uint16_t port, const std::vector<std::string> &nicknames)
     {
-        socket_->asyncReadSome(
-            asio::buffer(bufferToRead_),
-            std::bind(
-                std::mem_fn(&IrcClient::handleRead),
-                shared_from_this(),
-                StdAsioPlaceholders::error,
-                StdAsioPlaceholders::bytesTransferred
-            )
-        );
+        return std::format("{} {} {}", host, port, nicknames.empty() ? std::string() : nicknames[0]);
     }
 
-    void IrcClient::sendMessage(const IrcMessage &message)
+    void IrcClient::detach(std::function<void (std::optional<HandedOff>)> done)
     {
+        runInStrand([this, done = std::move(done)]() mutable
         {
-            std::string encoded = encodeMessage(message);
-            Log::instance().info("{}>>> {}", nickname_, encoded);
+            // TLS session state cannot leave the process, and a registration in progress is simply redone
+            if(ssl_ || !socket_ || quitReady_ || connectBeginning_ || capState_ != CapState::Done || detachDone_)
+            {
+                done(std::nullopt);
+                return;
+            }
 
-            std::lock_guard<std::mutex> lock(bufferWriteLock_);
-            bufferToWrite_.push_back(std::move(encoded) + "\r\n");
-            // print(decodeUtf8(nickname_ + ">>> " + bufferToWrite_.back()));
-        }
-        write();
+            detachDone_ = std::move(done);
+            detachReadDone_ = false;
+            reconnectTimer_.cancel();
+            floodTimer_.cancel();
+
+            // the read always outstanding completes, and then the connection is taken out in handleRead;
+            // a write in flight is finished first (see handleWrite)
+            if(!inWrite_)
+            {
+                std::error_code ec;
+                std::static_pointer_cast<TcpSocket>(socket_)->socket().cancel(ec);
+            }
+        });
     }
 
-    void IrcClient::write()
+    void IrcClient::finishDetach()
     {
-        std::lock_guard<std::mutex> lock(writeLock_);
+        flushQueuedJoins(); // saved as lines
+        std::string state = saveState();
+
+        std::error_code ec;
+        auto &socket = std::static_pointer_cast<TcpSocket>(socket_)->socket();
+        asio::ip::tcp protocol = socket.local_endpoint(ec).protocol();
+        asio::ip::tcp::socket::native_handle_type nativeSocket = socket.release(ec);
+
+        auto done = std::move(detachDone_);
+        detachDone_ = nullptr;
+        socket_.reset();
+        quitReady_ = true; // neither quits nor reconnects in this process
+        pool_.closed(shared_from_this());
 
-        if(inWrite_.exchange(true))
+        if(ec)
         {
+            Log::instance().warn("IrcClient[{}]: cannot release the socket: {}", static_cast<void *>(this), ec.message());
+            done(std::nullopt);
             return;
         }
+        done(HandedOff{std::move(state), protocol, nativeSocket});
+    }
+
+    void IrcClient::restore(HandedOff handedOff)
+    {
+        runInStrand([this, handedOff = std::move(handedOff)]() mutable
+        {
+            std::shared_ptr<TcpSocket> socket;
+            try
+            {
+                socket = std::make_shared<TcpSocket>(ios_, handedOff.protocol_, handedOff.nativeSocket_);
+                loadState(handedOff.state_);
+            }
+            catch(const std::exception &e)
+            {
+                Log::instance().warn("IrcClient[{}]: cannot restore the handed-off connection ({}); reconnecting",
+                    static_cast<void *>(this), e.what());
+                if(socket)
+                {
+                    socket->close();
+                }
+
+                for(auto &lane: sendLanes_)
+                {
+                    lane.clear();
+                }
+                parser_.clear();
+                channels_.clear();
+                joinKeys_.clear();
+                enabledCaps_.clear();
+                isupportTokens_.clear();
+                capabilities_ = ServerCapabilities();
+                setCaseMapping(CaseMapping::Rfc1459);
+                startConnect();
+                return;
+            }
+
+            Log::instance().info("IrcClient[{}]: took over the connection to {}:{} as {}",
+                static_cast<void *>(this), host_, port_, nickname_);
+
+            socket_ = std::move(socket);
+            capState_ = CapState::Done;
+            connectBeginning_ = false;
+
+            // listeners see the channels as if just joined
+            for(auto &[name, channel]: channels_)
+            {
+                if(!channel.synchronized_)
+                    continue;
+
+                onJoinChannel(JoinChannelArgs{shared_from_this(), name, InternedString()});
+                onChannelSynchronized(ChannelSynchronizedArgs{shared_from_this(), name,
+                    std::vector<Participant>(channel.participants_.begin(), channel.participants_.end())});
+            }
 
-        std::string message;
+            read();
+            write();
+        });
+    }
+
+    // Registered state only; everything negotiated before RPL_WELCOME is implied by capState_ being Done.
+    std::string IrcClient::saveState()
+    {
+        SnapshotWriter writer;
+        auto writeParticipants = [&writer](auto begin, auto end)
         {
-            std::lock_guard<std::mutex> lock(bufferWriteLock_);
-            if(!bufferToWrite_.empty())
+            writer.writeUInt32(static_cast<uint32_t>(std::distance(begin, end)));
+            for(auto it = begin; it != end; ++ it)
             {
-                message = std::move(bufferToWrite_.front());
-                bufferToWrite_.pop_front();
+                writer.writeString(it->nickname_.str());
+                writer.writeUInt8(static_cast<uint8_t>(it->modes_.to_ulong()));
+                writer.writeBool(it->away_);
             }
+        };
+
+        writer.writeString(nickname_);
+        writer.writeUInt32(static_cast<uint32_t>(currentNicknameIndex_));
+
+        writer.writeUInt32(static_cast<uint32_t>(enabledCaps_.size()));
+        for(const auto &cap: enabledCaps_)
+        {
+            writer.writeString(cap);
         }
 
-        if(!message.empty())
+        writer.writeUInt32(static_cast<uint32_t>(isupportTokens_.size()));
+        for(const auto &token: isupportTokens_)
         {
-            auto messagePtr = std::make_shared<std::string>(std::move(message));
+            writer.writeString(token);
+        }
 
-            socket_->asyncWrite(
-                asio::buffer(*messagePtr, messagePtr->size()),
-                std::bind(
-                    std::mem_fn(&IrcClient::handleWrite),
-                    shared_from_this(),
-                    StdAsioPlaceholders::error,
-                    StdAsioPlaceholders::bytesTransferred,
-                    messagePtr
-                )
-            );
+        writer.writeUInt32(static_cast<uint32_t>(channels_.size()));
+        for(const auto &[name, channel]: channels_)
+        {
+            writer.writeString(name.str());
+            writer.writeUInt8(static_cast<uint8_t>(channel.accessivity_));
+            writer.writeString(channel.topic_);
+            writer.writeString(channel.topicSetter_);
+            writer.writeTime(channel.topicSetTime_);
+            writer.writeString(channel.key_);
+            writer.writeUInt32(static_cast<uint32_t>(channel.limit_));
+            writer.writeBool(channel.synchronized_);
+            writeParticipants(channel.participants_.begin(), channel.participants_.end());
+            writeParticipants(channel.pendingNames_.begin(), channel.pendingNames_.end());
         }
-        else
+
+        writer.writeUInt32(static_cast<uint32_t>(joinKeys_.size()));
+        for(const auto &[channel, key]: joinKeys_)
         {
-            inWrite_ = false;
+            writer.writeString(channel);
+            writer.writeString(key);
         }
-    }
 
-    void IrcClient::close(bool clearMe)
-    {
-        quitReady_ = true;
-        clearMe_ = clearMe;
-        sendMessage(IrcMessage("QUIT", {"Bye!"}));
-        closeTimer_.expires_from_now(std::chrono::seconds(
-            Configure::instance().getAs("irc_client_close_timeout_sec", DefaultConfigureValue::IrcClientCloseTimeoutSec)
-        ));
-        closeTimer_.async_wait(std::bind(
-            std::mem_fn(&IrcClient::handleCloseTimeout),
-            shared_from_this(),
-            StdAsioPlaceholders::error
-        ));
-    }
+        for(const auto &lane: sendLanes_)
+        {
+            writer.writeUInt32(static_cast<uint32_t>(lane.size()));
+            for(const auto &line: lane)
+            {
+                writer.writeString(line);
+            }
+        }
 
-    void IrcClient::forceClose()
-    {
-        socket_->close();
-        pool_.closed(shared_from_this());
+        writer.writeString(parser_.partialLine());
+        return writer.release();
     }
 
-    bool IrcClient::isMyPrefix(const std::string &prefix) const
+    void IrcClient::loadState(std::string_view state)
     {
-        return nickname_ == getNicknameFromPrefix(prefix);
-    }
+        SnapshotReader reader(state);
+        auto readParticipants = [this, &reader]()
+        {
+            std::vector<Participant> participants(reader.readUInt32());
+            for(auto &participant: participants)
+            {
+                participant.nickname_ = names_.intern(reader.readString());
+                participant.modes_ = std::bitset<Participant::MaxModes>(reader.readUInt8());
+                participant.away_ = reader.readBool();
+            }
+            return participants;
+        };
 
-    bool IrcClient::isChannel(const std::string &str) const
-    {
-        if(str.empty())
-            return false;
-        return std::find(channelTypes_.begin(), channelTypes_.end(), str[0]) != channelTypes_.end();
-    }
+        setNickname(reader.readString());
+        currentNicknameIndex_ = reader.readUInt32();
+        if(currentNicknameIndex_ >= nicknameCandidates_.size()) // the configuration changed in between
+        {
+            currentNicknameIndex_ = 0;
+        }
 
-    IrcClient::Participant IrcClient::parseParticipant(const std::string &nicknameWithPrefix) const
-    {
-        Participant participant;
-        if(nicknameWithPrefix.empty())
+        for(uint32_t count = reader.readUInt32(); count > 0; -- count)
         {
-            return participant;
+            enabledCaps_.emplace(reader.readString());
         }
 
-        auto it = nicknamePrefixMap_.find(nicknameWithPrefix[0]);
-        if(it != nicknamePrefixMap_.end())
+        for(uint32_t count = reader.readUInt32(); count > 0; -- count)
         {
-            participant.modes_.set(participantModeFromPermission(it->second));
-            participant.nickname_ = nicknameWithPrefix.substr(1);
+            isupportTokens_.push_back(reader.readString());
+            capabilities_.apply(isupportTokens_.back());
         }
-        else
+        setCaseMapping(capabilities_.caseMapping());
+
+        for(uint32_t count = reader.readUInt32(); count > 0; -- count)
         {
-            participant.nickname_ = nicknameWithPrefix;
+            InternedString name = names_.intern(reader.readString());
+            Channel channel(names_, caseMapping_);
+            channel.accessivity_ = static_cast<char>(reader.readUInt8());
+            channel.topic_ = reader.readString();
+            channel.topicSetter_ = reader.readString();
+            channel.topicSetTime_ = reader.readTime();
+            channel.key_ = reader.readString();
+            channel.limit_ = reader.readUInt32();
+            channel.synchronized_ = reader.readBool();
+            channel.participants_.bulkInsert(readParticipants());
+            channel.pendingNames_ = readParticipants();
+            channels_.insert_or_assign(std::move(name), std::move(channel));
         }
-        return participant;
-    }
 
-    void IrcClient::handleRead(const std::error_code &ec, size_t bytesTransferred)
-    {
-        if(ec)
+        for(uint32_t count = reader.readUInt32(); count > 0; -- count)
         {
-            if(!quitReady_)
+            std::string channel = reader.readString();
+            joinKeys_[std::move(channel)] = reader.readString();
+        }
+
+        for(auto &lane: sendLanes_)
+        {
+            for(uint32_t count = reader.readUInt32(); count > 0; -- count)
             {
-                Log::instance().warn("IrcClient[{}]: read failed: {}", static_cast<void *>(this), ec.message());
-                forceClose();
+                lane.push_back(reader.readString());
             }
-            return;
         }
 
-        if(!parser_.parse(std::string(bufferToRead_.begin(), bufferToRead_.begin() + bytesTransferred),
-            std::bind(&IrcClient::procMessage, this, std::placeholders::_1)))
+        std::string partialLine = reader.readString();
+        parser_.parse(std::span<const char>(partialLine.data(), partialLine.size()),
+            std::bind(&IrcClient::procMessage, this, std::placeholders::_1));
+    }
+
+    void IrcClient::startConnect()
+    {
+        pool_.resolverCache_.asyncResolve(host_, port_,
+            strand_.wrap(std::bind(
+                std::mem_fn(&IrcClient::handleResolve),
+                shared_from_this(),
+                std::placeholders::_1,
+                std::placeholders::_2
+            )));
+    }
+
+    void IrcClient::reconnect()
+    {
+        if(!strand_.running_in_this_thread())
         {
-            Log::instance().warn("IrcClient[{}]: invalid message received", static_cast<void *>(this));
-            forceClose();
+            strand_.post(std::bind(&IrcClient::reconnect, shared_from_this()));
             return;
         }
 
-        // if(!quitReady_)
+        if(quitReady_)
         {
-            read();
+            finishReconnect();
+            return;
         }
-    }
 
-    void IrcClient::handleWrite(const std::error_code &ec, size_t bytesTransferred,
-        const std::shared_ptr<std::string> &messagePtr)
-    {
+        Log::instance().info("IrcClient[{}]: reconnecting to {}:{}", static_cast<void *>(this), host_, port_);
+
+        for(auto &lane: sendLanes_)
+        {
+            lane.clear();
+        }
+        queuedJoins_.clear();
+        writeBatch_.clear();
         inWrite_ = false;
 
-        if(ec)
+        parser_.clear();
+        capabilities_ = ServerCapabilities();
+        isupportTokens_.clear();
+        setCaseMapping(CaseMapping::Rfc1459);
+        capsToRequest_.clear();
+        enabledCaps_.clear();
+        batches_.clear();
+
+        // try the nickname we had first
+        if(!nickname_.empty())
         {
-            if(!quitReady_)
+            auto it = std::find(nicknameCandidates_.begin(), nicknameCandidates_.end(), nickname_);
+            if(it == nicknameCandidates_.end())
             {
-                Log::instance().warn("IrcClient[{}]: write failed: {}", static_cast<void *>(this), ec.message());
-                forceClose();
+                it = nicknameCandidates_.insert(nicknameCandidates_.begin(), nickname_);
             }
-            return;
+            currentNicknameIndex_ = static_cast<size_t>(it - nicknameCandidates_.begin());
         }
 
-        write();
+        startConnect();
     }
 
-    void IrcClient::handleCloseTimeout(const std::error_code &ec)
+    void IrcClient::finishReconnect()
     {
-        if(!ec)
+        if(reconnecting_)
         {
-            // TODO: error message (close timeout)
-            forceClose();
+            reconnecting_ = false;
+            pool_.reconnectFinished(host_);
         }
     }
 
-    void IrcClient::procMessage(const IrcMessage &message)
+    void IrcClient::tryNextNickname()
     {
-        // TODO: assertions (error and close) or fail-safe process
-
-        //print(decodeUtf8(nickname_ + "<<< " + encodeMessage(message)) + L"\r\n");
-        Log::instance().info("{}<<< {}", nickname_, encodeMessage(message));
+        ++ currentNicknameIndex_;
+        if(nicknameCandidates_.size() <= currentNicknameIndex_)
+        {
+            close();
+            // XXX: or random nickname?
+            return;
+        }
 
-        // Dictionary order; letters first.
+        nickname(nicknameCandidates_[currentNicknameIndex_]);
+    }
 
-        if(message.command_ == "ERROR")
+    void IrcClient::read()
+    {
+        bool waiting = false;
+        if(bufferToRead_.waitReadable())
         {
-            if(quitReady_) // graceful quit
+            visitSocket(*socket_, [this, &waiting](auto &socket)
             {
-                socket_->close();
-                if(clearMe_)
+                if constexpr(std::remove_reference_t<decltype(socket)>::WaitsReadable)
                 {
-                    pool_.closed(shared_from_this());
+                    socket.asyncWaitReadableDirect(
+                        asio::bind_executor(strand_, std::bind(
+                            std::mem_fn(&IrcClient::handleReadable),
+                            shared_from_this(),
+                            StdAsioPlaceholders::error,
+                            socket_
+                        ))
+                    );
+                    waiting = true;
                 }
-            }
+            });
         }
-        else if(message.command_ == "JOIN")
+
+        if(!waiting)
         {
-            const std::string &channel = message.params_.at(0);
-            if(isMyPrefix(message.prefix_))
-            {
-                channels_.emplace(channel, Channel());
+            readSome();
+        }
+    }
+
+    void IrcClient::readSome()
+    {
+        // the handler is stored in the operation as it is, which is allocated from memory of the socket
+        visitSocket(*socket_, [this](auto &socket)
+        {
+            socket.asyncReadSomeDirect(
+                bufferToRead_.prepare(),
+                asio::bind_executor(strand_, std::bind(
+                    std::mem_fn(&IrcClient::handleRead),
+                    shared_from_this(),
+                    StdAsioPlaceholders::error,
+                    StdAsioPlaceholders::bytesTransferred,
+                    socket_
+                ))
+            );
+        });
+    }
+
+    void IrcClient::sendMessage(const IrcMessage &message)
+    {
+        std::optional<IrcCommand> command = classifyIrcCommand(message.command_);
 
-                // TODO: request channel modes
+        // sent in groups of TARGMAX (or MAXTARGETS); whether a target exists is left to the server to answer
+        if((command == IrcCommand::Privmsg || command == IrcCommand::Notice) && message.params_.size() == 2)
+        {
+            std::vector<std::string> targets;
+            boost::algorithm::split(targets, message.params_[0], boost::algorithm::is_any_of(","));
+            size_t count = targets.size();
+            std::erase_if(targets, [](const std::string &target) { return target.empty(); });
+
+            size_t maxTargets = capabilities_.maxTargets(message.command_);
+            if(maxTargets == 0)
+            {
+                maxTargets = std::max<size_t>(targets.size(), 1);
             }
-            else
+            if(targets.size() != count || targets.size() > maxTargets)
             {
-                auto it = channels_.find(channel);
-                if(it != channels_.end())
+                for(size_t i = 0; i < targets.size(); i += maxTargets)
                 {
-                    std::string nickname = getNicknameFromPrefix(message.prefix_);
-                    it->second.participants_.insert(Participant(nickname));
-                    onJoinChannel(JoinChannelArgs{shared_from_this(), channel, nickname});
+                    std::string group = targets[i];
+                    for(size_t j = i + 1; j < std::min(i + maxTargets, targets.size()); ++ j)
+                    {
+                        group += ',';
+                        group += targets[j];
+                    }
+                    IrcMessage part = message; // keeps the tags
+                    part.params_[0] = std::move(group);
+                    sendMessage(part);
                 }
+                return;
             }
         }
-        else if(message.command_ == "MODE")
+
+        // JOINs are held back and merged into comma-separated JOINs when flushed
+        if(command == IrcCommand::Join && !message.params_.empty() && message.params_.size() <= 2
+            && !message.params_[0].empty() && message.params_[0] != "0")
         {
-            const std::string &to = message.params_.at(0);
-            if(to == nickname_)
+            std::vector<std::string> channels, keys;
+            boost::algorithm::split(channels, message.params_[0], boost::algorithm::is_any_of(","));
+            if(message.params_.size() == 2)
             {
+                boost::algorithm::split(keys, message.params_[1], boost::algorithm::is_any_of(","));
             }
-            else
+
+            for(size_t i = 0; i < channels.size(); ++ i)
             {
-                auto it = channels_.find(to);
-                if(it != channels_.end())
+                if(restoredChannels_.count(channels[i]))
                 {
-                    const std::string &modifier = message.params_.at(1);
+                    continue;
+                }
 
-                    size_t nextParamIdx = 2;
-                    auto nextParam = [&message, &nextParamIdx]() { return message.params_.at(nextParamIdx ++); };
+                std::string key = i < keys.size() ? std::move(keys[i]) : std::string();
+                if(!key.empty())
+                {
+                    joinKeys_[channels[i]] = key;
+                }
 
-                    std::optional<bool> operation = std::nullopt;
-                    // XXX: need to follow CHANMODES and PREFIX?
-                    for(char ch: modifier)
+                auto it = std::find_if(queuedJoins_.begin(), queuedJoins_.end(),
+                    [this, &channel = channels[i]](const std::pair<std::string, std::string> &join)
                     {
-                        switch(ch)
-                        {
-                        case '+':
-                            operation = true;
-                            continue;
+                        return EqualToCaseMapping{caseMapping_}(join.first, channel);
+                    });
+                if(it == queuedJoins_.end())
+                {
+                    queuedJoins_.emplace_back(std::move(channels[i]), std::move(key));
+                }
+                else if(it->second.empty())
+                {
+                    it->second = std::move(key);
+                }
+            }
+        }
+        else
+        {
+            SendLane lane = SendLane::Normal;
+            switch(command.value_or(IrcCommand::Unknown))
+            {
+            case IrcCommand::Ping:
+            case IrcCommand::Pong:
+                lane = SendLane::Urgent;
+                break;
+
+            case IrcCommand::Quit:
+                // a barrier rather than a jump: a farewell PRIVMSG or a PART queued before still goes out first
+                flushQueuedJoins();
+                {
+                    auto &urgent = sendLanes_[static_cast<size_t>(SendLane::Urgent)];
+                    auto &normal = sendLanes_[static_cast<size_t>(SendLane::Normal)];
+                    std::move(normal.begin(), normal.end(), std::back_inserter(urgent));
+                    normal.clear();
+                }
+                lane = SendLane::Urgent;
+                break;
 
-                        case '-':
-                            operation = false;
-                            continue;
-                        }
+            default:
+                break;
+            }
 
-                        if(!operation.has_value()) // a +/- sign required for server response
-                            continue;
+            std::string encoded = encodeMessage(message);
+            encoded += "\r\n";
 
-                        switch(ch)
-                        {
-                        case 'O': // channel creator
-                            break;
-
-                        case 'q': // owner
-                        case 'a': // admin
-                        case 'o': // op
-                        case 'h': // half-op
-                        case 'v': // voice
-                            if(operation.has_value())
-                            {
-                                auto partIt = it->second.participants_.find(nextParam());
-                                if(partIt != it->second.participants_.end())
-                                {
-                                    it->second.participants_.modify(partIt, [operation, ch](Participant &p)
-                                    {
-                                        if(operation.value())
-                                        {
-                                            p.modes_.set(participantModeFromPermission(ch));
-                                        }
-                                        else
-                                        {
-                                            p.modes_.reset(participantModeFromPermission(ch));
-                                        }
-                                    });
-                                }
-                            }
-                            break;
-
-                            // TODO: implement below modes
-                        case 'l': // limit
-                            break;
-
-                        case 'k': // key
-                            break;
-
-                        case 'b': // ban
-                            break;
-
-                        case 'e': // ban exception
-                            break;
-
-                        case 'I': // invitation mask
-                            break;
-
-                        default: // consume params
-                            if(std::binary_search(channelModes_[0].begin(), channelModes_[0].end(), ch)) // mode A
-                                nextParam();
-                            else if(std::binary_search(channelModes_[1].begin(), channelModes_[1].end(), ch)) // mode B
-                                nextParam();
-                            else if(nicknamePrefixMap_.get<1>().find(ch) != nicknamePrefixMap_.get<1>().end()) // prefix; considered as mode B
-                                nextParam();
-                            else if(operation && std::binary_search(channelModes_[2].begin(), channelModes_[2].end(), ch)) // mode C
-                                nextParam();
-                            break;
-                        }
+            if(lane == SendLane::Normal)
+            {
+                flushQueuedJoins(); // keep JOINs ordered before later commands
+            }
+            enqueueLine(lane, std::move(encoded));
+        }
+        write();
+    }
+
+    void IrcClient::enqueueLine(SendLane lane, std::string line, bool secret)
+    {
+        if(tap_)
+        {
+            tap_->record(TrafficTap::Direction::Outbound,
+                secret ? line.substr(0, line.find(' ')) + " <redacted>\r\n" : line);
+        }
+        sendLanes_[static_cast<size_t>(lane)].push_back(std::move(line));
+        // print(decodeUtf8(nickname_ + ">>> " + sendLanes_[static_cast<size_t>(lane)].back()));
+    }
+
+    void IrcClient::flushQueuedJoins()
+    {
+        if(queuedJoins_.empty())
+        {
+            return;
+        }
+
+        // keys are matched to channels by position, so keyed channels go first
+        std::stable_partition(queuedJoins_.begin(), queuedJoins_.end(),
+            [](const std::pair<std::string, std::string> &join) { return !join.second.empty(); });
+
+        static const size_t JoinOverhead = std::string_view("JOIN  :\r\n").size();
+
+        std::string channels;
+        std::string keys;
+        auto emit = [&]()
+        {
+            if(channels.empty())
+                return;
+            enqueueLine(SendLane::Normal, encodeMessage(keys.empty() ?
+                IrcMessage("JOIN", {channels}) : IrcMessage("JOIN", {channels, keys})) + "\r\n");
+            channels.clear();
+            keys.clear();
+        };
+
+        for(const auto &[channel, key]: queuedJoins_)
+        {
+            size_t length = JoinOverhead + channels.size() + 1 + channel.size();
+            if(!key.empty())
+            {
+                length += keys.size() + 1 + key.size();
+            }
+            if(length > capabilities_.lineLength())
+            {
+                emit();
+            }
+
+            if(!channels.empty())
+            {
+                channels += ',';
+            }
+            channels += channel;
+            if(!key.empty())
+            {
+                if(!keys.empty())
+                {
+                    keys += ',';
+                }
+                keys += key;
+            }
+        }
+        emit();
+        queuedJoins_.clear();
+    }
+
+    void IrcClient::write()
+    {
+        if(inWrite_ || !socket_ || detachDone_) // lines stay queued until the write in flight completes or handleConnect
+        {
+            return;
+        }
+
+        // Coalesce everything sendable into one contiguous block and send it with a single write.
+        // (A buffer sequence would not help on TLS; asio::ssl::stream writes one buffer per record.)
+        writeBatch_.clear();
+        writeBatchCount_ = 0;
+        bool throttled = false;
+        flushQueuedJoins();
+
+        auto now = TokenBucket::Clock::now();
+        for(size_t lane = 0; lane < SendLaneCount && !throttled; ++ lane)
+        {
+            auto &queue = sendLanes_[lane];
+            while(!queue.empty() && writeBatch_.size() < WriteBatchSizeThreshold)
+            {
+                if(lane == static_cast<size_t>(SendLane::Urgent))
+                {
+                    floodBucket_.consume(1.0, now); // never held back, but still counted
+                }
+                else if(!floodBucket_.tryConsume(1.0, now))
+                {
+                    throttled = true;
+                    break;
+                }
+
+                writeBatch_ += queue.front();
+                queue.pop_front();
+                ++ writeBatchCount_;
+            }
+        }
+
+        if(throttled && !floodTimerArmed_)
+        {
+            floodTimerArmed_ = true;
+            floodTimer_.expires_from_now(floodBucket_.timeUntilAvailable());
+            floodTimer_.async_wait(strand_.wrap(std::bind(
+                std::mem_fn(&IrcClient::handleFloodTimer),
+                shared_from_this(),
+                StdAsioPlaceholders::error
+            )));
+        }
+
+        if(!writeBatch_.empty())
+        {
+            inWrite_ = true;
+            visitSocket(*socket_, [this](auto &socket)
+            {
+                socket.asyncWriteDirect(
+                    asio::buffer(writeBatch_),
+                    asio::bind_executor(strand_, std::bind(
+                        std::mem_fn(&IrcClient::handleWrite),
+                        shared_from_this(),
+                        StdAsioPlaceholders::error,
+                        StdAsioPlaceholders::bytesTransferred,
+                        socket_
+                    ))
+                );
+            });
+        }
+    }
+
+    void IrcClient::close(bool clearMe)
+    {
+        if(!strand_.running_in_this_thread())
+        {
+            strand_.post(std::bind(&IrcClient::close, shared_from_this(), clearMe));
+            return;
+        }
+
+        quitReady_ = true;
+        clearMe_ = clearMe;
+        reconnectTimer_.cancel();
+        sendMessage(IrcMessage("QUIT", {"Bye!"}));
+        closeTimer_.expires_from_now(std::chrono::seconds(
+            Configure::instance().getAs("irc_client_close_timeout_sec", DefaultConfigureValue::IrcClientCloseTimeoutSec)
+        ));
+        closeTimer_.async_wait(strand_.wrap(std::bind(
+            std::mem_fn(&IrcClient::handleCloseTimeout),
+            shared_from_this(),
+            StdAsioPlaceholders::error
+        )));
+    }
+
+    void IrcClient::forceClose()
+    {
+        finishReconnect();
+        floodTimer_.cancel();
+        if(socket_)
+        {
+            socket_->close();
+            socket_.reset();
+        }
+
+        if(quitReady_)
+        {
+            reconnectTimer_.cancel();
+            pool_.closed(shared_from_this());
+            return;
+        }
+
+        // connection lost; remember where we were and let the pool reconnect
+        for(auto &[name, channel]: channels_)
+        {
+            channelsToRestore_.emplace_back(name.str(), channel.key_);
+        }
+        channels_.clear();
+        pool_.scheduleReconnect(shared_from_this());
+    }
+
+    void IrcClient::setNickname(std::string nickname)
+    {
+        nickname_ = std::move(nickname);
+        foldedNickname_ = nickname_;
+        const auto &table = caseFoldTable(caseMapping_);
+        for(char &ch: foldedNickname_)
+        {
+            ch = static_cast<char>(table[static_cast<uint8_t>(ch)]);
+        }
+    }
+
+    bool IrcClient::isMe(std::string_view nickname) const
+    {
+        return equalsPrefolded(foldedNickname_, nickname, caseMapping_);
+    }
+
+    bool IrcClient::isChannel(std::string_view str) const
+    {
+        return capabilities_.isChannel(str);
+    }
+
+    void IrcClient::setCaseMapping(CaseMapping caseMapping)
+    {
+        if(caseMapping == caseMapping_)
+            return;
+
+        caseMapping_ = caseMapping;
+        setNickname(std::move(nickname_));
+
+        ChannelMap channels(channels_.size(), HashCaseMapping{caseMapping}, EqualToCaseMapping{caseMapping});
+        for(auto &[name, channel]: channels_)
+        {
+            channel.participants_.setCaseMapping(caseMapping);
+            channels.emplace(name, std::move(channel));
+        }
+        channels_.swap(channels);
+
+        joinKeys_ = std::map<std::string, std::string, LessCaseMapping>(
+            std::make_move_iterator(joinKeys_.begin()), std::make_move_iterator(joinKeys_.end()), LessCaseMapping{caseMapping});
+        historyMarks_ = std::map<std::string, std::chrono::system_clock::time_point, LessCaseMapping>(
+            std::make_move_iterator(historyMarks_.begin()), std::make_move_iterator(historyMarks_.end()), LessCaseMapping{caseMapping});
+    }
+
+    IrcClient::Participant IrcClient::parseParticipant(std::string_view nicknameWithPrefix)
+    {
+        Participant participant;
+
+        // more than one prefix with multi-prefix
+        size_t prefixLength = 0;
+        for(; prefixLength < nicknameWithPrefix.size(); ++ prefixLength)
+        {
+            char permission = capabilities_.prefixMode(nicknameWithPrefix[prefixLength]);
+            if(permission == 0)
+                break;
+
+            size_t mode = participantModeFromPermission(capabilities_, permission);
+            if(mode < participant.modes_.size())
+                participant.modes_.set(mode);
+        }
+        participant.nickname_ = names_.intern(nicknameWithPrefix.substr(prefixLength));
+        return participant;
+    }
+
+    void IrcClient::handleResolve(const std::error_code &ec, const ResolverCache::EndPoints &endPoints)
+    {
+        if(ec)
+        {
+            Log::instance().warn("IrcClient[{}]: resolve failed: {}", static_cast<void *>(this), ec.message());
+            forceClose();
+            return;
+        }
+
+        EndPointRacer::start(ios_, endPoints,
+            std::chrono::milliseconds(Configure::instance().getAs("irc_connection_attempt_delay_ms",
+                DefaultConfigureValue::IrcConnectionAttemptDelayMs)),
+            [this]() -> std::shared_ptr<SocketBase>
+            {
+                if(ssl_)
+                    return std::make_shared<TcpSslSocket>(ios_, sslContext_);
+                return std::make_shared<TcpSocket>(ios_);
+            },
+            strand_.wrap(std::bind(
+                std::mem_fn(&IrcClient::handleConnect),
+                shared_from_this(),
+                std::placeholders::_1,
+                std::placeholders::_2
+            )));
+    }
+
+    void IrcClient::handleConnect(const std::error_code &ec, std::shared_ptr<SocketBase> socket)
+    {
+        if(ec)
+        {
+            Log::instance().warn("IrcClient[{}]: connect failed: {}", static_cast<void *>(this), ec.message());
+            forceClose();
+            return;
+        }
+
+        if(quitReady_) // closed while connecting
+        {
+            socket->close();
+            forceClose();
+            return;
+        }
+
+        socket_ = std::move(socket);
+        connectBeginning_ = true;
+        capState_ = CapState::Listing; // registration is held until CAP END
+        sendMessage(IrcMessage("CAP", {"LS", "302"}));
+        sendMessage(IrcMessage("USER", {nicknameCandidates_[0], "0", "*", nicknameCandidates_[0]}));
+        nickname(nicknameCandidates_[currentNicknameIndex_]);
+        read();
+    }
+
+    void IrcClient::handleReadable(const std::error_code &ec, const std::shared_ptr<SocketBase> &socket)
+    {
+        if(socket != socket_) // completion of a connection already closed
+        {
+            return;
+        }
+
+        if(ec || detachDone_) // nothing read; what is readable stays in the socket handed over
+        {
+            handleRead(ec, 0, socket);
+            return;
+        }
+
+        readSome();
+    }
+
+    void IrcClient::handleRead(const std::error_code &ec, size_t bytesTransferred, const std::shared_ptr<SocketBase> &socket)
+    {
+        if(socket != socket_) // completion of a connection already closed
+        {
+            return;
+        }
+
+        IoBuffer received = ec ? IoBuffer() : bufferToRead_.commit(bytesTransferred);
+        std::span<const char> data(reinterpret_cast<const char *>(received.data()), received.size());
+
+        if(detachDone_) // the last read; what it got, if anything, is processed before the state is saved
+        {
+            if(!ec && !parser_.parse(data,
+                std::bind(&IrcClient::procMessage, this, std::placeholders::_1)))
+            {
+                Log::instance().warn("IrcClient[{}]: invalid message received while detaching", static_cast<void *>(this));
+            }
+
+            detachReadDone_ = true;
+            if(!inWrite_)
+            {
+                finishDetach();
+            }
+            return;
+        }
+
+        if(ec)
+        {
+            if(!quitReady_)
+            {
+                Log::instance().warn("IrcClient[{}]: read failed: {}", static_cast<void *>(this), ec.message());
+                forceClose();
+            }
+            return;
+        }
+
+        if(tap_)
+        {
+            tap_->record(TrafficTap::Direction::Inbound, std::string_view(data.data(), data.size()));
+        }
+
+        if(!parser_.parse(data,
+            std::bind(&IrcClient::procMessage, this, std::placeholders::_1)))
+        {
+            Log::instance().warn("IrcClient[{}]: invalid message received", static_cast<void *>(this));
+            forceClose();
+            return;
+        }
+
+        // if(!quitReady_)
+        {
+            read();
+        }
+    }
+
+    void IrcClient::handleWrite(const std::error_code &ec, size_t bytesTransferred, const std::shared_ptr<SocketBase> &socket)
+    {
+        if(socket != socket_) // completion of a connection already closed
+        {
+            return;
+        }
+
+        inWrite_ = false;
+
+        if(detachDone_) // the write held the detach back
+        {
+            if(detachReadDone_)
+            {
+                finishDetach();
+            }
+            else
+            {
+                std::error_code cancelEc;
+                std::static_pointer_cast<TcpSocket>(socket_)->socket().cancel(cancelEc);
+            }
+            return;
+        }
+
+        if(ec)
+        {
+            if(!quitReady_)
+            {
+                Log::instance().warn("IrcClient[{}]: write failed: {}", static_cast<void *>(this), ec.message());
+                forceClose();
+            }
+            return;
+        }
+
+        writeStats_.batches_.fetch_add(1, std::memory_order_relaxed);
+        writeStats_.messages_.fetch_add(writeBatchCount_, std::memory_order_relaxed);
+        writeStats_.bytes_.fetch_add(bytesTransferred, std::memory_order_relaxed);
+        Log::instance().trace("IrcClient[{}]: wrote {} messages in a batch of {} bytes",
+            static_cast<void *>(this), writeBatchCount_, bytesTransferred);
+
+        write();
+    }
+
+    void IrcClient::handleFloodTimer(const std::error_code &ec)
+    {
+        floodTimerArmed_ = false;
+
+        if(!ec)
+        {
+            write();
+        }
+    }
+
+    void IrcClient::handleCloseTimeout(const std::error_code &ec)
+    {
+        if(!ec)
+        {
+            // TODO: error message (close timeout)
+            forceClose();
+        }
+    }
+
+    void IrcClient::procMessage(const IrcMessageView &message)
+    {
+        // TODO: assertions (error and close) or fail-safe process
+
+        //print(decodeUtf8(nickname_ + "<<< " + encodeMessage(message)) + L"\r\n");
+
+        // history is not live; it neither changes the state nor fires the live events
+        if(collectHistory(message))
+        {
+            return;
+        }
+
+        ProcFn proc = ProcTable[static_cast<size_t>(message.commandType_)];
+        if(proc)
+        {
+            (this->*proc)(message);
+        }
+
+        if(!commandEvents_.empty())
+        {
+            auto it = commandEvents_.find(message.commandType_);
+            if(it != commandEvents_.end())
+            {
+                it->second(CommandArgs{shared_from_this(), message});
+            }
+        }
+    }
+
+    bool IrcClient::collectHistory(const IrcMessageView &message)
+    {
+        if(batches_.empty())
+        {
+            return false;
+        }
+
+        auto reference = message.tags_.find("batch");
+        if(!reference.has_value())
+        {
+            return false;
+        }
+
+        auto it = batches_.find(std::string(reference.value()));
+        if(it == batches_.end() || !isHistoryBatchType(it->second.type_))
+        {
+            return false;
+        }
+
+        LogLine line{messageTime(message), names_.intern(message.source_.nickname_), LogLine::PRIVMSG, std::string(),
+            std::string(message.tags_.find("msgid").value_or(std::string_view()))};
+        switch(message.commandType_)
+        {
+        case IrcCommand::Privmsg:
+            line.logType_ = LogLine::PRIVMSG;
+            break;
+
+        case IrcCommand::Notice:
+            line.logType_ = LogLine::NOTICE;
+            break;
+
+        case IrcCommand::Join:
+            line.logType_ = LogLine::JOIN;
+            break;
+
+        case IrcCommand::Part:
+            line.logType_ = LogLine::PART;
+            break;
+
+        case IrcCommand::Topic:
+            line.logType_ = LogLine::TOPIC;
+            break;
+
+        case IrcCommand::Mode:
+            line.logType_ = LogLine::MODE;
+            break;
+
+        default: // not archived, but still part of the history
+            return true;
+        }
+
+        // the target is the first param; the rest is the text (MODE changes joined back with spaces)
+        for(size_t i = 1; i < message.params_.size(); ++ i)
+        {
+            if(i > 1)
+            {
+                line.message_ += ' ';
+            }
+            line.message_ += message.params_[i];
+        }
+        markHistory(message);
+        it->second.lines_.push_back(std::move(line));
+        return true;
+    }
+
+    void IrcClient::endCapNegotiation()
+    {
+        if(capState_ != CapState::Done)
+        {
+            capState_ = CapState::Done;
+            sendMessage(IrcMessage("CAP", {"END"}));
+        }
+    }
+
+    void IrcClient::requestHistory(const std::string &target)
+    {
+        if(!enabledCaps_.count("chathistory") && !enabledCaps_.count("draft/chathistory"))
+        {
+            return;
+        }
+
+        size_t lines = Configure::instance().getAs("irc_chathistory_lines", DefaultConfigureValue::IrcChatHistoryLines);
+        if(capabilities_.chatHistoryLimit() != 0)
+        {
+            lines = std::min(lines, capabilities_.chatHistoryLimit());
+        }
+
+        if(lines == 0)
+        {
+            return;
+        }
+
+        // after a reconnect or rejoin, only what was missed since the newest line seen
+        auto mark = historyMarks_.find(target);
+        if(mark != historyMarks_.end())
+        {
+            sendMessage(IrcMessage("CHATHISTORY",
+                {"AFTER", target, "timestamp=" + generateIsoDateTime(mark->second), std::to_string(lines)}));
+        }
+        else
+        {
+            sendMessage(IrcMessage("CHATHISTORY", {"LATEST", target, "*", std::to_string(lines)}));
+        }
+    }
+
+    void IrcClient::markHistory(const IrcMessageView &message)
+    {
+        auto time = message.tags_.find("time"); // without server-time, our clock may be ahead of the server's
+        if(!time.has_value() || message.params_.empty() || !isChannel(message.params_[0]))
+        {
+            return;
+        }
+
+        auto parsed = parseIsoDateTime(time.value());
+        if(!parsed.has_value())
+        {
+            return;
+        }
+
+        auto [it, inserted] = historyMarks_.emplace(std::string(message.params_[0]), parsed.value());
+        if(!inserted && it->second < parsed.value())
+        {
+            it->second = parsed.value();
+        }
+    }
+
+    void IrcClient::procBatch(const IrcMessageView &message)
+    {
+        std::string_view reference = message.params_.at(0);
+        if(reference.size() < 2)
+        {
+            return;
+        }
+
+        if(reference[0] == '+')
+        {
+            Batch &batch = batches_[std::string(reference.substr(1))];
+            batch.type_ = message.params_.at(1);
+            batch.target_ = message.params_.size() > 2 ? names_.intern(message.params_[2]) : InternedString();
+            batch.lines_.clear();
+        }
+        else if(reference[0] == '-')
+        {
+            auto it = batches_.find(std::string(reference.substr(1)));
+            if(it == batches_.end())
+            {
+                return;
+            }
+
+            Batch batch = std::move(it->second);
+            batches_.erase(it);
+            if(isHistoryBatchType(batch.type_) && !batch.lines_.empty())
+            {
+                onHistoryBatch(HistoryBatchArgs{shared_from_this(), batch.target_, std::move(batch.lines_)});
+            }
+        }
+    }
+
+    void IrcClient::procCap(const IrcMessageView &message)
+    {
+        std::string_view subcommand = message.params_.at(1);
+        std::string_view caps = message.params_.back();
+        bool more = message.params_.size() > 3 && message.params_[2] == "*"; // multiline LS
+
+        // fn(name, value); value is given by CAP LS 302 and NEW only
+        auto forEachCap = [caps](auto fn)
+        {
+            for(size_t pos = 0; pos < caps.size(); )
+            {
+                size_t spacePos = std::min(caps.find(' ', pos), caps.size());
+                if(spacePos > pos)
+                {
+                    std::string_view cap = caps.substr(pos, spacePos - pos);
+                    size_t equalPos = cap.find('=');
+                    fn(cap.substr(0, equalPos), equalPos == std::string_view::npos ? std::string_view() : cap.substr(equalPos + 1));
+                }
+                pos = spacePos + 1;
+            }
+        };
+
+        if(subcommand == "LS" || subcommand == "NEW")
+        {
+            forEachCap([this](std::string_view cap, std::string_view value)
+            {
+                if(enabledCaps_.count(std::string(cap)))
+                {
+                    return;
+                }
+
+                if(cap == "sasl")
+                {
+                    // only while registering; the mechanisms are listed with 302
+                    std::string_view mechanism = sasl_.mechanism_ == Sasl::Mechanism::Plain ? "PLAIN" : "EXTERNAL";
+                    std::vector<std::string> mechanisms;
+                    boost::algorithm::split(mechanisms, value, boost::algorithm::is_any_of(","));
+                    if(sasl_.mechanism_ != Sasl::Mechanism::None && capState_ != CapState::Done
+                        && (value.empty() || std::find(mechanisms.begin(), mechanisms.end(), mechanism) != mechanisms.end()))
+                    {
+                        capsToRequest_.emplace_back(cap);
                     }
                 }
+                else if(std::binary_search(requestedCaps_.begin(), requestedCaps_.end(), cap))
+                {
+                    capsToRequest_.emplace_back(cap);
+                }
+            });
+            if(more)
+            {
+                return;
             }
+
+            if(!capsToRequest_.empty())
+            {
+                sendMessage(IrcMessage("CAP", {"REQ", boost::algorithm::join(capsToRequest_, " ")}));
+                capsToRequest_.clear();
+                if(capState_ == CapState::Listing)
+                {
+                    capState_ = CapState::Requesting;
+                }
+            }
+            else if(capState_ == CapState::Listing)
+            {
+                endCapNegotiation();
+            }
+        }
+        else if(subcommand == "ACK")
+        {
+            forEachCap([this](std::string_view cap, std::string_view)
+            {
+                if(!cap.empty() && cap[0] == '-')
+                    enabledCaps_.erase(std::string(cap.substr(1)));
+                else
+                    enabledCaps_.emplace(cap);
+            });
+
+            if(capState_ == CapState::Requesting)
+            {
+                if(sasl_.mechanism_ != Sasl::Mechanism::None && enabledCaps_.count("sasl"))
+                {
+                    capState_ = CapState::Authenticating;
+                    sendMessage(IrcMessage("AUTHENTICATE", {sasl_.mechanism_ == Sasl::Mechanism::Plain ? "PLAIN" : "EXTERNAL"}));
+                }
+                else
+                {
+                    endCapNegotiation();
+                }
+            }
+        }
+        else if(subcommand == "NAK")
+        {
+            if(capState_ == CapState::Requesting) // the whole request is rejected; go on without them
+            {
+                endCapNegotiation();
+            }
+        }
+        else if(subcommand == "DEL")
+        {
+            forEachCap([this](std::string_view cap, std::string_view)
+            {
+                enabledCaps_.erase(std::string(cap));
+            });
+        }
+    }
+
+    void IrcClient::procAuthenticate(const IrcMessageView &message)
+    {
+        if(capState_ != CapState::Authenticating || message.params_.at(0) != "+")
+        {
+            return;
         }
-        else if(message.command_ == "NOTICE")
+
+        std::string payload = "+";
+        if(sasl_.mechanism_ == Sasl::Mechanism::Plain)
         {
-            // TODO: can send notices personally?
-            onChannelNotice(ChannelMessageArgs{shared_from_this(),
-                message.params_[0], getNicknameFromPrefix(message.prefix_), message.params_[1]});
+            std::string credential = sasl_.account_;
+            credential += '\0';
+            credential += sasl_.account_;
+            credential += '\0';
+            credential += sasl_.password_;
+            payload = encodeBase64(std::vector<uint8_t>(credential.begin(), credential.end()));
         }
-        else if(message.command_ == "PART")
+
+        // in chunks; a full last chunk is followed by an empty one
+        for(size_t pos = 0; ; pos += AuthenticateChunkSize)
         {
-            const std::string &channel = message.params_.at(0);
-            if(isMyPrefix(message.prefix_))
-            {
-                channels_.erase(channel);
-            }
-            else
+            std::string_view chunk = std::string_view(payload).substr(pos, AuthenticateChunkSize);
+            enqueueLine(SendLane::Normal, encodeMessage(IrcMessage("AUTHENTICATE", {chunk.empty() ? "+" : std::string(chunk)})) + "\r\n", true);
+            if(chunk.size() < AuthenticateChunkSize)
             {
-                auto it = channels_.find(channel);
-                if(it != channels_.end())
-                {
-                    it->second.participants_.erase(getNicknameFromPrefix(message.prefix_));
-                }
+                break;
             }
         }
-        else if(message.command_ == "PING")
+        write();
+    }
+
+    void IrcClient::procLoggedIn(const IrcMessageView &message)
+    {
+        Log::instance().info("IrcClient[{}]: logged in as {}", static_cast<void *>(this), message.params_.at(2));
+    }
+
+    void IrcClient::procSaslEnd(const IrcMessageView &message)
+    {
+        if(capState_ != CapState::Authenticating)
+        {
+            return;
+        }
+
+        if(message.commandType_ != IrcCommand::RplSaslSuccess)
         {
-            sendMessage(IrcMessage("PONG", message.params_));
+            Log::instance().warn("IrcClient[{}]: SASL authentication failed ({}); continuing without it",
+                static_cast<void *>(this), message.command_);
         }
-        else if(message.command_ == "PRIVMSG")
+        endCapNegotiation();
+    }
+
+    void IrcClient::procError(const IrcMessageView &message)
+    {
+        if(quitReady_) // graceful quit
         {
-            std::string channel = message.params_[0];
-            if(channel == nickname_)
+            socket_->close();
+            if(clearMe_)
             {
-                onPersonalMessage(PersonalMessageArgs{shared_from_this(),
-                    getNicknameFromPrefix(message.prefix_), message.params_[1]});
+                pool_.closed(shared_from_this());
             }
-            else
+        }
+    }
+
+    void IrcClient::procJoin(const IrcMessageView &message)
+    {
+        std::string_view channel = message.params_.at(0);
+        if(isMe(message.source_.nickname_))
+        {
+            Channel &joined = channels_.emplace(names_.intern(channel), Channel(names_, caseMapping_)).first->second;
+            auto keyIt = joinKeys_.find(channel);
+            if(keyIt != joinKeys_.end())
             {
-                onChannelMessage(ChannelMessageArgs{shared_from_this(),
-                    message.params_[0], getNicknameFromPrefix(message.prefix_), message.params_[1]});
+                joined.key_ = std::move(keyIt->second);
+                joinKeys_.erase(keyIt);
             }
+
+            // TODO: request channel modes
         }
-        else if(message.command_ == "001") // RPL_WELCOME
+        else
         {
-            connectBeginning_ = false;
+            auto it = channels_.find(channel);
+            if(it != channels_.end())
+            {
+                InternedString nickname = names_.intern(message.source_.nickname_);
+                it->second.participants_.insert(Participant(nickname));
+                onJoinChannel(JoinChannelArgs{shared_from_this(), it->first, nickname});
+            }
+        }
+    }
 
-            onConnect(shared_from_this());
-            onServerMessage(ServerMessageArgs{shared_from_this(), message.command_, message.params_[0]});
+    void IrcClient::procMode(const IrcMessageView &message)
+    {
+        std::string_view to = message.params_.at(0);
+        if(isMe(to))
+        {
         }
-        else if(message.command_ == "005") // RPL_ISUPPORT
+        else
         {
-            std::string name, value;
-            for(auto it = ++ message.params_.begin(), end = -- message.params_.end(); it != end; ++ it)
+            auto it = channels_.find(to);
+            if(it != channels_.end())
             {
-                size_t equalPos = it->find("=");
-                if(equalPos != std::string::npos)
-                {
-                    name = it->substr(0, equalPos);
-                    value = it->substr(equalPos + 1);
-                    serverOptions_.emplace(name, value);
-                }
-                else
-                {
-                    value.clear();
-                    serverOptions_.emplace(name, value);
-                }
+                std::string_view modifier = message.params_.at(1);
 
-                if(name == "CHANTYPES")
-                {
-                    channelTypes_ = std::move(value);
-                    std::sort(channelTypes_.begin(), channelTypes_.end());
-                }
-                else if(name == "CHANMODES")
+                size_t nextParamIdx = 2;
+                auto nextParam = [&message, &nextParamIdx]() { return message.params_.at(nextParamIdx ++); };
+
+                std::optional<bool> operation = std::nullopt;
+                for(char ch: modifier)
                 {
-                    std::vector<std::string> supportedModes;
-                    boost::algorithm::split(supportedModes, value, boost::algorithm::is_any_of(","));
-                    if(supportedModes.size() == 4)
+                    switch(ch)
                     {
-                        for(size_t i = 0; i < 4; ++ i)
-                        {
-                            channelModes_[i] = std::move(supportedModes[i]);
-                            std::sort(channelModes_[i].begin(), channelModes_[i].end());
-                        }
+                    case '+':
+                        operation = true;
+                        continue;
+
+                    case '-':
+                        operation = false;
+                        continue;
                     }
-                }
-                else if(name == "PREFIX")
-                {
-                    static const boost::regex PrefixRegex("\\(([A-Za-z]+)\\)(.+)", boost::regex::extended);
-                    boost::smatch matched;
-                    if(boost::regex_match(value, matched, PrefixRegex))
+
+                    if(!operation.has_value()) // a +/- sign required for server response
+                        continue;
+
+                    // the parameter is consumed by the type from CHANMODES and PREFIX
+                    switch(capabilities_.channelModeType(ch))
                     {
-                        if(matched[1].length() == matched[2].length())
+                    case ServerCapabilities::ModeType::Prefix:
+                        {
+                            Participant *participant = it->second.participants_.find(nextParam());
+                            size_t mode = participantModeFromPermission(capabilities_, ch);
+                            if(participant && mode < participant->modes_.size())
+                            {
+                                participant->modes_.set(mode, operation.value());
+                            }
+                        }
+                        break;
+
+                    case ServerCapabilities::ModeType::A: // lists (ban, ban exception, invitation mask); not tracked
+                        nextParam();
+                        break;
+
+                    case ServerCapabilities::ModeType::B:
+                        {
+                            std::string_view param = nextParam();
+                            if(ch == 'k') // key; kept to rejoin after reconnecting
+                            {
+                                if(operation.value())
+                                    it->second.key_ = param;
+                                else
+                                    it->second.key_.clear();
+                            }
+                        }
+                        break;
+
+                    case ServerCapabilities::ModeType::C:
+                        if(operation.value())
                         {
-                            nicknamePrefixMap_.clear();
-                            for(auto valueIt = matched[1].first, keyIt = matched[2].first;
-                                valueIt != matched[1].second && keyIt != matched[2].second;
-                                ++ valueIt, ++ keyIt)
+                            std::string_view param = nextParam();
+                            if(ch == 'l') // limit
                             {
-                                nicknamePrefixMap_.insert(CcPair(*keyIt, *valueIt));
+                                size_t limit = 0;
+                                std::from_chars(param.data(), param.data() + param.size(), limit);
+                                it->second.limit_ = limit;
                             }
                         }
+                        else if(ch == 'l')
+                        {
+                            it->second.limit_ = 0;
+                        }
+                        break;
+
+                    default: // D, or not advertised
+                        break;
                     }
                 }
             }
         }
-        else if(message.command_ == "331") // RPL_NOTOPIC
+    }
+
+    void IrcClient::procNick(const IrcMessageView &message)
+    {
+        std::string_view nickname = message.source_.nickname_;
+        InternedString newNickname = names_.intern(message.params_.at(0));
+        for(auto &[name, channel]: channels_)
+        {
+            channel.participants_.rename(nickname, newNickname);
+        }
+
+        if(isMe(nickname))
         {
-            auto it = channels_.find(message.params_.at(1));
-            if(it != channels_.end())
-            {
-                it->second.topic_ = "";
-                it->second.topicSetter_ = "";
-                it->second.topicSetTime_ = std::chrono::system_clock::now();
-            }
+            setNickname(newNickname.str());
         }
-        else if(message.command_ == "332") // RPL_TOPIC
+    }
+
+    void IrcClient::procNotice(const IrcMessageView &message)
+    {
+        markHistory(message);
+        // TODO: can send notices personally?
+        onChannelNotice(ChannelMessageArgs{shared_from_this(),
+            names_.intern(message.params_[0]), names_.intern(message.source_.nickname_), std::string(message.params_[1]),
+            messageTime(message), isMe(message.source_.nickname_)});
+    }
+
+    void IrcClient::procPart(const IrcMessageView &message)
+    {
+        std::string_view channel = message.params_.at(0);
+        if(isMe(message.source_.nickname_))
         {
-            auto it = channels_.find(message.params_.at(1));
+            auto it = channels_.find(channel);
             if(it != channels_.end())
             {
-                it->second.topic_ = message.params_.at(2);
+                channels_.erase(it);
             }
         }
-        else if(message.command_ == "333") // RPL_TOPICSETTER (tentative)
+        else
         {
-            auto it = channels_.find(message.params_.at(1));
+            auto it = channels_.find(channel);
             if(it != channels_.end())
             {
-                it->second.topicSetter_ = message.params_.at(2);
-                it->second.topicSetTime_ = std::chrono::system_clock::from_time_t(
-                    boost::lexical_cast<time_t>(message.params_.at(3)));
+                it->second.participants_.erase(message.source_.nickname_);
             }
         }
-        else if(message.command_ == "353") // RPL_NAMREPLY
+    }
+
+    void IrcClient::procPing(const IrcMessageView &message)
+    {
+        sendMessage(IrcMessage("PONG", std::vector<std::string>(message.params_.begin(), message.params_.end())));
+    }
+
+    void IrcClient::procPrivmsg(const IrcMessageView &message)
+    {
+        markHistory(message);
+        std::string_view channel = message.params_[0];
+        bool echo = isMe(message.source_.nickname_); // only with echo-message
+        if(isMe(channel))
         {
-            auto it = channels_.find(message.params_.at(2));
-            if(it != channels_.end())
-            {
-                char accessivity = message.params_.at(1)[0];
-                switch(accessivity)
-                {
-                case Channel::Public:
-                case Channel::Private:
-                case Channel::Secret:
-                    // OK
-                    break;
+            onPersonalMessage(PersonalMessageArgs{shared_from_this(),
+                names_.intern(message.source_.nickname_), std::string(message.params_[1]), messageTime(message), echo});
+        }
+        else if(echo && !isChannel(channel))
+        {
+            onPersonalMessage(PersonalMessageArgs{shared_from_this(),
+                names_.intern(channel), std::string(message.params_[1]), messageTime(message), true});
+        }
+        else
+        {
+            onChannelMessage(ChannelMessageArgs{shared_from_this(),
+                names_.intern(channel), names_.intern(message.source_.nickname_), std::string(message.params_[1]),
+                messageTime(message), echo});
+        }
+    }
 
-                default:
-                    return;
-                }
+    void IrcClient::procWelcome(const IrcMessageView &message)
+    {
+        connectBeginning_ = false;
+        reconnectAttempt_ = 0;
+        finishReconnect();
 
-                it->second.accessivity_ = accessivity;
+        // rejoin where we were; JOINs of the same channels from onConnect handlers are skipped
+        for(auto &[channel, key]: channelsToRestore_)
+        {
+            if(key.empty())
+                join(channel);
+            else
+                join(channel, key);
+            restoredChannels_.insert(channel);
+        }
+        channelsToRestore_.clear();
 
-                std::vector<std::string> participantNicknames;
-                boost::algorithm::split(participantNicknames, message.params_.at(3), boost::algorithm::is_space());
-                for(std::string &nickname: participantNicknames)
-                {
-                    it->second.participants_.insert(parseParticipant(nickname));
-                }
-            }
+        onConnect(shared_from_this());
+        restoredChannels_.clear();
+        onServerMessage(ServerMessageArgs{shared_from_this(), std::string(message.command_), std::string(message.params_[0])});
+    }
+
+    void IrcClient::procISupport(const IrcMessageView &message)
+    {
+        for(auto it = ++ message.params_.begin(), end = -- message.params_.end(); it != end; ++ it)
+        {
+            capabilities_.apply(*it);
+            isupportTokens_.emplace_back(*it);
         }
-        else if(message.command_ == "366") // RPL_ENDOFNAMES
+        setCaseMapping(capabilities_.caseMapping());
+    }
+
+    void IrcClient::procNoTopic(const IrcMessageView &message)
+    {
+        auto it = channels_.find(message.params_.at(1));
+        if(it != channels_.end())
         {
-            // join complete; you can see channel now
+            it->second.topic_ = "";
+            it->second.topicSetter_ = "";
+            it->second.topicSetTime_ = std::chrono::system_clock::now();
         }
-        else if(message.command_ == "432") // ERR_ERRONEOUSNICKNAME
+    }
+
+    void IrcClient::procTopic(const IrcMessageView &message)
+    {
+        auto it = channels_.find(message.params_.at(1));
+        if(it != channels_.end())
         {
-            if(connectBeginning_)
-            {
-                tryNextNickname();
-            }
+            it->second.topic_ = message.params_.at(2);
+        }
+    }
+
+    void IrcClient::procTopicWhoTime(const IrcMessageView &message)
+    {
+        auto it = channels_.find(message.params_.at(1));
+        if(it != channels_.end())
+        {
+            it->second.topicSetter_ = message.params_.at(2);
+            it->second.topicSetTime_ = std::chrono::system_clock::from_time_t(
+                boost::lexical_cast<time_t>(std::string(message.params_.at(3))));
         }
-        else if(message.command_ == "433") // ERR_NICKNAMEINUSE
+    }
+
+    void IrcClient::procNamReply(const IrcMessageView &message)
+    {
+        auto it = channels_.find(message.params_.at(2));
+        if(it != channels_.end())
         {
-            if(connectBeginning_)
+            char accessivity = message.params_.at(1)[0];
+            switch(accessivity)
             {
-                tryNextNickname();
+            case Channel::Public:
+            case Channel::Private:
+            case Channel::Secret:
+                // OK
+                break;
+
+            default:
+                return;
             }
-        }
-        else if(message.command_ == "436") // ERR_NICKCOLLISION
-        {
-            if(connectBeginning_)
+
+            it->second.accessivity_ = accessivity;
+
+            // staged until RPL_ENDOFNAMES, then swapped in at once
+            std::string_view names = message.params_.at(3);
+            std::vector<Participant> &pendingNames = it->second.pendingNames_;
+            for(size_t pos = 0; pos < names.size(); )
             {
-                tryNextNickname();
+                size_t spacePos = std::min(names.find(' ', pos), names.size());
+                if(spacePos > pos)
+                {
+                    pendingNames.push_back(parseParticipant(names.substr(pos, spacePos - pos)));
+                }
+                pos = spacePos + 1;
             }
         }
-        else if(message.command_ == "437") // ERR_UNAVAILRESOURCE
+    }
+
+    void IrcClient::procEndOfNames(const IrcMessageView &message)
+    {
+        auto it = channels_.find(message.params_.at(1));
+        if(it == channels_.end())
         {
-            if(connectBeginning_)
-            {
-                tryNextNickname();
-            }
+            return;
+        }
+
+        // a JOIN or PART in between belongs to the old roster and is superseded by the new one
+        Channel &channel = it->second;
+        ChannelSynchronizedArgs args{shared_from_this(), it->first, std::move(channel.pendingNames_)};
+        channel.pendingNames_.clear();
+
+        ParticipantIndex participants(names_, caseMapping_);
+        participants.bulkInsert(args.participants_); // read in place; args still hands the roster to the event
+        std::swap(channel.participants_, participants);
+
+        // join complete; you can see channel now
+        if(!channel.synchronized_)
+        {
+            channel.synchronized_ = true;
+            onJoinChannel(JoinChannelArgs{shared_from_this(), it->first, InternedString()});
+            requestHistory(it->first.str());
+        }
+        onChannelSynchronized(args);
+    }
+
+    void IrcClient::procNicknameUnavailable(const IrcMessageView &message)
+    {
+        if(connectBeginning_)
+        {
+            tryNextNickname();
         }
     }
 
     IrcClientPool::IrcClientPool()
-        : signals_(ios_)
+        : MtIoService("irc_client_pool")
+        , signals_(ios_)
+        , resolverCache_(ios_, std::chrono::seconds(
+            Configure::instance().getAs("irc_resolver_cache_ttl_sec", DefaultConfigureValue::IrcResolverCacheTtlSec)))
         , nextConnectionId_(1)
+        , reconnectRandom_(std::random_device()())
+        , reconnectBaseDelay_(std::chrono::milliseconds(
+            Configure::instance().getAs("irc_reconnect_base_delay_ms", DefaultConfigureValue::IrcReconnectBaseDelayMs)))
+        , reconnectMaxDelay_(std::chrono::seconds(
+            Configure::instance().getAs("irc_reconnect_max_delay_sec", DefaultConfigureValue::IrcReconnectMaxDelaySec)))
+        , reconnectPerHostLimit_(
+            Configure::instance().getAs("irc_reconnect_per_host_limit", DefaultConfigureValue::IrcReconnectPerHostLimit))
+        , reconnectBucket_(
+            Configure::instance().getAs("irc_reconnect_burst", DefaultConfigureValue::IrcReconnectBurst),
+            Configure::instance().getAs("irc_reconnect_rate_per_sec", DefaultConfigureValue::IrcReconnectRatePerSec))
+        , reconnectTimer_(ios_)
+        , reconnectTimerArmed_(false)
     {
         signals_.add(SIGINT);
         signals_.add(SIGTERM);
@@ -722,15 +1967,30 @@ namespace SudaGureum
     }
 
     std::weak_ptr<IrcClient> IrcClientPool::connect(const std::string &host, uint16_t port, std::string encoding,
-        std::vector<std::string> nicknames, bool ssl, std::function<void (IrcClient &)> constructCb)
+        std::vector<std::string> nicknames, bool ssl, std::vector<std::string> caps, IrcClient::Sasl sasl,
+        std::function<void (IrcClient &)> constructCb)
     {
-        std::shared_ptr<IrcClient> client(new IrcClient(*this, nextConnectionId_ ++));
+        // with hash assignment, a user's connection to a network stays on the same shard
+        asio::io_service &ios = assignIoService(std::hash<std::string>()(host + ' ' + (nicknames.empty() ? std::string() : nicknames[0])));
+        std::shared_ptr<IrcClient> client(new IrcClient(*this, nextConnectionId_ ++, ios));
         if(constructCb)
         {
             constructCb(*client);
         }
 
-        client->connect(host, port, std::move(encoding), std::move(nicknames), ssl);
+        std::optional<IrcClient::HandedOff> handedOff;
+        {
+            std::lock_guard<std::mutex> lock(clientsLock_);
+            auto it = adopted_.find(IrcClient::handoffKey(host, port, nicknames));
+            if(it != adopted_.end())
+            {
+                handedOff = std::move(it->second);
+                adopted_.erase(it);
+            }
+        }
+
+        client->connect(host, port, std::move(encoding), std::move(nicknames), ssl, std::move(caps), std::move(sasl),
+            std::move(handedOff));
         {
             std::lock_guard<std::mutex> lock(clientsLock_);
             clients_.emplace(client->connectionId_, client);
@@ -740,6 +2000,12 @@ namespace SudaGureum
 
     void IrcClientPool::closeAll()
     {
+        {
+            std::lock_guard<std::mutex> lock(reconnectLock_);
+            reconnectQueue_.clear();
+            reconnectTimer_.cancel();
+        }
+
         std::lock_guard<std::mutex> lock(clientsLock_);
         for(auto &p: clients_)
         {
@@ -748,6 +2014,120 @@ namespace SudaGureum
         clients_.clear();
     }
 
+    Handoff::Payload IrcClientPool::detachAll()
+    {
+        {
+            std::lock_guard<std::mutex> lock(reconnectLock_);
+            reconnectQueue_.clear();
+            reconnectTimer_.cancel();
+        }
+
+        std::vector<std::pair<std::shared_ptr<IrcClient>, std::future<std::optional<IrcClient::HandedOff>>>> detaching;
+        {
+            std::lock_guard<std::mutex> lock(clientsLock_);
+            detaching.reserve(clients_.size());
+            for(auto &p: clients_)
+            {
+                auto promise = std::make_shared<std::promise<std::optional<IrcClient::HandedOff>>>();
+                detaching.emplace_back(p.second, promise->get_future());
+                p.second->detach([promise](std::optional<IrcClient::HandedOff> handedOff)
+                {
+                    promise->set_value(std::move(handedOff));
+                });
+            }
+        }
+
+        // finishDetach takes clientsLock_, so it is not held while waiting
+        auto deadline = std::chrono::steady_clock::now() + std::chrono::milliseconds(
+            Configure::instance().getAs("irc_handoff_timeout_ms", DefaultConfigureValue::IrcHandoffTimeoutMs));
+
+        Handoff::Payload payload;
+        SnapshotWriter entries;
+        uint32_t count = 0;
+        for(auto &[client, future]: detaching)
+        {
+            if(future.wait_until(deadline) != std::future_status::ready)
+            {
+                Log::instance().warn("IrcClient[{}]: detaching timed out", static_cast<void *>(client.get()));
+                continue; // left to the process exit; its server sees the connection drop
+            }
+
+            std::optional<IrcClient::HandedOff> handedOff = future.get();
+            if(!handedOff.has_value())
+            {
+                client->close(false);
+                continue;
+            }
+
+            entries.writeString(client->handoffKey_);
+            entries.writeBool(handedOff->protocol_ == asio::ip::tcp::v6());
+            entries.writeUInt32(static_cast<uint32_t>(payload.fds_.size()));
+            entries.writeString(handedOff->state_);
+            payload.fds_.push_back(static_cast<int>(handedOff->nativeSocket_));
+            ++ count;
+        }
+
+        SnapshotWriter writer;
+        writer.writeUInt32(count);
+        payload.snapshot_ = writer.release() + entries.release();
+
+        Log::instance().info("IrcClientPool: {} of {} connections detached", count, detaching.size());
+        return payload;
+    }
+
+    void IrcClientPool::adopt(Handoff::Payload payload)
+    {
+        std::vector<bool> used(payload.fds_.size());
+        try
+        {
+            SnapshotReader reader(payload.snapshot_);
+            std::lock_guard<std::mutex> lock(clientsLock_);
+            for(uint32_t count = reader.readUInt32(); count > 0; -- count)
+            {
+                std::string key = reader.readString();
+                asio::ip::tcp protocol = reader.readBool() ? asio::ip::tcp::v6() : asio::ip::tcp::v4();
+                uint32_t fdIndex = reader.readUInt32();
+                std::string state = reader.readString();
+                if(fdIndex >= payload.fds_.size() || used[fdIndex])
+                {
+                    throw(std::runtime_error("snapshot refers to an invalid socket"));
+                }
+
+                used[fdIndex] = true;
+                adopted_.insert_or_assign(std::move(key), IrcClient::HandedOff{std::move(state), protocol,
+                    static_cast<asio::ip::tcp::socket::native_handle_type>(payload.fds_[fdIndex])});
+            }
+        }
+        catch(const std::runtime_error &e)
+        {
+            Log::instance().warn("IrcClientPool: handoff snapshot is broken: {}", e.what());
+        }
+
+        // sockets nobody refers to
+        for(size_t i = 0; i < payload.fds_.size(); ++ i)
+        {
+            if(!used[i])
+            {
+                std::error_code ec;
+                asio::ip::tcp::socket(ios_, asio::ip::tcp::v4(), payload.fds_[i]).close(ec);
+            }
+        }
+
+        Log::instance().info("IrcClientPool: {} connections adopted", adopted_.size());
+    }
+
+    void IrcClientPool::discardAdopted()
+    {
+        std::lock_guard<std::mutex> lock(clientsLock_);
+        for(auto &[key, handedOff]: adopted_)
+        {
+            Log::instance().info("IrcClientPool: no user for the handed-off connection {}", key);
+            std::error_code ec;
+            asio::ip::tcp::socket(ios_, handedOff.protocol_, handedOff.nativeSocket_).close(ec);
+        }
+        adopted_.clear();
+    }
+
     void IrcClientPool::closed(const std::shared_ptr<IrcClient> &client)
     {
         std::lock_guard<std::mutex> lock(clientsLock_);
@@ -757,4 +2137,106 @@ namespace SudaGureum
             clients_.erase(it);
         }
     }
+
+    void IrcClientPool::scheduleReconnect(const std::shared_ptr<IrcClient> &client)
+    {
+        std::chrono::milliseconds delay;
+        {
+            // exponential backoff with full jitter: uniform in [0, min(max, base * 2^attempt)]
+            size_t attempt = std::min<size_t>(client->reconnectAttempt_ ++, 30);
+            auto ceiling = std::min<std::chrono::milliseconds>(reconnectMaxDelay_, reconnectBaseDelay_ * (size_t(1) << attempt));
+
+            std::lock_guard<std::mutex> lock(reconnectLock_);
+            delay = std::chrono::milliseconds(
+                std::uniform_int_distribution<long long>(0, ceiling.count())(reconnectRandom_));
+        }
+
+        Log::instance().info("IrcClient[{}]: connection lost; reconnecting in {} ms (attempt {})",
+            static_cast<void *>(client.get()), delay.count(), client->reconnectAttempt_);
+
+        client->reconnectTimer_.expires_from_now(delay);
+        client->reconnectTimer_.async_wait([this, client](const std::error_code &ec)
+        {
+            if(ec)
+                return;
+
+            std::vector<std::shared_ptr<IrcClient>> starting;
+            {
+                std::lock_guard<std::mutex> lock(reconnectLock_);
+                reconnectQueue_.push_back(client);
+                starting = pumpReconnects();
+            }
+            for(auto &startingClient: starting)
+            {
+                startingClient->reconnect();
+            }
+        });
+    }
+
+    void IrcClientPool::reconnectFinished(const std::string &host)
+    {
+        std::vector<std::shared_ptr<IrcClient>> starting;
+        {
+            std::lock_guard<std::mutex> lock(reconnectLock_);
+            auto it = reconnectsPerHost_.find(host);
+            if(it != reconnectsPerHost_.end() && -- it->second == 0)
+            {
+                reconnectsPerHost_.erase(it);
+            }
+            starting = pumpReconnects();
+        }
+        for(auto &client: starting)
+        {
+            client->reconnect();
+        }
+    }
+
+    std::vector<std::shared_ptr<IrcClient>> IrcClientPool::pumpReconnects()
+    {
+        std::vector<std::shared_ptr<IrcClient>> starting;
+        bool rateLimited = false;
+        auto now = TokenBucket::Clock::now();
+        for(auto it = reconnectQueue_.begin(); it != reconnectQueue_.end(); )
+        {
+            size_t &inFlight = reconnectsPerHost_[(*it)->host_];
+            if(inFlight >= reconnectPerHostLimit_)
+            {
+                ++ it; // retried when one of the host finishes
+                continue;
+            }
+            if(!reconnectBucket_.tryConsume(1.0, now))
+            {
+                rateLimited = true;
+                break;
+            }
+
+            ++ inFlight;
+            (*it)->reconnecting_ = true;
+            starting.push_back(std::move(*it));
+            it = reconnectQueue_.erase(it);
+        }
+        std::erase_if(reconnectsPerHost_, [](const auto &p) { return p.second == 0; });
+
+        if(rateLimited && !reconnectTimerArmed_)
+        {
+            reconnectTimerArmed_ = true;
+            reconnectTimer_.expires_from_now(reconnectBucket_.timeUntilAvailable(1.0, now));
+            reconnectTimer_.async_wait([this](const std::error_code &ec)
+            {
+                std::vector<std::shared_ptr<IrcClient>> starting;
+                {
+                    std::lock_guard<std::mutex> lock(reconnectLock_);
+                    reconnectTimerArmed_ = false;
+                    if(ec)
+                        return;
+                    starting = pumpReconnects();
+                }
+                for(auto &client: starting)
+                {
+                    client->reconnect();
+                }
+            });
+        }
+        return starting;
+    }
 }
@@ -1,56 +1,32 @@
 ﻿#pragma once
 
+#include "Archive.h"
 #include "Comparator.h"
 #include "Event.h"
+#include "Handoff.h"
+#include "InternedString.h"
 #include "IrcParser.h"
 #include "MtIoService.h"
+#include "ParticipantIndex.h"
+#include "ReadBuffer.h"
+#include "Resolver.h"
+#include "ServerCapabilities.h"
+#include "TokenBucket.h"
 #include "Utility.h"
 
 namespace SudaGureum
 {
     class IrcClientPool;
     class SocketBase;
+    class TrafficTap;
 
     // Connects to IRC server, and fires IRC events.
+    // State of a connection is only touched on its strand, so events are fired there as well;
+    // the public member functions can be called from any thread.
     class IrcClient : public std::enable_shared_from_this<IrcClient>
     {
     public:
-        struct Participant
-        {
-            enum Modes : size_t
-            {
-                Voice = 0,
-                HalfOp,
-                Op,
-                Admin,
-                Owner
-            };
-
-            std::bitset<5> modes_;
-            std::string nickname_;
-            bool away_;
-
-            Participant()
-                : away_(false)
-            {
-            }
-
-            explicit Participant(std::string nickname)
-                : nickname_(std::move(nickname))
-                , away_(false)
-            {
-            }
-        };
-
-        typedef boost::multi_index_container<
-            Participant,
-            boost::multi_index::indexed_by<
-                boost::multi_index::ordered_unique<
-                    boost::multi_index::member<Participant, std::string, &Participant::nickname_>,
-                    LessCaseInsensitive
-                >
-            >
-        > ChannelParticipantSet;
+        typedef ParticipantIndex::Participant Participant;
 
         struct Channel
         {
@@ -64,31 +40,41 @@ namespace SudaGureum
             std::string topic_;
             std::string topicSetter_;
             std::chrono::system_clock::time_point topicSetTime_;
-            ChannelParticipantSet participants_;
+            ParticipantIndex participants_;
+            std::vector<Participant> pendingNames_; // RPL_NAMREPLY entries until RPL_ENDOFNAMES
+            bool synchronized_; // NAMES received at least once since joining
             std::string key_;
             size_t limit_;
 
-            Channel()
+            explicit Channel(InternPool pool = InternPool(), CaseMapping caseMapping = CaseMapping::Rfc1459)
                 : accessivity_(0)
+                , participants_(std::move(pool), caseMapping)
+                , synchronized_(false)
                 , limit_(0)
             {
             }
         };
 
-        typedef CaseInsensitiveMap<Channel> ChannelMap;
-
-        typedef std::pair<char, char> CcPair;
-        typedef boost::multi_index_container<
-            CcPair,
-            boost::multi_index::indexed_by<
-                boost::multi_index::ordered_unique<
-                    boost::multi_index::member<CcPair, char, &CcPair::first>
-                >,
-                boost::multi_index::ordered_unique<
-                    boost::multi_index::member<CcPair, char, &CcPair::second>
-                >
-            >
-        > NicknamePrefixMap;
+        typedef std::unordered_map<InternedString, Channel, HashCaseMapping, EqualToCaseMapping> ChannelMap;
+
+        struct Sasl
+        {
+            enum class Mechanism
+            {
+                None,
+                Plain,
+                External // with the client certificate of the TLS connection
+            };
+
+            Mechanism mechanism_ = Mechanism::None;
+            std::string account_; // PLAIN only
+            std::string password_; // PLAIN only
+            std::string certificateFile_; // EXTERNAL only; PEM, loaded into the TLS context of the connection
+            std::string privateKeyFile_; // EXTERNAL only; PEM
+        };
+
+    public:
+        static const std::array<std::string_view, 7> SupportedCaps; // sasl is requested by Sasl instead
 
     public:
         struct ServerMessageArgs
@@ -101,47 +87,115 @@ namespace SudaGureum
         struct JoinChannelArgs
         {
             std::weak_ptr<IrcClient> ircClient_;
-            std::string channel_;
-            std::string nickname_; // empty if self
+            InternedString channel_;
+            InternedString nickname_; // empty if self
         };
 
         struct PartChannelArgs
         {
             std::weak_ptr<IrcClient> ircClient_;
-            std::string channel_;
-            std::string nickname_; // empty if self
+            InternedString channel_;
+            InternedString nickname_; // empty if self
+        };
+
+        struct ChannelSynchronizedArgs
+        {
+            std::weak_ptr<IrcClient> ircClient_;
+            InternedString channel_;
+            std::vector<Participant> participants_; // whole roster, in no particular order
         };
 
         struct ChannelMessageArgs
         {
             std::weak_ptr<IrcClient> ircClient_;
-            std::string channel_;
-            std::string nickname_;
+            InternedString channel_;
+            InternedString nickname_;
             std::string message_;
+            std::chrono::system_clock::time_point time_; // server-time if given, otherwise when received
+            bool echo_; // sent by us and echoed back (echo-message)
         };
 
         struct PersonalMessageArgs
         {
             std::weak_ptr<IrcClient> ircClient_;
-            std::string nickname_;
+            InternedString nickname_; // the other side, even if echo_
             std::string message_;
+            std::chrono::system_clock::time_point time_; // server-time if given, otherwise when received
+            bool echo_; // sent by us and echoed back (echo-message)
+        };
+
+        struct HistoryBatchArgs
+        {
+            std::weak_ptr<IrcClient> ircClient_;
+            InternedString target_; // channel or nickname
+            std::vector<LogLine> lines_; // oldest first
+        };
+
+        struct WriteStats
+        {
+            size_t batches_; // number of socket writes
+            size_t messages_;
+            size_t bytes_;
+        };
+
+        struct CommandArgs
+        {
+            std::weak_ptr<IrcClient> ircClient_;
+            const IrcMessageView &message_; // valid only while the event is fired
         };
 
     private:
-        static std::string getNicknameFromPrefix(std::string prefix);
+        typedef void (IrcClient::*ProcFn)(const IrcMessageView &);
+
+        // An open BATCH; only lines of chathistory batches are collected, others are processed as usual.
+        struct Batch
+        {
+            std::string type_;
+            InternedString target_;
+            std::vector<LogLine> lines_;
+        };
+
+        // A registered plaintext connection taken out of one process and given to another.
+        struct HandedOff
+        {
+            std::string state_; // see saveState
+            asio::ip::tcp protocol_;
+            asio::ip::tcp::socket::native_handle_type nativeSocket_;
+        };
+
+        enum class CapState
+        {
+            Listing, // CAP LS sent
+            Requesting, // CAP REQ sent
+            Authenticating, // AUTHENTICATE sent
+            Done // CAP END sent; registration goes on
+        };
+
+        enum class SendLane : size_t
+        {
+            Urgent, // PING, PONG, and QUIT with every line queued before it; bypass flood control
+            Normal // everything else, in the order sent
+        };
+
+        static constexpr size_t SendLaneCount = 2;
+        static constexpr size_t AuthenticateChunkSize = 400;
+        static constexpr size_t WriteBatchSizeThreshold = 16384; // one TLS record
+
+        static constexpr size_t CommandSlotCount = static_cast<size_t>(IrcCommand::End);
 
     private:
-        static const NicknamePrefixMap DefaultNicknamePrefixMap;
+        static const std::array<ProcFn, CommandSlotCount> ProcTable; // built-in handlers, indexed by IrcCommand
 
     private:
         IrcClient(const IrcClient &) = delete;
         IrcClient &operator =(const IrcClient &) = delete;
 
     private:
-        IrcClient(IrcClientPool &pool, size_t connectionId);
+        IrcClient(IrcClientPool &pool, size_t connectionId, asio::io_service &ios);
 
     public:
         size_t connectionId() const;
+        WriteStats writeStats() const;
 
         // self
         void nickname(const std::string &nickname);
@@ -161,62 +215,154 @@ namespace SudaGureum
         Event<const ServerMessageArgs &> onServerMessage;
         Event<const JoinChannelArgs &> onJoinChannel;
         Event<const PartChannelArgs &> onPartChannel;
+        Event<const ChannelSynchronizedArgs &> onChannelSynchronized; // on every RPL_ENDOFNAMES
         Event<const ChannelMessageArgs &> onChannelMessage;
         Event<const ChannelMessageArgs &> onChannelNotice;
         Event<const PersonalMessageArgs &> onPersonalMessage;
+        Event<const HistoryBatchArgs &> onHistoryBatch; // on the end of a chathistory batch
+
+        // Fired after the built-in handler of the command; register handlers before connecting.
+        Event<const CommandArgs &> &onCommand(IrcCommand command);
 
     private:
         void connect(const std::string &host, uint16_t port, std::string encoding,
-            std::vector<std::string> nicknames, bool ssl);
+            std::vector<std::string> nicknames, bool ssl, std::vector<std::string> caps, Sasl sasl,
+            std::optional<HandedOff> handedOff);
+        static std::string handoffKey(const std::string &host, uint16_t port, const std::vector<std::string> &nicknames);
+        void detach(std::function<void (std::optional<HandedOff>)> done); // nullopt if this connection cannot be handed off
+        void finishDetach();
+        void restore(HandedOff handedOff);
+        std::string saveState();
+        void loadState(std::string_view state);
+        void startConnect();
+        std::shared_ptr<asio::ssl::context> makeSslContext(); // drops EXTERNAL if its certificate cannot be used
+        void reconnect(); // called by the pool once backoff and limits allow
+        void finishReconnect();
+        void runInStrand(std::function<void ()> fn);
         void tryNextNickname();
         void read();
+        void readSome();
         void sendMessage(const IrcMessage &message);
+        void enqueueLine(SendLane lane, std::string line, bool secret = false); // only the command of a secret line is tapped
+        void flushQueuedJoins();
         void write();
         void close(bool clearMe = true);
         void forceClose();
-        bool isMyPrefix(const std::string &prefix) const;
-        bool isChannel(const std::string &str) const;
-        Participant parseParticipant(const std::string &nicknameWithPrefix) const;
+        void setNickname(std::string nickname);
+        bool isMe(std::string_view nickname) const;
+        bool isChannel(std::string_view str) const;
+        void setCaseMapping(CaseMapping caseMapping); // rebuilds name lookups of channels
+        Participant parseParticipant(std::string_view nicknameWithPrefix);
+        bool collectHistory(const IrcMessageView &message); // true if the message belongs to a chathistory batch
+        void requestHistory(const std::string &target);
+        void markHistory(const IrcMessageView &message); // remembers the server-time of a channel line
+        void endCapNegotiation();
 
     private:
-        void handleRead(const std::error_code &ec, size_t bytesTransferred);
-        void handleWrite(const std::error_code &ec, size_t bytesTransferred, const std::shared_ptr<std::string> &messagePtr);
+        void handleResolve(const std::error_code &ec, const ResolverCache::EndPoints &endPoints);
+        void handleConnect(const std::error_code &ec, std::shared_ptr<SocketBase> socket);
+        void handleReadable(const std::error_code &ec, const std::shared_ptr<SocketBase> &socket);
+        void handleRead(const std::error_code &ec, size_t bytesTransferred, const std::shared_ptr<SocketBase> &socket);
+        void handleWrite(const std::error_code &ec, size_t bytesTransferred, const std::shared_ptr<SocketBase> &socket);
+        void handleFloodTimer(const std::error_code &ec);
         void handleCloseTimeout(const std::error_code &ec);
-        void procMessage(const IrcMessage &message);
+        void procMessage(const IrcMessageView &message);
+
+    private:
+        void procAuthenticate(const IrcMessageView &message);
+        void procBatch(const IrcMessageView &message);
+        void procCap(const IrcMessageView &message);
+        void procError(const IrcMessageView &message);
+        void procJoin(const IrcMessageView &message);
+        void procMode(const IrcMessageView &message);
+        void procNick(const IrcMessageView &message);
+        void procNotice(const IrcMessageView &message);
+        void procPart(const IrcMessageView &message);
+        void procPing(const IrcMessageView &message);
+        void procPrivmsg(const IrcMessageView &message);
+        void procWelcome(const IrcMessageView &message);
+        void procISupport(const IrcMessageView &message);
+        void procNoTopic(const IrcMessageView &message);
+        void procTopic(const IrcMessageView &message);
+        void procTopicWhoTime(const IrcMessageView &message);
+        void procNamReply(const IrcMessageView &message);
+        void procEndOfNames(const IrcMessageView &message);
+        void procNicknameUnavailable(const IrcMessageView &message);
+        void procLoggedIn(const IrcMessageView &message);
+        void procSaslEnd(const IrcMessageView &message);
 
     private:
         IrcClientPool &pool_;
         size_t connectionId_;
         asio::io_service &ios_;
+        asio::io_service::strand strand_; // every handler and state change of this connection runs here
         std::shared_ptr<SocketBase> socket_;
+        std::shared_ptr<TrafficTap> tap_; // nullptr if the traffic tap is disabled
 
         std::string encoding_;
 
         IrcParser parser_;
-        std::array<char, 65536> bufferToRead_;
-
-        std::mutex bufferWriteLock_;
-        std::deque<std::string> bufferToWrite_;
-        std::mutex writeLock_;
-        std::atomic<bool> inWrite_;
-
-        CaseInsensitiveMap<std::string> serverOptions_;
-        std::array<std::string, 4> channelModes_;
-        std::string channelTypes_;
-        NicknamePrefixMap nicknamePrefixMap_;
+        ReadBuffer bufferToRead_;
+
+        std::array<std::deque<std::string>, SendLaneCount> sendLanes_; // encoded lines, indexed by SendLane
+        std::vector<std::pair<std::string, std::string>> queuedJoins_; // (channel, key); merged when flushed
+        std::string writeBatch_; // in flight; storage is reused between batches
+        size_t writeBatchCount_;
+        bool inWrite_;
+        struct
+        {
+            std::atomic<size_t> batches_;
+            std::atomic<size_t> messages_;
+            std::atomic<size_t> bytes_;
+        } writeStats_;
+        TokenBucket floodBucket_;
+        asio::basic_waitable_timer<std::chrono::steady_clock> floodTimer_;
+        bool floodTimerArmed_;
+        std::map<std::string, std::string, LessCaseMapping> joinKeys_; // keys of JOINs sent, until the server confirms them
+
+        std::string host_;
+        uint16_t port_;
+        bool ssl_;
+        std::shared_ptr<asio::ssl::context> sslContext_; // shared by the sockets of every attempt
+
+        InternPool names_; // nicknames and channel names of this network
+        ServerCapabilities capabilities_; // from RPL_ISUPPORT
+        std::vector<std::string> isupportTokens_; // as received, to rebuild capabilities_ after a handoff
+        CaseMapping caseMapping_; // capabilities_.caseMapping() once applied to the name lookups
+
+        std::vector<std::string> requestedCaps_; // sorted; from the server settings
+        Sasl sasl_;
+        CapState capState_;
+        std::vector<std::string> capsToRequest_; // offered by CAP LS so far
+        std::set<std::string> enabledCaps_;
+        std::unordered_map<std::string, Batch> batches_; // by reference tag
 
         bool connectBeginning_; // TODO: rename (not cool)
         std::vector<std::string> nicknameCandidates_;
         size_t currentNicknameIndex_;
 
         std::string nickname_;
+        std::string foldedNickname_; // under caseMapping_
 
         ChannelMap channels_;
+        std::map<std::string, std::chrono::system_clock::time_point, LessCaseMapping> historyMarks_; // newest line seen per channel; kept across reconnects
+
+        std::unordered_map<IrcCommand, Event<const CommandArgs &>> commandEvents_;
 
         bool quitReady_;
         asio::basic_waitable_timer<std::chrono::steady_clock> closeTimer_;
         bool clearMe_;
 
+        std::vector<std::pair<std::string, std::string>> channelsToRestore_; // (channel, key) joined before the connection was lost
+        std::set<std::string, LessCaseMapping> restoredChannels_; // rejoined while RPL_WELCOME is processed
+        size_t reconnectAttempt_; // reset on RPL_WELCOME
+        bool reconnecting_; // counted in IrcClientPool::reconnectsPerHost_
+        asio::basic_waitable_timer<std::chrono::steady_clock> reconnectTimer_;
+
+        std::string handoffKey_;
+        std::function<void (std::optional<HandedOff>)> detachDone_; // set while detaching
+        bool detachReadDone_; // the last read completed; no more reads are started
+
         friend class IrcClientPool;
     };
 
@@ -231,17 +377,41 @@ namespace SudaGureum
 
     public:
         std::weak_ptr<IrcClient> connect(const std::string &host, uint16_t port, std::string encoding,
-            std::vector<std::string> nicknames, bool ssl, std::function<void (IrcClient &)> constructCb);
+            std::vector<std::string> nicknames, bool ssl, std::vector<std::string> caps, IrcClient::Sasl sasl,
+            std::function<void (IrcClient &)> constructCb);
         void closeAll();
 
+        // Connections given by adopt are taken by connect with the same host, port and nicknames;
+        // call discardAdopted once every user is connected.
+        Handoff::Payload detachAll(); // called on the handoff thread; blocks until every connection is detached
+        void adopt(Handoff::Payload payload);
+        void discardAdopted();
+
     private:
         void closed(const std::shared_ptr<IrcClient> &client);
+        void scheduleReconnect(const std::shared_ptr<IrcClient> &client);
+        void reconnectFinished(const std::string &host);
+        std::vector<std::shared_ptr<IrcClient>> pumpReconnects(); // entered with reconnectLock_ held; returns clients to start
 
     private:
         asio::signal_set signals_; // TODO: temporary
+        ResolverCache resolverCache_; // shared by all connections of the pool
         std::mutex clientsLock_;
         std::unordered_map<size_t, std::shared_ptr<IrcClient>> clients_;
         std::atomic<size_t> nextConnectionId_;
+        std::unordered_map<std::string, IrcClient::HandedOff> adopted_; // by IrcClient::handoffKey; guarded by clientsLock_
+
+        // reconnect scheduler
+        std::mutex reconnectLock_;
+        std::mt19937 reconnectRandom_;
+        std::chrono::milliseconds reconnectBaseDelay_;
+        std::chrono::milliseconds reconnectMaxDelay_;
+        size_t reconnectPerHostLimit_;
+        std::deque<std::shared_ptr<IrcClient>> reconnectQueue_; // backoff elapsed, waiting for the limits
+        std::unordered_map<std::string, size_t> reconnectsPerHost_; // reconnects in progress
+        TokenBucket reconnectBucket_; // global reconnect rate
+        asio::basic_waitable_timer<std::chrono::steady_clock> reconnectTimer_;
+        bool reconnectTimerArmed_;
 
         friend class IrcClient;
     };
@@ -0,0 +1,152 @@
+﻿#include "Common.h"
+
+#include "IrcCommand.h"
+
+namespace SudaGureum
+{
+    namespace
+    {
+        enum CharClass : uint8_t
+        {
+            Other = 0,
+            Alpha,
+            Digit
+        };
+
+        constexpr std::array<uint8_t, 256> CharClassTable = []()
+        {
+            std::array<uint8_t, 256> table = {};
+            for(int ch = 'A'; ch <= 'Z'; ++ ch)
+            {
+                table[ch] = Alpha;
+                table[ch - 'A' + 'a'] = Alpha;
+            }
+            for(int ch = '0'; ch <= '9'; ++ ch)
+            {
+                table[ch] = Digit;
+            }
+            return table;
+        }();
+
+        constexpr char toUpperAscii(char ch)
+        {
+            return (ch >= 'a' && ch <= 'z') ? static_cast<char>(ch - 'a' + 'A') : ch;
+        }
+
+        struct IrcCommandName
+        {
+            std::string_view name_; // upper case
+            IrcCommand command_;
+        };
+
+        constexpr IrcCommandName IrcCommandNames[] =
+        {
+            {"ACCOUNT", IrcCommand::Account},
+            {"AUTHENTICATE", IrcCommand::Authenticate},
+            {"AWAY", IrcCommand::Away},
+            {"BATCH", IrcCommand::Batch},
+            {"CAP", IrcCommand::Cap},
+            {"CHGHOST", IrcCommand::ChgHost},
+            {"ERROR", IrcCommand::Error},
+            {"INVITE", IrcCommand::Invite},
+            {"JOIN", IrcCommand::Join},
+            {"KICK", IrcCommand::Kick},
+            {"KILL", IrcCommand::Kill},
+            {"MODE", IrcCommand::Mode},
+            {"NICK", IrcCommand::Nick},
+            {"NOTICE", IrcCommand::Notice},
+            {"PART", IrcCommand::Part},
+            {"PING", IrcCommand::Ping},
+            {"PONG", IrcCommand::Pong},
+            {"PRIVMSG", IrcCommand::Privmsg},
+            {"QUIT", IrcCommand::Quit},
+            {"SETNAME", IrcCommand::SetName},
+            {"TAGMSG", IrcCommand::TagMsg},
+            {"TOPIC", IrcCommand::Topic},
+            {"WALLOPS", IrcCommand::Wallops},
+        };
+
+        static_assert(std::size(IrcCommandNames) == static_cast<size_t>(IrcCommand::End) - static_cast<size_t>(IrcCommand::Unknown) - 1,
+            "every word command needs its name");
+
+        constexpr uint32_t hashWord(std::string_view word) // FNV-1a, case-insensitive
+        {
+            uint32_t hash = 2166136261u;
+            for(char ch: word)
+            {
+                hash ^= static_cast<uint8_t>(toUpperAscii(ch));
+                hash *= 16777619u;
+            }
+            return hash;
+        }
+
+        constexpr size_t WordTableSize = 64; // power of 2, more than twice of names
+
+        // Open addressing (linear probing); each slot is an index of IrcCommandNames plus 1, or 0 if empty.
+        constexpr std::array<uint8_t, WordTableSize> WordTable = []()
+        {
+            std::array<uint8_t, WordTableSize> table = {};
+            for(size_t i = 0; i < std::size(IrcCommandNames); ++ i)
+            {
+                size_t slot = hashWord(IrcCommandNames[i].name_) & (WordTableSize - 1);
+                while(table[slot] != 0)
+                {
+                    slot = (slot + 1) & (WordTableSize - 1);
+                }
+                table[slot] = static_cast<uint8_t>(i + 1);
+            }
+            return table;
+        }();
+
+        constexpr IrcCommand lookupWord(std::string_view word)
+        {
+            size_t slot = hashWord(word) & (WordTableSize - 1);
+            while(WordTable[slot] != 0)
+            {
+                const IrcCommandName &entry = IrcCommandNames[WordTable[slot] - 1];
+                if(entry.name_.size() == word.size()
+                    && std::equal(word.begin(), word.end(), entry.name_.begin(),
+                        [](char lhs, char rhs) { return toUpperAscii(lhs) == rhs; }))
+                {
+                    return entry.command_;
+                }
+                slot = (slot + 1) & (WordTableSize - 1);
+            }
+            return IrcCommand::Unknown;
+        }
+
+        static_assert(lookupWord("PRIVMSG") == IrcCommand::Privmsg);
+        static_assert(lookupWord("join") == IrcCommand::Join);
+        static_assert(lookupWord("FOO") == IrcCommand::Unknown);
+    }
+
+    std::optional<IrcCommand> classifyIrcCommand(std::string_view command)
+    {
+        if(command.empty())
+        {
+            return std::nullopt;
+        }
+
+        if(CharClassTable[static_cast<uint8_t>(command[0])] == Digit)
+        {
+            if(command.size() != 3
+                || CharClassTable[static_cast<uint8_t>(command[1])] != Digit
+                || CharClassTable[static_cast<uint8_t>(command[2])] != Digit)
+            {
+                return std::nullopt;
+            }
+
+            return static_cast<IrcCommand>((command[0] - '0') * 100 + (command[1] - '0') * 10 + (command[2] - '0'));
+        }
+
+        for(char ch: command)
+        {
+            if(CharClassTable[static_cast<uint8_t>(ch)] != Alpha)
+            {
+                return std::nullopt;
+            }
+        }
+
+        return lookupWord(command);
+    }
+}
@@ -0,0 +1,79 @@
+﻿#pragma once
+
+namespace SudaGureum
+{
+    // Numeric replies keep their own value (0-999), so a command maps to a dense slot without any lookup.
+    enum class IrcCommand : uint16_t
+    {
+        RplWelcome = 1,
+        RplYourHost = 2,
+        RplCreated = 3,
+        RplMyInfo = 4,
+        RplISupport = 5,
+        RplNoTopic = 331,
+        RplTopic = 332,
+        RplTopicWhoTime = 333,
+        RplNamReply = 353,
+        RplEndOfNames = 366,
+        RplMotd = 372,
+        RplMotdStart = 375,
+        RplEndOfMotd = 376,
+        ErrNoSuchChannel = 403,
+        ErrTooManyChannels = 405,
+        ErrNoMotd = 422,
+        ErrErroneusNickname = 432,
+        ErrNicknameInUse = 433,
+        ErrNickCollision = 436,
+        ErrUnavailResource = 437,
+        ErrChannelIsFull = 471,
+        ErrInviteOnlyChan = 473,
+        ErrBannedFromChan = 474,
+        ErrBadChannelKey = 475,
+        RplLoggedIn = 900,
+        RplLoggedOut = 901,
+        RplSaslSuccess = 903,
+        ErrSaslFail = 904,
+        ErrSaslTooLong = 905,
+        ErrSaslAborted = 906,
+        ErrSaslAlready = 907,
+        RplSaslMechs = 908,
+
+        NumericEnd = 1000,
+
+        // Words; any valid but unlisted word is Unknown.
+        Unknown = NumericEnd,
+        Account,
+        Authenticate,
+        Away,
+        Batch,
+        Cap,
+        ChgHost,
+        Error,
+        Invite,
+        Join,
+        Kick,
+        Kill,
+        Mode,
+        Nick,
+        Notice,
+        Part,
+        Ping,
+        Pong,
+        Privmsg,
+        Quit,
+        SetName,
+        TagMsg,
+        Topic,
+        Wallops,
+
+        End
+    };
+
+    // Validates the command of a message ([A-Za-z]+ or [0-9]{3}) and classifies it; nullopt if invalid.
+    std::optional<IrcCommand> classifyIrcCommand(std::string_view command);
+
+    constexpr bool isNumericIrcCommand(IrcCommand command)
+    {
+        return command < IrcCommand::NumericEnd;
+    }
+}
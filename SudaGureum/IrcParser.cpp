@@ -6,6 +6,72 @@
 
 namespace SudaGureum
 {
+    std::string escapeTagValue(std::string_view value)
+    {
+        std::string escaped;
+        escaped.reserve(value.size());
+        for(char ch: value)
+        {
+            switch(ch)
+            {
+            case ';':
+                escaped += "\\:";
+                break;
+            case ' ':
+                escaped += "\\s";
+                break;
+            case '\\':
+                escaped += "\\\\";
+                break;
+            case '\r':
+                escaped += "\\r";
+                break;
+            case '\n':
+                escaped += "\\n";
+                break;
+            default:
+                escaped += ch;
+            }
+        }
+        return escaped;
+    }
+
+    std::string unescapeTagValue(std::string_view value)
+    {
+        std::string unescaped;
+        unescaped.reserve(value.size());
+        for(size_t i = 0; i < value.size(); ++ i)
+        {
+            if(value[i] != '\\')
+            {
+                unescaped += value[i];
+                continue;
+            }
+
+            if(++ i == value.size()) // a trailing backslash is dropped
+                break;
+
+            switch(value[i])
+            {
+            case ':':
+                unescaped += ';';
+                break;
+            case 's':
+                unescaped += ' ';
+                break;
+            case 'r':
+                unescaped += '\r';
+                break;
+            case 'n':
+                unescaped += '\n';
+                break;
+            default: // including the backslash itself
+                unescaped += value[i];
+            }
+        }
+        return unescaped;
+    }
+
     IrcMessage::IrcMessage()
     {
     }
@@ -28,6 +94,18 @@ namespace SudaGureum
     {
     }
 
+    IrcMessage::IrcMessage(const IrcMessageView &view)
+        : prefix_(view.prefix_)
+        , command_(view.command_)
+        , params_(view.params_.begin(), view.params_.end())
+    {
+        tags_.reserve(view.tags_.tags_.size());
+        for(const IrcTag &tag: view.tags_.tags_)
+        {
+            tags_.emplace_back(tag.key_, unescapeTagValue(tag.value_));
+        }
+    }
+
     IrcParser::IrcParser()
         : state_(State::None)
     {
@@ -39,166 +117,235 @@ namespace SudaGureum
         buffer_.clear();
     }
 
-    bool IrcParser::parse(const std::string &str, std::function<void (const IrcMessage &)> cb)
+    bool IrcParser::parse(std::span<const char> data, std::function<void (const IrcMessageView &)> cb)
     {
         if(state_ == State::Error)
         {
             return false;
         }
 
-        auto append = [this](char ch)
+        if(data.empty())
         {
-            static const size_t BufferSizeThreshold = 4096;
-
-            buffer_ += ch;
-            if(buffer_.size() > BufferSizeThreshold)
-            {
-                return false;
-            }
-
             return true;
-        };
+        }
+
+        const char *it = data.data();
+        const char *end = it + data.size();
 
-        std::string line;
-        for(char ch: str)
+        if(!buffer_.empty()) // complete the partial line of the previous read first
         {
-            switch(state_)
+            const char *lf = static_cast<const char *>(std::memchr(it, '\n', end - it));
+            if(lf == nullptr)
             {
-            case State::None:
-                if(ch == '\r' || ch == '\n')
+                buffer_.append(it, end);
+                if(buffer_.size() > BufferSizeThreshold)
                 {
                     state_ = State::Error;
                     return false;
                 }
-                else
-                {
-                    if(!append(ch))
-                    {
-                        state_ = State::Error;
-                        return false;
-                    }
-                    state_ = State::InLine;
-                }
-                break;
+                return true;
+            }
 
-            case State::InLine:
-                if(ch == '\r' || ch == '\n')
-                {
-                    if(ch == '\r')
-                    {
-                        state_ = State::WaitLf;
-                    }
-                    if(!parseMessage(std::move(buffer_), cb))
-                    {
-                        state_ = State::Error;
-                        return false;
-                    }
-                    buffer_.clear();
-                }
-                else
-                {
-                    if(!append(ch))
-                    {
-                        return false;
-                    }
-                }
-                break;
+            buffer_.append(it, lf);
+            it = lf + 1;
+
+            bool res = parseLine(buffer_, cb);
+            buffer_.clear();
+            if(!res)
+            {
+                state_ = State::Error;
+                return false;
+            }
+        }
 
-            case State::WaitLf:
-                if(ch != '\n')
+        while(it != end)
+        {
+            const char *lf = static_cast<const char *>(std::memchr(it, '\n', end - it));
+            if(lf == nullptr)
+            {
+                if(static_cast<size_t>(end - it) > BufferSizeThreshold)
                 {
                     state_ = State::Error;
                     return false;
                 }
-                else
-                {
-                    state_ = State::None;
-                }
+                buffer_.assign(it, end); // only partial line is copied
                 break;
             }
+
+            if(!parseLine(std::string_view(it, lf - it), cb))
+            {
+                state_ = State::Error;
+                return false;
+            }
+            it = lf + 1;
         }
 
         return true;
     }
 
-    bool IrcParser::parseMessage(const std::string &line, std::function<void (const IrcMessage &)> cb)
+    bool IrcParser::parse(const std::string &str, std::function<void (const IrcMessage &)> cb)
+    {
+        return parse(std::span<const char>(str.data(), str.size()),
+            [&cb](const IrcMessageView &message)
+            {
+                cb(IrcMessage(message));
+            });
+    }
+
+    bool IrcParser::parseLine(std::string_view line, const std::function<void (const IrcMessageView &)> &cb)
     {
-        enum class ParseMessageState : int32_t
+        if(!line.empty() && line.back() == '\r')
         {
-            None,
-            WaitCommand,
-            InParam,
-            InTrailing
-        } state = ParseMessageState::None;
+            line.remove_suffix(1);
+        }
 
-        std::vector<std::string> words;
-        boost::algorithm::split(words, line, boost::algorithm::is_any_of(" "));
+        // empty line, or CR without LF
+        if(line.empty() || line.size() > BufferSizeThreshold || line.find('\r') != std::string_view::npos)
+        {
+            return false;
+        }
 
-        IrcMessage message;
-        for(const std::string &word: words)
+        IrcMessageView message;
+        if(!parseMessage(line, message))
         {
-            if(state != ParseMessageState::InTrailing && word.empty())
+            return false;
+        }
+
+        cb(message);
+
+        return true;
+    }
+
+    bool IrcParser::parseMessage(std::string_view line, IrcMessageView &message)
+    {
+        message.line_ = line;
+
+        std::string_view rest = line;
+        bool hasMore = true;
+        auto nextWord = [&rest, &hasMore]()
+        {
+            size_t spacePos = rest.find(' ');
+            std::string_view word = rest.substr(0, spacePos);
+            if(spacePos == std::string_view::npos)
+            {
+                rest = {};
+                hasMore = false;
+            }
+            else
+            {
+                rest.remove_prefix(spacePos + 1);
+            }
+            return word;
+        };
+
+        std::string_view word = nextWord();
+        if(word.empty())
+        {
+            return false;
+        }
+
+        if(word[0] == '@')
+        {
+            if(!parseTags(word.substr(1), message.tags_) || !hasMore)
             {
                 return false;
             }
 
-            switch(state)
+            word = nextWord();
+            if(word.empty())
             {
-            case ParseMessageState::None:
-                if(word[0] == ':')
-                {
-                    message.prefix_ = word.substr(1);
-                    if(message.prefix_.empty())
-                    {
-                        return false;
-                    }
-                    state = ParseMessageState::WaitCommand;
-                }
-                else
-                {
-                    message.command_ = word;
-                    state = ParseMessageState::InParam;
-                }
-                break;
+                return false;
+            }
+        }
 
-            case ParseMessageState::WaitCommand:
-                message.command_ = word;
-                state = ParseMessageState::InParam;
-                break;
+        if(word[0] == ':')
+        {
+            message.prefix_ = word.substr(1);
+            if(message.prefix_.empty() || !hasMore)
+            {
+                return false;
+            }
 
-            case ParseMessageState::InParam:
-                if(word[0] == ':')
-                {
-                    message.params_.push_back(word.substr(1));
-                    state = ParseMessageState::InTrailing;
-                }
-                else
-                {
-                    message.params_.push_back(word);
-                    if(message.params_.size() >= 15)
-                    {
-                        state = ParseMessageState::InTrailing;
-                    }
-                }
-                break;
+            // nickname[[!user]@host]
+            std::string_view prefix = message.prefix_;
+            size_t hostPos = prefix.find('@');
+            if(hostPos != std::string_view::npos)
+            {
+                message.source_.host_ = prefix.substr(hostPos + 1);
+                prefix = prefix.substr(0, hostPos);
+            }
+            size_t userPos = prefix.find('!');
+            if(userPos != std::string_view::npos)
+            {
+                message.source_.user_ = prefix.substr(userPos + 1);
+                prefix = prefix.substr(0, userPos);
+            }
+            message.source_.nickname_ = prefix;
 
-            case ParseMessageState::InTrailing:
-                message.params_.back() += " " + word;
-                break;
+            word = nextWord();
+            if(word.empty())
+            {
+                return false;
             }
         }
 
-        static const boost::regex CommandRegex("[A-Za-z]+|[0-9]{3}", boost::regex::extended); // TODO: non-static or something
-        if(!boost::regex_match(message.command_, CommandRegex))
+        auto commandType = classifyIrcCommand(word);
+        if(!commandType)
         {
             return false;
         }
 
-        cb(message);
+        message.command_ = word;
+        message.commandType_ = commandType.value();
+
+        while(hasMore)
+        {
+            if(rest.empty() || rest[0] == ' ') // empty word
+            {
+                return false;
+            }
+
+            if(rest[0] == ':' || message.params_.size() == IrcMessageView::MaxParams - 1) // trailing
+            {
+                message.params_.push_back(rest[0] == ':' ? rest.substr(1) : rest);
+                break;
+            }
+
+            message.params_.push_back(nextWord());
+        }
+
+        return true;
+    }
+
+    bool IrcParser::parseTags(std::string_view tags, IrcTagMap &tagMap)
+    {
+        while(!tags.empty())
+        {
+            size_t semicolonPos = tags.find(';');
+            std::string_view tag = tags.substr(0, semicolonPos);
+            tags = semicolonPos == std::string_view::npos ? std::string_view() : tags.substr(semicolonPos + 1);
+            if(tag.empty())
+            {
+                continue;
+            }
 
+            size_t equalPos = tag.find('=');
+            IrcTag parsed{tag.substr(0, equalPos),
+                equalPos == std::string_view::npos ? std::string_view() : tag.substr(equalPos + 1)};
+            if(parsed.key_.empty())
+            {
+                return false;
+            }
+            tagMap.tags_.push_back(parsed);
+        }
         return true;
     }
 
+    const std::string &IrcParser::partialLine() const
+    {
+        return buffer_;
+    }
+
     IrcParser::operator bool() const
     {
         return (state_ != State::Error);
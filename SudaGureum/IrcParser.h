@@ -1,9 +1,57 @@
 ﻿#pragma once
 
+#include "IrcCommand.h"
+
 namespace SudaGureum
 {
+    struct IrcMessageView;
+
+    // Tag values are escaped on the wire (IRCv3 message-tags).
+    std::string escapeTagValue(std::string_view value);
+    std::string unescapeTagValue(std::string_view value);
+
+    struct IrcTag
+    {
+        std::string_view key_; // with the client-only '+' and the vendor prefix, if any
+        std::string_view value_; // still escaped; empty if not given
+    };
+
+    // Tags of a message in wire order; there are few enough of them that a linear search is the fastest.
+    struct IrcTagMap
+    {
+        boost::container::small_vector<IrcTag, 8> tags_;
+
+        // The last one wins if a key is repeated.
+        std::optional<std::string_view> find(std::string_view key) const
+        {
+            for(auto it = tags_.rbegin(); it != tags_.rend(); ++ it)
+            {
+                if(it->key_ == key)
+                    return it->value_;
+            }
+            return std::nullopt;
+        }
+
+        std::optional<std::string> value(std::string_view key) const // unescaped
+        {
+            auto escaped = find(key);
+            if(!escaped.has_value())
+                return std::nullopt;
+            return unescapeTagValue(escaped.value());
+        }
+    };
+
+    // Prefix of a message, split once by the parser; views into the same line as the prefix.
+    struct IrcPrefix
+    {
+        std::string_view nickname_; // or the server name
+        std::string_view user_; // empty if not given
+        std::string_view host_; // empty if not given
+    };
+
     struct IrcMessage
     {
+        std::vector<std::pair<std::string, std::string>> tags_; // unescaped values
         std::string prefix_;
         std::string command_;
         std::vector<std::string> params_;
@@ -12,16 +60,33 @@ namespace SudaGureum
         explicit IrcMessage(std::string command);
         IrcMessage(std::string command, std::vector<std::string> params);
         IrcMessage(std::string prefix, std::string command, std::vector<std::string> params);
+        explicit IrcMessage(const IrcMessageView &view);
+    };
+
+    // Non-owning message; all views point into the data given to IrcParser::parse (or into the parser's
+    // partial line buffer), so it is valid only until the callback returns.
+    struct IrcMessageView
+    {
+        static constexpr size_t MaxParams = 15;
+
+        std::string_view line_; // whole line without CR-LF
+        IrcTagMap tags_;
+        std::string_view prefix_;
+        IrcPrefix source_; // prefix_ split into parts
+        std::string_view command_;
+        IrcCommand commandType_ = IrcCommand::Unknown;
+        boost::container::static_vector<std::string_view, MaxParams> params_;
     };
 
     class IrcParser
     {
+    private:
+        static constexpr size_t BufferSizeThreshold = 8191 + 512; // tags with '@' and the space, then the rest with CR-LF
+
     private:
         enum class State : int32_t
         {
             None,
-            InLine,
-            WaitLf,
             Error
         };
 
@@ -30,17 +95,23 @@ namespace SudaGureum
 
     public:
         void clear();
+        bool parse(std::span<const char> data, std::function<void (const IrcMessageView &)> cb);
         bool parse(const std::string &str, std::function<void (const IrcMessage &)> cb);
 
     public:
         explicit operator bool() const;
         bool operator !() const;
 
+    public:
+        const std::string &partialLine() const; // received after the last LF
+
     private:
-        bool parseMessage(const std::string &line, std::function<void(const IrcMessage &)> cb);
+        bool parseLine(std::string_view line, const std::function<void (const IrcMessageView &)> &cb);
+        static bool parseMessage(std::string_view line, IrcMessageView &message);
+        static bool parseTags(std::string_view tags, IrcTagMap &tagMap);
 
     private:
         State state_;
-        std::string buffer_;
+        std::string buffer_; // partial line carried over to the next parse
     };
 }
@@ -2,10 +2,45 @@
 
 #include "MtIoService.h"
 
+#include "Configure.h"
+#include "Log.h"
+
+#if defined(__linux__)
+#   include <pthread.h>
+#endif
+
 namespace SudaGureum
 {
-    void MtIoService::runImpl(asio::io_service &ios)
+    namespace
     {
+        void pinCurrentThread(size_t cpu)
+        {
+#if defined(_WIN32)
+            if(SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(1) << (cpu % (sizeof(DWORD_PTR) * 8))) == 0)
+            {
+                Log::instance().warn("MtIoService: cannot pin thread to cpu {}", cpu);
+            }
+#elif defined(__linux__)
+            cpu_set_t cpuSet;
+            CPU_ZERO(&cpuSet);
+            CPU_SET(cpu, &cpuSet);
+            if(pthread_setaffinity_np(pthread_self(), sizeof(cpuSet), &cpuSet) != 0)
+            {
+                Log::instance().warn("MtIoService: cannot pin thread to cpu {}", cpu);
+            }
+#else
+            Log::instance().warn("MtIoService: thread pinning is not supported on this platform");
+#endif
+        }
+    }
+
+    void MtIoService::runImpl(asio::io_service &ios, std::optional<size_t> cpu)
+    {
+        if(cpu)
+        {
+            pinCurrentThread(cpu.value());
+        }
+
         try
         {
             ios.run();
@@ -28,22 +63,57 @@ namespace SudaGureum
         }
     }
 
+    MtIoService::MtIoService(const std::string &name)
+        : pinThreads_(Configure::instance().getAs(name + "_io_pin_threads", false))
+        , assignByHash_(Configure::instance().get(name + "_io_assignment").value_or("round_robin") == "hash")
+        , nextShard_(0)
+    {
+        size_t numShards = Configure::instance().getAs(name + "_io_shards", size_t(1));
+        for(size_t i = 1; i < numShards; ++ i)
+        {
+            shards_.push_back(std::make_unique<asio::io_service>(1)); // concurrency hint; one thread each
+        }
+    }
+
     MtIoService::~MtIoService()
     {
     }
 
     void MtIoService::run(uint16_t numThreads)
     {
-        for(uint16_t i = 0; i < numThreads; ++ i)
+        size_t numCpus = std::max(std::thread::hardware_concurrency(), 1u);
+
+        if(shards_.empty())
+        {
+            for(uint16_t i = 0; i < numThreads; ++ i)
+            {
+                std::shared_ptr<std::thread> thread(
+                    new std::thread(std::bind(&MtIoService::runImpl, std::ref(ios_),
+                        pinThreads_ ? std::make_optional<size_t>(i % numCpus) : std::nullopt)));
+                threads_.push_back(thread);
+            }
+        }
+        else
         {
-            std::shared_ptr<std::thread> thread(
-                new std::thread(std::bind(&MtIoService::runImpl, std::ref(ios_))));
-            threads_.push_back(thread);
+            for(size_t i = 0; i < shardCount(); ++ i)
+            {
+                workGuards_.push_back(asio::make_work_guard(shard(i)));
+                std::shared_ptr<std::thread> thread(
+                    new std::thread(std::bind(&MtIoService::runImpl, std::ref(shard(i)),
+                        pinThreads_ ? std::make_optional<size_t>(i % numCpus) : std::nullopt)));
+                threads_.push_back(thread);
+            }
         }
     }
 
     void MtIoService::join()
     {
+        // like shared mode, shards run until they are out of work from now on
+        for(auto &workGuard: workGuards_)
+        {
+            workGuard.reset();
+        }
+
         for(auto &thread: threads_)
         {
             thread->join();
@@ -52,6 +122,31 @@ namespace SudaGureum
 
     void MtIoService::stop()
     {
-        ios_.stop();
+        for(size_t i = 0; i < shardCount(); ++ i)
+        {
+            shard(i).stop();
+        }
+    }
+
+    size_t MtIoService::shardCount() const
+    {
+        return shards_.size() + 1;
+    }
+
+    asio::io_service &MtIoService::shard(size_t index)
+    {
+        return index == 0 ? ios_ : *shards_[index - 1];
+    }
+
+    asio::io_service &MtIoService::assignIoService()
+    {
+        return shard(nextShard_.fetch_add(1, std::memory_order_relaxed) % shardCount());
+    }
+
+    asio::io_service &MtIoService::assignIoService(size_t hash)
+    {
+        if(!assignByHash_)
+            return assignIoService();
+        return shard(hash % shardCount());
     }
 }
@@ -2,21 +2,38 @@
 
 namespace SudaGureum
 {
+    // Runs asio::io_service's on worker threads.
+    // In shared mode (default), all threads run ios_. In sharded mode ("<name>_io_shards" > 1), every thread runs
+    // its own io_service, ios_ being shard 0, and connections are spread over shards by assignIoService.
     class MtIoService
     {
     private:
-        static void runImpl(asio::io_service &ios);
+        static void runImpl(asio::io_service &ios, std::optional<size_t> cpu);
 
     public:
+        explicit MtIoService(const std::string &name); // prefix of configure keys
         virtual ~MtIoService() = 0;
 
     public:
-        void run(uint16_t numThreads);
+        void run(uint16_t numThreads); // numThreads is ignored in sharded mode; one thread per shard
         void join();
         void stop();
 
+    public:
+        size_t shardCount() const;
+        asio::io_service &shard(size_t index);
+        asio::io_service &assignIoService(); // round-robin
+        asio::io_service &assignIoService(size_t hash); // round-robin unless "<name>_io_assignment" is "hash"
+
     protected:
-        asio::io_service ios_;
+        asio::io_service ios_; // shard 0
+        std::vector<std::unique_ptr<asio::io_service>> shards_; // shard 1 and later
+        std::vector<asio::executor_work_guard<asio::io_service::executor_type>> workGuards_; // keeps idle shards running
         std::vector<std::shared_ptr<std::thread>> threads_;
+
+    private:
+        bool pinThreads_;
+        bool assignByHash_;
+        std::atomic<size_t> nextShard_;
     };
 }
@@ -0,0 +1,265 @@
+﻿#include "Common.h"
+
+#include "ParticipantIndex.h"
+
+namespace SudaGureum
+{
+    ParticipantIndex::ParticipantIndex(InternPool pool, CaseMapping caseMapping)
+        : pool_(std::move(pool))
+        , caseMapping_(caseMapping)
+        , foldTable_(&caseFoldTable(caseMapping))
+    {
+    }
+
+    CaseMapping ParticipantIndex::caseMapping() const
+    {
+        return caseMapping_;
+    }
+
+    void ParticipantIndex::setCaseMapping(CaseMapping caseMapping)
+    {
+        if(caseMapping == caseMapping_)
+            return;
+
+        caseMapping_ = caseMapping;
+        foldTable_ = &caseFoldTable(caseMapping);
+
+        // nicknames distinct under the old mapping may collide under the new one; the first one is kept
+        std::vector<Entry> entries;
+        entries.swap(entries_);
+        slots_.clear();
+        reserve(entries.size());
+        for(Entry &entry: entries)
+        {
+            insert(std::move(static_cast<Participant &>(entry)));
+        }
+    }
+
+    size_t ParticipantIndex::size() const
+    {
+        return entries_.size();
+    }
+
+    bool ParticipantIndex::empty() const
+    {
+        return entries_.empty();
+    }
+
+    ParticipantIndex::const_iterator ParticipantIndex::begin() const
+    {
+        return entries_.begin();
+    }
+
+    ParticipantIndex::const_iterator ParticipantIndex::end() const
+    {
+        return entries_.end();
+    }
+
+    void ParticipantIndex::clear()
+    {
+        entries_.clear();
+        std::fill(slots_.begin(), slots_.end(), Slot{0, 0});
+    }
+
+    void ParticipantIndex::reserve(size_t count)
+    {
+        entries_.reserve(count);
+        growSlots(count);
+    }
+
+    ParticipantIndex::Participant *ParticipantIndex::find(std::string_view nickname)
+    {
+        size_t pos = findSlot(nickname, hash(nickname));
+        return pos == NoSlot ? nullptr : &entries_[slots_[pos].index_ - 1];
+    }
+
+    const ParticipantIndex::Participant *ParticipantIndex::find(std::string_view nickname) const
+    {
+        size_t pos = findSlot(nickname, hash(nickname));
+        return pos == NoSlot ? nullptr : &entries_[slots_[pos].index_ - 1];
+    }
+
+    bool ParticipantIndex::insert(Participant participant)
+    {
+        uint32_t participantHash = hash(participant.nickname_);
+        if(findSlot(participant.nickname_, participantHash) != NoSlot)
+            return false;
+
+        growSlots(entries_.size() + 1);
+        entries_.push_back(makeEntry(std::move(participant)));
+        insertSlot(static_cast<uint32_t>(entries_.size() - 1), entries_.back().hash_);
+        return true;
+    }
+
+    void ParticipantIndex::bulkInsert(std::span<const Participant> participants)
+    {
+        reserve(entries_.size() + participants.size());
+        for(const Participant &participant: participants)
+        {
+            size_t pos = findSlot(participant.nickname_, hash(participant.nickname_));
+            if(pos != NoSlot)
+            {
+                entries_[slots_[pos].index_ - 1].modes_ = participant.modes_;
+                continue;
+            }
+
+            entries_.push_back(makeEntry(participant));
+            insertSlot(static_cast<uint32_t>(entries_.size() - 1), entries_.back().hash_);
+        }
+    }
+
+    bool ParticipantIndex::erase(std::string_view nickname)
+    {
+        size_t pos = findSlot(nickname, hash(nickname));
+        if(pos == NoSlot)
+            return false;
+
+        eraseEntry(pos);
+        return true;
+    }
+
+    bool ParticipantIndex::rename(std::string_view nickname, InternedString newNickname)
+    {
+        size_t pos = findSlot(nickname, hash(nickname));
+        if(pos == NoSlot)
+            return false;
+
+        uint32_t index = slots_[pos].index_ - 1;
+        Entry &entry = entries_[index];
+        uint32_t newHash = hash(newNickname);
+        if(newHash == entry.hash_ && equals(entry.folded_, newNickname)) // only the case has changed
+        {
+            entry.nickname_ = std::move(newNickname);
+            return true;
+        }
+
+        if(findSlot(newNickname, newHash) != NoSlot)
+            return false;
+
+        removeSlot(pos);
+        entry.nickname_ = std::move(newNickname);
+        fold(entry);
+        insertSlot(index, entry.hash_);
+        return true;
+    }
+
+    uint32_t ParticipantIndex::hash(std::string_view nickname) const // FNV-1a of the folded nickname
+    {
+        uint32_t result = 2166136261u;
+        for(char ch: nickname)
+        {
+            result ^= (*foldTable_)[static_cast<uint8_t>(ch)];
+            result *= 16777619u;
+        }
+        return result;
+    }
+
+    bool ParticipantIndex::equals(std::string_view folded, std::string_view nickname) const
+    {
+        return equalsPrefolded(folded, nickname, caseMapping_);
+    }
+
+    size_t ParticipantIndex::findSlot(std::string_view nickname, uint32_t hash) const
+    {
+        if(slots_.empty())
+            return NoSlot;
+
+        size_t mask = slots_.size() - 1;
+        for(size_t pos = hash & mask; ; pos = (pos + 1) & mask)
+        {
+            const Slot &slot = slots_[pos];
+            if(slot.index_ == 0)
+                return NoSlot;
+            if(slot.hash_ == hash && equals(entries_[slot.index_ - 1].folded_, nickname))
+                return pos;
+        }
+    }
+
+    size_t ParticipantIndex::findSlotOfIndex(uint32_t index) const
+    {
+        size_t mask = slots_.size() - 1;
+        for(size_t pos = entries_[index].hash_ & mask; ; pos = (pos + 1) & mask)
+        {
+            if(slots_[pos].index_ == index + 1)
+                return pos;
+        }
+    }
+
+    void ParticipantIndex::insertSlot(uint32_t index, uint32_t hash)
+    {
+        size_t mask = slots_.size() - 1;
+        size_t pos = hash & mask;
+        while(slots_[pos].index_ != 0)
+        {
+            pos = (pos + 1) & mask;
+        }
+        slots_[pos] = Slot{index + 1, hash};
+    }
+
+    void ParticipantIndex::removeSlot(size_t pos)
+    {
+        // backward shift deletion; keeps every probe sequence unbroken without tombstones
+        size_t mask = slots_.size() - 1;
+        size_t hole = pos;
+        for(size_t next = (hole + 1) & mask; slots_[next].index_ != 0; next = (next + 1) & mask)
+        {
+            size_t home = slots_[next].hash_ & mask;
+            if(((next - home) & mask) >= ((next - hole) & mask))
+            {
+                slots_[hole] = slots_[next];
+                hole = next;
+            }
+        }
+        slots_[hole] = Slot{0, 0};
+    }
+
+    void ParticipantIndex::eraseEntry(size_t pos)
+    {
+        uint32_t index = slots_[pos].index_ - 1;
+        removeSlot(pos);
+
+        uint32_t last = static_cast<uint32_t>(entries_.size() - 1);
+        if(index != last)
+        {
+            slots_[findSlotOfIndex(last)].index_ = index + 1;
+            entries_[index] = std::move(entries_[last]);
+        }
+        entries_.pop_back();
+    }
+
+    void ParticipantIndex::growSlots(size_t count)
+    {
+        if(count * 2 > slots_.size())
+        {
+            rehash(std::bit_ceil(std::max<size_t>(count * 2, 16)));
+        }
+    }
+
+    void ParticipantIndex::rehash(size_t slotCount)
+    {
+        slots_.assign(slotCount, Slot{0, 0});
+        for(size_t i = 0; i < entries_.size(); ++ i)
+        {
+            insertSlot(static_cast<uint32_t>(i), entries_[i].hash_);
+        }
+    }
+
+    void ParticipantIndex::fold(Entry &entry)
+    {
+        std::string folded = entry.nickname_.str();
+        for(char &ch: folded)
+        {
+            ch = static_cast<char>((*foldTable_)[static_cast<uint8_t>(ch)]);
+        }
+        entry.folded_ = folded == entry.nickname_.str() ? entry.nickname_ : pool_.intern(folded);
+        entry.hash_ = hash(entry.nickname_);
+    }
+
+    ParticipantIndex::Entry ParticipantIndex::makeEntry(Participant participant)
+    {
+        Entry entry;
+        static_cast<Participant &>(entry) = std::move(participant);
+        fold(entry);
+        return entry;
+    }
+}
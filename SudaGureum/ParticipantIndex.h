@@ -0,0 +1,104 @@
+﻿#pragma once
+
+#include "Comparator.h"
+#include "InternedString.h"
+
+namespace SudaGureum
+{
+    // Participants of a channel, looked up by nickname under the server's case mapping.
+    // Each nickname is folded and hashed once when it is stored; folded keys are interned in the pool of
+    // the network, so a nickname already in lower case shares its entry. Participants live in one contiguous vector,
+    // with their mode bits inline, and an open-addressing table of (index, hash) slots points into it;
+    // a lookup folds the query on the fly and never allocates.
+    // Erasing moves the last participant into the hole, so the order of iteration is unspecified.
+    class ParticipantIndex
+    {
+    public:
+        struct Participant
+        {
+            static constexpr size_t MaxModes = 8;
+
+            std::bitset<MaxModes> modes_; // bit i: the membership mode ranked i + 1 by PREFIX, so bit 0 is the highest
+            InternedString nickname_; // change with ParticipantIndex::rename only
+            bool away_;
+
+            Participant()
+                : away_(false)
+            {
+            }
+
+            explicit Participant(InternedString nickname)
+                : nickname_(std::move(nickname))
+                , away_(false)
+            {
+            }
+        };
+
+        struct Entry : Participant
+        {
+            InternedString folded_;
+            uint32_t hash_;
+        };
+
+        typedef std::vector<Entry>::const_iterator const_iterator;
+
+    private:
+        struct Slot
+        {
+            uint32_t index_; // index into entries_ + 1; 0 if empty
+            uint32_t hash_;
+        };
+
+        static constexpr size_t NoSlot = std::numeric_limits<size_t>::max();
+
+    public:
+        explicit ParticipantIndex(InternPool pool = InternPool(), CaseMapping caseMapping = CaseMapping::Rfc1459);
+
+    public:
+        CaseMapping caseMapping() const;
+        void setCaseMapping(CaseMapping caseMapping); // refolds every nickname
+
+        size_t size() const;
+        bool empty() const;
+        const_iterator begin() const;
+        const_iterator end() const;
+
+        void clear();
+        void reserve(size_t count);
+
+        Participant *find(std::string_view nickname);
+        const Participant *find(std::string_view nickname) const;
+
+        // Returns false, leaving the existing one as it is, if the nickname is already there.
+        bool insert(Participant participant);
+
+        // Loads a whole NAMES reply at once; the table grows at most once.
+        // Unlike insert, an existing participant takes the modes of the new one.
+        void bulkInsert(std::span<const Participant> participants);
+
+        bool erase(std::string_view nickname);
+
+        // Returns false if there is no such participant, or another one already has the new nickname.
+        bool rename(std::string_view nickname, InternedString newNickname);
+
+    private:
+        uint32_t hash(std::string_view nickname) const;
+        bool equals(std::string_view folded, std::string_view nickname) const;
+        size_t findSlot(std::string_view nickname, uint32_t hash) const;
+        size_t findSlotOfIndex(uint32_t index) const;
+        void insertSlot(uint32_t index, uint32_t hash);
+        void removeSlot(size_t pos);
+        void eraseEntry(size_t pos);
+        void growSlots(size_t count);
+        void rehash(size_t slotCount);
+        void fold(Entry &entry); // fills folded_ and hash_ from nickname_
+        Entry makeEntry(Participant participant);
+
+    private:
+        InternPool pool_;
+        CaseMapping caseMapping_;
+        const std::array<uint8_t, 256> *foldTable_;
+        std::vector<Entry> entries_;
+        std::vector<Slot> slots_; // power of 2 in size, at most half full
+    };
+}
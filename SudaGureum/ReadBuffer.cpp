@@ -0,0 +1,78 @@
+﻿#include "Common.h"
+
+#include "ReadBuffer.h"
+
+#include "Configure.h"
+#include "Default.h"
+
+namespace SudaGureum
+{
+    ReadBuffer::ReadBuffer()
+        : ReadBuffer(
+            Configure::instance().getAs("socket_read_buffer_min_size", DefaultConfigureValue::SocketReadBufferMinSize),
+            Configure::instance().getAs("socket_read_buffer_max_size", DefaultConfigureValue::SocketReadBufferMaxSize),
+            Configure::instance().getAs("socket_read_wait_readable", DefaultConfigureValue::SocketReadWaitReadable))
+    {
+    }
+
+    ReadBuffer::ReadBuffer(size_t minSize, size_t maxSize, bool waitReadable)
+        : minSize_(std::max<size_t>(minSize, 1))
+        , maxSize_(std::max(maxSize, minSize_))
+        , size_(minSize_)
+        , waitReadable_(waitReadable)
+        , smallReads_(0)
+    {
+    }
+
+    bool ReadBuffer::waitReadable() const
+    {
+        return waitReadable_;
+    }
+
+    size_t ReadBuffer::size() const
+    {
+        return size_;
+    }
+
+    asio::mutable_buffers_1 ReadBuffer::prepare()
+    {
+        if(buffer_.size() != size_ || buffer_.shared()) // what the last commit returned may still be held
+        {
+            buffer_ = IoBuffer(size_);
+            buffer_.resize(size_);
+        }
+        return asio::mutable_buffers_1(buffer_.data(), buffer_.size());
+    }
+
+    IoBuffer ReadBuffer::commit(size_t bytesTransferred)
+    {
+        IoBuffer received = buffer_.slice(0, bytesTransferred);
+
+        if(bytesTransferred == size_ && size_ < maxSize_) // likely more waiting; read more at once
+        {
+            size_ = std::min(size_ * 4, maxSize_); // next size class
+            smallReads_ = 0;
+            buffer_ = IoBuffer();
+        }
+        else if(bytesTransferred <= size_ / 4 && size_ > minSize_)
+        {
+            if(++ smallReads_ == ShrinkAfterReads)
+            {
+                size_ = std::max(size_ / 4, minSize_);
+                smallReads_ = 0;
+                buffer_ = IoBuffer();
+            }
+        }
+        else
+        {
+            smallReads_ = 0;
+        }
+
+        if(waitReadable_)
+        {
+            buffer_ = IoBuffer(); // back to the freelist once the data is processed
+        }
+
+        return received;
+    }
+}
@@ -0,0 +1,39 @@
+﻿#pragma once
+
+#include "IoBuffer.h"
+
+namespace SudaGureum
+{
+    // Read buffer of a connection, sized by its traffic instead of for the worst case. It starts small, moves up a size
+    // class when a read fills it and back down after a run of reads that use little of it. In the wait-readable mode the
+    // connection drops it before waiting for the socket to become readable and takes it again for the read, so an idle
+    // connection holds no buffer; the storage then comes from the IoBuffer freelists shared by the thread.
+    class ReadBuffer
+    {
+    private:
+        static constexpr size_t ShrinkAfterReads = 16; // in a row, each using a quarter of the buffer or less
+
+    private:
+        ReadBuffer(const ReadBuffer &) = delete;
+        ReadBuffer &operator =(const ReadBuffer &) = delete;
+
+    public:
+        ReadBuffer(); // configured by socket_read_buffer_*
+        ReadBuffer(size_t minSize, size_t maxSize, bool waitReadable);
+
+    public:
+        bool waitReadable() const; // wait with SocketBase::asyncWaitReadable before each read
+        size_t size() const; // of the next read
+
+        asio::mutable_buffers_1 prepare(); // storage for the next read, taken from the freelists if dropped
+        IoBuffer commit(size_t bytesTransferred); // what the read got; kept intact for as long as it is held
+
+    private:
+        size_t minSize_;
+        size_t maxSize_;
+        size_t size_;
+        bool waitReadable_;
+        size_t smallReads_;
+        IoBuffer buffer_;
+    };
+}
@@ -0,0 +1,205 @@
+﻿#include "Common.h"
+
+#include "Resolver.h"
+
+#include "Socket.h"
+
+namespace SudaGureum
+{
+    ResolverCache::ResolverCache(asio::io_service &ios, std::chrono::seconds ttl)
+        : ios_(ios)
+        , ttl_(ttl)
+    {
+    }
+
+    void ResolverCache::asyncResolve(const std::string &host, uint16_t port, Handler handler)
+    {
+        std::string service = fmt::format_int(port).str();
+        std::string key = host + ':' + service;
+
+        std::lock_guard<std::mutex> lock(entriesLock_);
+        Entry &entry = entries_[key];
+        if(!entry.waiters_.empty())
+        {
+            entry.waiters_.push_back(std::move(handler));
+            return;
+        }
+
+        if(!entry.endPoints_.empty() && std::chrono::steady_clock::now() < entry.expiry_)
+        {
+            asio::post(ios_, std::bind(std::move(handler), std::error_code(), entry.endPoints_));
+            return;
+        }
+
+        entry.waiters_.push_back(std::move(handler));
+
+        auto resolver = std::make_shared<asio::ip::tcp::resolver>(ios_);
+        resolver->async_resolve(host, service,
+            std::bind(&ResolverCache::handleResolve, this, key, resolver, std::placeholders::_1, std::placeholders::_2));
+    }
+
+    void ResolverCache::handleResolve(const std::string &key, const std::shared_ptr<asio::ip::tcp::resolver> &resolver,
+        const std::error_code &ec, const asio::ip::tcp::resolver::results_type &results)
+    {
+        EndPoints endPoints;
+        std::vector<Handler> waiters;
+        {
+            std::lock_guard<std::mutex> lock(entriesLock_);
+            auto it = entries_.find(key);
+            if(it == entries_.end())
+            {
+                return;
+            }
+
+            waiters.swap(it->second.waiters_);
+            if(ec || results.empty())
+            {
+                entries_.erase(it); // no negative caching
+            }
+            else
+            {
+                for(const auto &result: results)
+                {
+                    endPoints.push_back(result.endpoint());
+                }
+                it->second.endPoints_ = endPoints;
+                it->second.expiry_ = std::chrono::steady_clock::now() + ttl_;
+            }
+        }
+
+        std::error_code resultEc = ec;
+        if(!resultEc && endPoints.empty())
+        {
+            resultEc = asio::error::host_not_found;
+        }
+        for(auto &waiter: waiters)
+        {
+            waiter(resultEc, endPoints);
+        }
+    }
+
+    void EndPointRacer::start(asio::io_service &ios, const ResolverCache::EndPoints &endPoints,
+        std::chrono::milliseconds stagger, SocketFactory socketFactory, Handler handler)
+    {
+        if(endPoints.empty())
+        {
+            asio::post(ios, std::bind(std::move(handler), asio::error::host_not_found, nullptr));
+            return;
+        }
+
+        // interleave address families, keeping the resolver's order within each family
+        ResolverCache::EndPoints first, second;
+        bool firstIsV6 = endPoints.front().address().is_v6();
+        for(const auto &endPoint: endPoints)
+        {
+            (endPoint.address().is_v6() == firstIsV6 ? first : second).push_back(endPoint);
+        }
+
+        ResolverCache::EndPoints ordered;
+        ordered.reserve(endPoints.size());
+        for(size_t i = 0; i < first.size() || i < second.size(); ++ i)
+        {
+            if(i < first.size())
+                ordered.push_back(first[i]);
+            if(i < second.size())
+                ordered.push_back(second[i]);
+        }
+
+        auto racer = std::make_shared<EndPointRacer>(ios, std::move(ordered), stagger, std::move(socketFactory), std::move(handler));
+        std::lock_guard<std::mutex> lock(racer->attemptsLock_);
+        racer->launch();
+    }
+
+    EndPointRacer::EndPointRacer(asio::io_service &ios, ResolverCache::EndPoints endPoints,
+        std::chrono::milliseconds stagger, SocketFactory socketFactory, Handler handler)
+        : endPoints_(std::move(endPoints))
+        , stagger_(stagger)
+        , socketFactory_(std::move(socketFactory))
+        , handler_(std::move(handler))
+        , attempts_(endPoints_.size())
+        , next_(0)
+        , pending_(0)
+        , done_(false)
+        , staggerTimer_(ios)
+        , staggerGeneration_(0)
+    {
+    }
+
+    void EndPointRacer::launch()
+    {
+        size_t index = next_ ++;
+        ++ pending_;
+        attempts_[index] = socketFactory_();
+        // the handler owns the attempt too: a loser reset by handleConnect may still have its TLS handshake in flight
+        attempts_[index]->asyncConnect(endPoints_[index],
+            [self = shared_from_this(), index, attempt = attempts_[index]](const std::error_code &ec)
+            {
+                self->handleConnect(index, ec);
+            });
+
+        if(next_ < endPoints_.size())
+        {
+            staggerTimer_.expires_from_now(stagger_);
+            staggerTimer_.async_wait(
+                std::bind(&EndPointRacer::handleStagger, shared_from_this(), ++ staggerGeneration_, std::placeholders::_1));
+        }
+    }
+
+    void EndPointRacer::handleConnect(size_t index, const std::error_code &ec)
+    {
+        std::shared_ptr<SocketBase> winner;
+        {
+            std::lock_guard<std::mutex> lock(attemptsLock_);
+            -- pending_;
+            if(done_)
+            {
+                return; // lost the race; already closed
+            }
+
+            if(!ec)
+            {
+                done_ = true;
+                winner = std::move(attempts_[index]);
+                for(auto &attempt: attempts_)
+                {
+                    if(attempt)
+                    {
+                        attempt->close();
+                        attempt.reset();
+                    }
+                }
+                ++ staggerGeneration_;
+                staggerTimer_.cancel();
+            }
+            else
+            {
+                lastError_ = ec;
+                attempts_[index]->close();
+                attempts_[index].reset();
+
+                if(next_ < endPoints_.size())
+                {
+                    launch(); // do not wait for the stagger interval
+                    return;
+                }
+                if(pending_ > 0)
+                {
+                    return;
+                }
+                done_ = true;
+            }
+        }
+
+        handler_(winner ? std::error_code() : lastError_, std::move(winner));
+    }
+
+    void EndPointRacer::handleStagger(size_t generation, const std::error_code &ec)
+    {
+        std::lock_guard<std::mutex> lock(attemptsLock_);
+        if(ec || done_ || generation != staggerGeneration_ || next_ >= endPoints_.size())
+        {
+            return;
+        }
+        launch();
+    }
+}
@@ -0,0 +1,87 @@
+﻿#pragma once
+
+namespace SudaGureum
+{
+    class SocketBase;
+
+    // Asynchronous host name resolution with a small TTL cache.
+    // Concurrent lookups of the same host and port share a single resolver query.
+    class ResolverCache
+    {
+    public:
+        typedef std::vector<asio::ip::tcp::endpoint> EndPoints;
+        typedef std::function<void (const std::error_code &, const EndPoints &)> Handler;
+
+    private:
+        struct Entry
+        {
+            EndPoints endPoints_;
+            std::chrono::steady_clock::time_point expiry_;
+            std::vector<Handler> waiters_; // non-empty while resolving
+        };
+
+    private:
+        ResolverCache(const ResolverCache &) = delete;
+        ResolverCache &operator =(const ResolverCache &) = delete;
+
+    public:
+        ResolverCache(asio::io_service &ios, std::chrono::seconds ttl);
+
+    public:
+        // handler is always called asynchronously, on a thread running ios.
+        void asyncResolve(const std::string &host, uint16_t port, Handler handler);
+
+    private:
+        void handleResolve(const std::string &key, const std::shared_ptr<asio::ip::tcp::resolver> &resolver,
+            const std::error_code &ec, const asio::ip::tcp::resolver::results_type &results);
+
+    private:
+        asio::io_service &ios_;
+        std::chrono::seconds ttl_;
+        std::mutex entriesLock_;
+        std::unordered_map<std::string, Entry> entries_;
+    };
+
+    // Races connection attempts over resolved end points (Happy Eyeballs, RFC 8305).
+    // Address families are interleaved, starting with the first resolved one, and a new attempt is started
+    // every stagger interval or as soon as the previous attempt fails. The first established socket wins
+    // and the others are closed.
+    class EndPointRacer : public std::enable_shared_from_this<EndPointRacer>
+    {
+    public:
+        typedef std::function<std::shared_ptr<SocketBase> ()> SocketFactory;
+        typedef std::function<void (const std::error_code &, std::shared_ptr<SocketBase>)> Handler;
+
+    public:
+        static void start(asio::io_service &ios, const ResolverCache::EndPoints &endPoints,
+            std::chrono::milliseconds stagger, SocketFactory socketFactory, Handler handler);
+
+    private:
+        EndPointRacer(const EndPointRacer &) = delete;
+        EndPointRacer &operator =(const EndPointRacer &) = delete;
+
+    public:
+        EndPointRacer(asio::io_service &ios, ResolverCache::EndPoints endPoints,
+            std::chrono::milliseconds stagger, SocketFactory socketFactory, Handler handler);
+
+    private:
+        void launch(); // entered with attemptsLock_ held
+        void handleConnect(size_t index, const std::error_code &ec);
+        void handleStagger(size_t generation, const std::error_code &ec);
+
+    private:
+        ResolverCache::EndPoints endPoints_;
+        std::chrono::milliseconds stagger_;
+        SocketFactory socketFactory_;
+        Handler handler_;
+
+        std::mutex attemptsLock_;
+        std::vector<std::shared_ptr<SocketBase>> attempts_; // indexed as endPoints_
+        size_t next_;
+        size_t pending_;
+        bool done_;
+        std::error_code lastError_;
+        asio::basic_waitable_timer<std::chrono::steady_clock> staggerTimer_;
+        size_t staggerGeneration_;
+    };
+}
@@ -0,0 +1,184 @@
+﻿#include "Common.h"
+
+#include "ServerCapabilities.h"
+
+namespace SudaGureum
+{
+    namespace
+    {
+        const std::string_view DefaultChannelModes = "beI,k,l,imnpst";
+        const std::string_view DefaultPrefix = "(ov)@+";
+        const std::string_view DefaultChannelTypes = "#&";
+
+        size_t parseNumber(std::string_view value, size_t defaultValue)
+        {
+            size_t number = 0;
+            auto result = std::from_chars(value.data(), value.data() + value.size(), number);
+            if(result.ec != std::errc() || result.ptr != value.data() + value.size())
+                return defaultValue;
+            return number;
+        }
+    }
+
+    ServerCapabilities::ServerCapabilities()
+        : channelModeTypes_()
+        , prefixModes_()
+        , prefixRanks_()
+        , channelTypes_()
+        , caseMapping_(CaseMapping::Rfc1459)
+        , nicknameLength_(0)
+        , maxTargets_(0)
+        , lineLength_(DefaultLineLength)
+        , chatHistoryLimit_(0)
+    {
+        setPrefix(DefaultPrefix);
+        setChannelModes(DefaultChannelModes);
+        setChannelTypes(DefaultChannelTypes);
+    }
+
+    void ServerCapabilities::apply(std::string_view token)
+    {
+        bool negated = !token.empty() && token[0] == '-';
+        if(negated)
+        {
+            token.remove_prefix(1);
+        }
+
+        size_t equalPos = token.find('=');
+        std::string_view name = token.substr(0, equalPos);
+        std::string_view value = equalPos == std::string_view::npos ? std::string_view() : token.substr(equalPos + 1);
+
+        if(name == "CHANMODES")
+        {
+            setChannelModes(negated ? DefaultChannelModes : value);
+        }
+        else if(name == "PREFIX")
+        {
+            setPrefix(negated ? DefaultPrefix : value);
+        }
+        else if(name == "CHANTYPES")
+        {
+            setChannelTypes(negated ? DefaultChannelTypes : value);
+        }
+        else if(name == "CASEMAPPING")
+        {
+            caseMapping_ = negated ? CaseMapping::Rfc1459 : caseMappingFromName(value).value_or(caseMapping_);
+        }
+        else if(name == "NICKLEN")
+        {
+            nicknameLength_ = negated ? 0 : parseNumber(value, 0);
+        }
+        else if(name == "MAXTARGETS")
+        {
+            maxTargets_ = negated ? 0 : parseNumber(value, 0);
+        }
+        else if(name == "TARGMAX")
+        {
+            setTargetMax(negated ? std::string_view() : value);
+        }
+        else if(name == "LINELEN")
+        {
+            lineLength_ = negated ? DefaultLineLength : std::max(parseNumber(value, DefaultLineLength), DefaultLineLength);
+        }
+        else if(name == "CHATHISTORY")
+        {
+            chatHistoryLimit_ = negated ? 0 : parseNumber(value, 0);
+        }
+    }
+
+    bool ServerCapabilities::isValidNickname(std::string_view nickname) const
+    {
+        if(nickname.empty() || (nicknameLength_ != 0 && nickname.size() > nicknameLength_))
+            return false;
+
+        // neither a channel nor a prefixed name, and no separators of the protocol
+        char first = nickname[0];
+        if(isChannel(nickname) || prefixMode(first) != 0 || first == ':' || (first >= '0' && first <= '9') || first == '-')
+            return false;
+        return nickname.find_first_of(" ,*?!@") == std::string_view::npos;
+    }
+
+    size_t ServerCapabilities::maxTargets(std::string_view command) const
+    {
+        auto it = targetMax_.find(command);
+        return it != targetMax_.end() ? it->second : maxTargets_;
+    }
+
+    // COMMAND:[limit],...; a command without a limit takes any number of targets.
+    void ServerCapabilities::setTargetMax(std::string_view value)
+    {
+        targetMax_.clear();
+
+        while(!value.empty())
+        {
+            std::string_view entry = value.substr(0, value.find(','));
+            value.remove_prefix(std::min(value.size(), entry.size() + 1));
+
+            size_t colonPos = entry.find(':');
+            if(colonPos == 0 || colonPos == std::string_view::npos)
+                continue;
+            targetMax_[std::string(entry.substr(0, colonPos))] = parseNumber(entry.substr(colonPos + 1), 0);
+        }
+    }
+
+    // A,B,C,D[,...]; groups past the fourth are ignored.
+    void ServerCapabilities::setChannelModes(std::string_view value)
+    {
+        static constexpr ModeType Types[] = {ModeType::A, ModeType::B, ModeType::C, ModeType::D};
+
+        channelModeTypes_ = {};
+
+        size_t group = 0;
+        for(char ch: value)
+        {
+            if(ch == ',')
+            {
+                if(++ group == std::size(Types))
+                    break;
+                continue;
+            }
+
+            uint8_t index = static_cast<uint8_t>(ch);
+            if(index < 128)
+                channelModeTypes_[index] = Types[group];
+        }
+    }
+
+    // (modes)symbols, highest first; empty if no membership prefixes.
+    void ServerCapabilities::setPrefix(std::string_view value)
+    {
+        prefixModes_ = {};
+        prefixRanks_ = {};
+
+        size_t closePos = value.find(')');
+        if(value.size() < 2 || value[0] != '(' || closePos == std::string_view::npos)
+            return;
+
+        std::string_view modes = value.substr(1, closePos - 1);
+        std::string_view symbols = value.substr(closePos + 1);
+        if(modes.size() != symbols.size() || modes.size() > std::numeric_limits<uint8_t>::max())
+            return;
+
+        for(size_t i = 0; i < modes.size(); ++ i)
+        {
+            uint8_t mode = static_cast<uint8_t>(modes[i]);
+            uint8_t symbol = static_cast<uint8_t>(symbols[i]);
+            if(mode >= 128 || symbol >= 128)
+                continue;
+
+            prefixModes_[symbol] = modes[i];
+            prefixRanks_[mode] = static_cast<uint8_t>(i + 1);
+        }
+    }
+
+    void ServerCapabilities::setChannelTypes(std::string_view value)
+    {
+        channelTypes_ = {};
+        for(char ch: value)
+        {
+            uint8_t index = static_cast<uint8_t>(ch);
+            if(index < 128)
+                channelTypes_[index] = true;
+        }
+    }
+}
@@ -0,0 +1,86 @@
+﻿#pragma once
+
+#include "Comparator.h"
+
+namespace SudaGureum
+{
+    // ISUPPORT (005) tokens compiled into typed fields.
+    // Modes and prefixes are kept in 128-entry tables indexed by ASCII character, so MODE parsing and target
+    // checks cost one lookup per character; anything outside ASCII is never a mode, prefix or channel type.
+    class ServerCapabilities
+    {
+    public:
+        enum class ModeType : uint8_t
+        {
+            None, // not advertised; assumed to take no parameter
+            A, // list; always takes a parameter
+            B, // always takes a parameter
+            C, // takes a parameter only when set
+            D, // never takes a parameter
+            Prefix // membership prefix; takes a nickname
+        };
+
+        static constexpr size_t DefaultLineLength = 512; // including CR-LF
+
+    public:
+        ServerCapabilities(); // RFC 1459 defaults, until RPL_ISUPPORT says otherwise
+
+    public:
+        // One token of RPL_ISUPPORT: NAME, NAME=VALUE or -NAME; unknown ones are ignored.
+        void apply(std::string_view token);
+
+    public:
+        ModeType channelModeType(char mode) const
+        {
+            uint8_t index = static_cast<uint8_t>(mode);
+            if(index >= 128)
+                return ModeType::None;
+            return prefixRanks_[index] != 0 ? ModeType::Prefix : channelModeTypes_[index];
+        }
+
+        // Mode character of a membership prefix symbol ('@' -> 'o'); 0 if not a prefix.
+        char prefixMode(char symbol) const
+        {
+            uint8_t index = static_cast<uint8_t>(symbol);
+            return index < 128 ? prefixModes_[index] : 0;
+        }
+
+        // 1 for the highest membership mode; 0 if not a membership mode.
+        uint8_t prefixRank(char mode) const
+        {
+            uint8_t index = static_cast<uint8_t>(mode);
+            return index < 128 ? prefixRanks_[index] : 0;
+        }
+
+        bool isChannel(std::string_view name) const
+        {
+            return !name.empty() && static_cast<uint8_t>(name[0]) < 128 && channelTypes_[static_cast<uint8_t>(name[0])];
+        }
+
+        bool isValidNickname(std::string_view nickname) const;
+
+        CaseMapping caseMapping() const { return caseMapping_; }
+        size_t nicknameLength() const { return nicknameLength_; } // 0 if not limited
+        size_t maxTargets(std::string_view command) const; // TARGMAX of command, or else MAXTARGETS; 0 if not limited
+        size_t lineLength() const { return lineLength_; }
+        size_t chatHistoryLimit() const { return chatHistoryLimit_; } // 0 if not limited
+
+    private:
+        void setChannelModes(std::string_view value);
+        void setPrefix(std::string_view value);
+        void setChannelTypes(std::string_view value);
+        void setTargetMax(std::string_view value);
+
+    private:
+        std::array<ModeType, 128> channelModeTypes_; // from CHANMODES; membership modes take precedence
+        std::array<char, 128> prefixModes_; // by symbol
+        std::array<uint8_t, 128> prefixRanks_; // by mode
+        std::array<bool, 128> channelTypes_;
+        CaseMapping caseMapping_;
+        size_t nicknameLength_;
+        size_t maxTargets_; // from MAXTARGETS
+        std::map<std::string, size_t, LessCaseInsensitive> targetMax_; // from TARGMAX by command; 0 if not limited
+        size_t lineLength_;
+        size_t chatHistoryLimit_;
+    };
+}
@@ -0,0 +1,127 @@
+﻿#include "Common.h"
+
+#include "Snapshot.h"
+
+namespace SudaGureum
+{
+    template<typename T>
+    void SnapshotWriter::writeInteger(T value)
+    {
+        T little = boost::endian::native_to_little(value);
+        data_.append(reinterpret_cast<const char *>(&little), sizeof(little));
+    }
+
+    void SnapshotWriter::writeUInt8(uint8_t value)
+    {
+        data_ += static_cast<char>(value);
+    }
+
+    void SnapshotWriter::writeUInt16(uint16_t value)
+    {
+        writeInteger(value);
+    }
+
+    void SnapshotWriter::writeUInt32(uint32_t value)
+    {
+        writeInteger(value);
+    }
+
+    void SnapshotWriter::writeInt64(int64_t value)
+    {
+        writeInteger(value);
+    }
+
+    void SnapshotWriter::writeBool(bool value)
+    {
+        writeUInt8(value ? 1 : 0);
+    }
+
+    void SnapshotWriter::writeString(std::string_view value)
+    {
+        writeUInt32(static_cast<uint32_t>(value.size()));
+        data_.append(value);
+    }
+
+    void SnapshotWriter::writeTime(std::chrono::system_clock::time_point value)
+    {
+        writeInt64(std::chrono::duration_cast<std::chrono::milliseconds>(value.time_since_epoch()).count());
+    }
+
+    const std::string &SnapshotWriter::data() const
+    {
+        return data_;
+    }
+
+    std::string SnapshotWriter::release()
+    {
+        return std::move(data_);
+    }
+
+    SnapshotReader::SnapshotReader(std::string_view data)
+        : data_(data)
+    {
+    }
+
+    template<typename T>
+    T SnapshotReader::readInteger()
+    {
+        if(data_.size() < sizeof(T))
+        {
+            throw(std::runtime_error("snapshot is truncated"));
+        }
+
+        T little;
+        std::memcpy(&little, data_.data(), sizeof(little));
+        data_.remove_prefix(sizeof(little));
+        return boost::endian::little_to_native(little);
+    }
+
+    uint8_t SnapshotReader::readUInt8()
+    {
+        return readInteger<uint8_t>();
+    }
+
+    uint16_t SnapshotReader::readUInt16()
+    {
+        return readInteger<uint16_t>();
+    }
+
+    uint32_t SnapshotReader::readUInt32()
+    {
+        return readInteger<uint32_t>();
+    }
+
+    int64_t SnapshotReader::readInt64()
+    {
+        return readInteger<int64_t>();
+    }
+
+    bool SnapshotReader::readBool()
+    {
+        return readUInt8() != 0;
+    }
+
+    std::string SnapshotReader::readString()
+    {
+        uint32_t size = readUInt32();
+        if(data_.size() < size)
+        {
+            throw(std::runtime_error("snapshot is truncated"));
+        }
+
+        std::string value(data_.substr(0, size));
+        data_.remove_prefix(size);
+        return value;
+    }
+
+    std::chrono::system_clock::time_point SnapshotReader::readTime()
+    {
+        return std::chrono::system_clock::time_point(
+            std::chrono::duration_cast<std::chrono::system_clock::duration>(std::chrono::milliseconds(readInt64())));
+    }
+
+    bool SnapshotReader::atEnd() const
+    {
+        return data_.empty();
+    }
+}
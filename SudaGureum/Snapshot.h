@@ -0,0 +1,55 @@
+﻿#pragma once
+
+namespace SudaGureum
+{
+    // Flat binary encoding of state handed over to another process; fixed-width little-endian integers and
+    // length-prefixed strings, with no padding.
+    class SnapshotWriter
+    {
+    public:
+        void writeUInt8(uint8_t value);
+        void writeUInt16(uint16_t value);
+        void writeUInt32(uint32_t value);
+        void writeInt64(int64_t value);
+        void writeBool(bool value);
+        void writeString(std::string_view value);
+        void writeTime(std::chrono::system_clock::time_point value); // milliseconds since the epoch
+
+    public:
+        const std::string &data() const;
+        std::string release();
+
+    private:
+        template<typename T>
+        void writeInteger(T value);
+
+    private:
+        std::string data_;
+    };
+
+    // Throws std::runtime_error if the data ends in the middle of a value.
+    class SnapshotReader
+    {
+    public:
+        explicit SnapshotReader(std::string_view data);
+
+    public:
+        uint8_t readUInt8();
+        uint16_t readUInt16();
+        uint32_t readUInt32();
+        int64_t readInt64();
+        bool readBool();
+        std::string readString();
+        std::chrono::system_clock::time_point readTime();
+
+    public:
+        bool atEnd() const;
+
+    private:
+        template<typename T>
+        T readInteger();
+
+    private:
+        std::string_view data_; // not read yet
+    };
+}
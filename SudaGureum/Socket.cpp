@@ -1,4 +1,4 @@
-#include "Common.h"
+﻿#include "Common.h"
 
 #include "Socket.h"
 
@@ -9,6 +9,27 @@ namespace SudaGureum
     {
     }
 
+    TcpSocket::TcpSocket(asio::io_service &ios, const asio::ip::tcp &protocol,
+        asio::ip::tcp::socket::native_handle_type nativeSocket)
+        : socket_(ios, protocol, nativeSocket)
+    {
+    }
+
+    SocketKind TcpSocket::kind() const
+    {
+        return SocketKind::Tcp;
+    }
+
+    asio::awaitable<size_t> TcpSocket::readSome(asio::mutable_buffers_1 buffer, std::error_code &ec)
+    {
+        co_return co_await socket_.async_read_some(buffer, asio::redirect_error(asio::use_awaitable, ec));
+    }
+
+    asio::awaitable<void> TcpSocket::waitReadable(std::error_code &ec)
+    {
+        co_await socket_.async_wait(asio::ip::tcp::socket::wait_read, asio::redirect_error(asio::use_awaitable, ec));
+    }
+
     void TcpSocket::asyncHandshakeAsServer(std::function<void (const std::error_code &)> handler)
     {
         throw(std::logic_error("asyncHandshakeAsServer is not implemented in TcpSocket"));
@@ -20,6 +41,11 @@ namespace SudaGureum
         socket_.async_read_some(buffer, std::move(handler));
     }
 
+    void TcpSocket::asyncWaitReadable(std::function<void (const std::error_code &)> handler)
+    {
+        socket_.async_wait(asio::ip::tcp::socket::wait_read, std::move(handler));
+    }
+
     void TcpSocket::asyncWrite(const asio::const_buffers_1 &buffer,
         std::function<void (const std::error_code &, size_t)> handler)
     {
@@ -32,12 +58,24 @@ namespace SudaGureum
         asio::async_write(socket_, buffer, std::move(handler));
     }
 
+    void TcpSocket::asyncWrite(const std::vector<asio::const_buffer> &buffers,
+        std::function<void (const std::error_code &, size_t)> handler)
+    {
+        asio::async_write(socket_, buffers, std::move(handler));
+    }
+
     void TcpSocket::asyncConnect(asio::ip::tcp::resolver::iterator endPointIt,
         std::function<void (const std::error_code &, asio::ip::tcp::resolver::iterator)> handler)
     {
         asio::async_connect(socket_, std::move(endPointIt), std::move(handler));
     }
 
+    void TcpSocket::asyncConnect(const asio::ip::tcp::endpoint &endPoint,
+        std::function<void (const std::error_code &)> handler)
+    {
+        socket_.async_connect(endPoint, std::move(handler));
+    }
+
     std::error_code TcpSocket::close()
     {
         std::error_code ec;
@@ -62,6 +100,22 @@ namespace SudaGureum
     {
     }
 
+    SocketKind TcpSslSocket::kind() const
+    {
+        return SocketKind::TcpSsl;
+    }
+
+    asio::awaitable<size_t> TcpSslSocket::readSome(asio::mutable_buffers_1 buffer, std::error_code &ec)
+    {
+        co_return co_await stream_.async_read_some(buffer, asio::redirect_error(asio::use_awaitable, ec));
+    }
+
+    asio::awaitable<void> TcpSslSocket::waitReadable(std::error_code &ec)
+    {
+        ec.clear(); // see asyncWaitReadable
+        co_return;
+    }
+
     void TcpSslSocket::asyncHandshakeAsServer(std::function<void (const std::error_code &)> handler)
     {
         stream_.async_handshake(asio::ssl::stream_base::server, handler);
@@ -73,6 +127,13 @@ namespace SudaGureum
         stream_.async_read_some(buffer, std::move(handler));
     }
 
+    void TcpSslSocket::asyncWaitReadable(std::function<void (const std::error_code &)> handler)
+    {
+        // The stream may already hold received records, which a wait on the TCP socket would not see;
+        // the read that follows holds its buffer until data arrives.
+        asio::post(stream_.get_executor(), std::bind(std::move(handler), std::error_code()));
+    }
+
     void TcpSslSocket::asyncWrite(const asio::const_buffers_1 &buffer,
         std::function<void (const std::error_code &, size_t)> handler)
     {
@@ -85,6 +146,12 @@ namespace SudaGureum
         asio::async_write(stream_, buffer, std::move(handler));
     }
 
+    void TcpSslSocket::asyncWrite(const std::vector<asio::const_buffer> &buffers,
+        std::function<void (const std::error_code &, size_t)> handler)
+    {
+        asio::async_write(stream_, buffers, std::move(handler));
+    }
+
     void TcpSslSocket::asyncConnect(asio::ip::tcp::resolver::iterator endPointIt,
         std::function<void (const std::error_code &, asio::ip::tcp::resolver::iterator)> handler)
     {
@@ -102,6 +169,20 @@ namespace SudaGureum
         );
     }
 
+    void TcpSslSocket::asyncConnect(const asio::ip::tcp::endpoint &endPoint,
+        std::function<void (const std::error_code &)> handler)
+    {
+        stream_.lowest_layer().async_connect(endPoint,
+            [this, handler](const std::error_code &ec)
+            {
+                if(ec)
+                    handler(ec);
+                else
+                    stream_.async_handshake(asio::ssl::stream_base::client, handler);
+            }
+        );
+    }
+
     asio::ssl::stream<asio::ip::tcp::socket>::lowest_layer_type &TcpSslSocket::socket()
     {
         return stream_.lowest_layer();
@@ -1,71 +1,150 @@
 ﻿#pragma once
 
 #include "AsioHelper.h"
+#include "HandlerAllocator.h"
+#include "IoBuffer.h"
 
 namespace SudaGureum
 {
+    enum class SocketKind : uint8_t
+    {
+        Tcp,
+        TcpSsl,
+        BufferedTcp,
+        BufferedTcpSsl
+    };
+
+    // The virtual operations take type-erased handlers. The concrete sockets also have templated ...Direct operations
+    // that store the handler in the asio operation as it is and allocate the operation from memory of the socket
+    // (see HandlerMemory); reach them through visitSocket.
+    // readSome and waitReadable are the awaitable forms for coroutines started with asio::co_spawn; like the handlers,
+    // they report errors through ec instead of throwing.
     class SocketBase
     {
     public:
+        virtual SocketKind kind() const = 0;
+        virtual asio::awaitable<size_t> readSome(asio::mutable_buffers_1 buffer, std::error_code &ec) = 0;
+        virtual asio::awaitable<void> waitReadable(std::error_code &ec) = 0;
         virtual void asyncHandshakeAsServer(std::function<void (const std::error_code &)> handler) = 0;
         virtual void asyncReadSome(const asio::mutable_buffers_1 &buffer,
             std::function<void (const std::error_code &, size_t)> handler) = 0;
+        virtual void asyncWaitReadable(std::function<void (const std::error_code &)> handler) = 0; // no buffer is held
         virtual void asyncWrite(const asio::const_buffers_1 &buffer,
             std::function<void (const std::error_code &, size_t)> handler) = 0;
         virtual void asyncWrite(const asio::mutable_buffers_1 &buffer,
             std::function<void (const std::error_code &, size_t)> handler) = 0;
+        virtual void asyncWrite(const std::vector<asio::const_buffer> &buffers, // gathered into as few writes as possible
+            std::function<void (const std::error_code &, size_t)> handler) = 0;
         virtual void asyncConnect(asio::ip::tcp::resolver::iterator endPointIt,
             std::function<void (const std::error_code &, asio::ip::tcp::resolver::iterator)> handler) = 0;
+        virtual void asyncConnect(const asio::ip::tcp::endpoint &endPoint,
+            std::function<void (const std::error_code &)> handler) = 0;
         virtual std::error_code close() = 0;
     };
 
     class TcpSocket : public SocketBase
     {
+    public:
+        static constexpr bool WaitsReadable = true;
+
     public:
         TcpSocket(asio::io_service &ios);
+        TcpSocket(asio::io_service &ios, const asio::ip::tcp &protocol,
+            asio::ip::tcp::socket::native_handle_type nativeSocket); // adopts a connected socket
 
     public:
+        virtual SocketKind kind() const;
+        virtual asio::awaitable<size_t> readSome(asio::mutable_buffers_1 buffer, std::error_code &ec);
+        virtual asio::awaitable<void> waitReadable(std::error_code &ec);
         virtual void asyncHandshakeAsServer(std::function<void (const std::error_code &)> handler);
         virtual void asyncReadSome(const asio::mutable_buffers_1 &buffer,
             std::function<void (const std::error_code &, size_t)> handler);
+        virtual void asyncWaitReadable(std::function<void (const std::error_code &)> handler);
         virtual void asyncWrite(const asio::const_buffers_1 &buffer,
             std::function<void (const std::error_code &, size_t)> handler);
         virtual void asyncWrite(const asio::mutable_buffers_1 &buffer,
             std::function<void (const std::error_code &, size_t)> handler);
+        virtual void asyncWrite(const std::vector<asio::const_buffer> &buffers,
+            std::function<void (const std::error_code &, size_t)> handler);
         virtual void asyncConnect(asio::ip::tcp::resolver::iterator endPointIt,
             std::function<void (const std::error_code &, asio::ip::tcp::resolver::iterator)> handler);
+        virtual void asyncConnect(const asio::ip::tcp::endpoint &endPoint,
+            std::function<void (const std::error_code &)> handler);
         virtual std::error_code close();
 
+    public:
+        template<typename Handler>
+        void asyncReadSomeDirect(const asio::mutable_buffers_1 &buffer, Handler &&handler)
+        {
+            socket_.async_read_some(buffer, makeAllocHandler(memory_, AsyncOp::Read, std::forward<Handler>(handler)));
+        }
+        template<typename Handler>
+        void asyncWaitReadableDirect(Handler &&handler)
+        {
+            socket_.async_wait(asio::ip::tcp::socket::wait_read,
+                makeAllocHandler(memory_, AsyncOp::Wait, std::forward<Handler>(handler)));
+        }
+        template<typename ConstBufferSequence, typename Handler>
+        void asyncWriteDirect(const ConstBufferSequence &buffers, Handler &&handler)
+        {
+            asio::async_write(socket_, buffers, makeAllocHandler(memory_, AsyncOp::Write, std::forward<Handler>(handler)));
+        }
+
     public:
         asio::ip::tcp::socket &socket();
 
     private:
+        HandlerMemory memory_; // for the ...Direct operations, whose handlers must keep this socket alive
         asio::ip::tcp::socket socket_;
     };
 
     class TcpSslSocket : public SocketBase
     {
+    public:
+        static constexpr bool WaitsReadable = false; // see asyncWaitReadable
+
     public:
         TcpSslSocket(asio::io_service &ios);
         TcpSslSocket(asio::io_service &ios, std::shared_ptr<asio::ssl::context> context);
 
     public:
+        virtual SocketKind kind() const;
+        virtual asio::awaitable<size_t> readSome(asio::mutable_buffers_1 buffer, std::error_code &ec);
+        virtual asio::awaitable<void> waitReadable(std::error_code &ec); // completes at once
         virtual void asyncHandshakeAsServer(std::function<void (const std::error_code &)> handler);
         virtual void asyncReadSome(const asio::mutable_buffers_1 &buffer,
             std::function<void (const std::error_code &, size_t)> handler);
+        virtual void asyncWaitReadable(std::function<void (const std::error_code &)> handler); // completes at once
         virtual void asyncWrite(const asio::const_buffers_1 &buffer,
             std::function<void (const std::error_code &, size_t)> handler);
         virtual void asyncWrite(const asio::mutable_buffers_1 &buffer,
             std::function<void (const std::error_code &, size_t)> handler);
+        virtual void asyncWrite(const std::vector<asio::const_buffer> &buffers, // one TLS record per buffer, still in one operation
+            std::function<void (const std::error_code &, size_t)> handler);
         virtual void asyncConnect(asio::ip::tcp::resolver::iterator endPointIt,
             std::function<void (const std::error_code &, asio::ip::tcp::resolver::iterator)> handler);
+        virtual void asyncConnect(const asio::ip::tcp::endpoint &endPoint,
+            std::function<void (const std::error_code &)> handler);
         virtual std::error_code close();
 
+    public:
+        template<typename Handler>
+        void asyncReadSomeDirect(const asio::mutable_buffers_1 &buffer, Handler &&handler)
+        {
+            stream_.async_read_some(buffer, makeAllocHandler(memory_, AsyncOp::Read, std::forward<Handler>(handler)));
+        }
+        template<typename ConstBufferSequence, typename Handler>
+        void asyncWriteDirect(const ConstBufferSequence &buffers, Handler &&handler)
+        {
+            asio::async_write(stream_, buffers, makeAllocHandler(memory_, AsyncOp::Write, std::forward<Handler>(handler)));
+        }
+
     public:
         asio::ssl::stream<asio::ip::tcp::socket>::lowest_layer_type &socket();
 
     private:
         std::shared_ptr<asio::ssl::context> ctx_;
+        HandlerMemory memory_;
         asio::ssl::stream<asio::ip::tcp::socket> stream_;
     };
 
@@ -74,22 +153,55 @@ namespace SudaGureum
     public:
         using SocketBase::asyncWrite;
 
-        virtual void asyncWrite(std::vector<uint8_t> data,
+        virtual void asyncWrite(IoChain data,
             std::function<void (const std::error_code &, size_t)> handler) = 0;
     };
 
     template<typename Socket>
     class BufferedWriterSocket : public BufferedWriterSocketBase, public std::enable_shared_from_this<BufferedWriterSocket<Socket>>
     {
+    public:
+        static constexpr bool WaitsReadable = Socket::WaitsReadable;
+
+    private:
+        struct Frame
+        {
+            IoChain data_;
+            std::function<void (const std::error_code &, size_t)> handler_;
+            Frame *next_; // the one pushed before
+        };
+
     public:
         template<typename ...Args>
         BufferedWriterSocket(asio::io_service &ios, Args &&...args)
             : socket_(ios, std::forward<Args>(args)...)
+            , pending_(nullptr)
             , inWrite_(false)
         {
         }
 
+        ~BufferedWriterSocket()
+        {
+            for(Frame *frame = pending_.exchange(nullptr); frame != nullptr; )
+            {
+                std::unique_ptr<Frame> owned(frame);
+                frame = frame->next_;
+            }
+        }
+
     public:
+        virtual SocketKind kind() const
+        {
+            return std::is_same_v<Socket, TcpSslSocket> ? SocketKind::BufferedTcpSsl : SocketKind::BufferedTcp;
+        }
+        virtual asio::awaitable<size_t> readSome(asio::mutable_buffers_1 buffer, std::error_code &ec)
+        {
+            return socket_.readSome(buffer, ec);
+        }
+        virtual asio::awaitable<void> waitReadable(std::error_code &ec)
+        {
+            return socket_.waitReadable(ec);
+        }
         virtual void asyncHandshakeAsServer(std::function<void (const std::error_code &)> handler)
         {
             socket_.asyncHandshakeAsServer(std::move(handler));
@@ -99,6 +211,10 @@ namespace SudaGureum
         {
             socket_.asyncReadSome(buffer, std::move(handler));
         }
+        virtual void asyncWaitReadable(std::function<void (const std::error_code &)> handler)
+        {
+            socket_.asyncWaitReadable(std::move(handler));
+        }
         virtual void asyncWrite(const asio::const_buffers_1 &buffer,
             std::function<void (const std::error_code &, size_t)> handler)
         {
@@ -109,24 +225,47 @@ namespace SudaGureum
         {
             socket_.asyncWrite(buffer, std::move(handler));
         }
+        virtual void asyncWrite(const std::vector<asio::const_buffer> &buffers,
+            std::function<void (const std::error_code &, size_t)> handler)
+        {
+            socket_.asyncWrite(buffers, std::move(handler));
+        }
         virtual void asyncConnect(asio::ip::tcp::resolver::iterator endPointIt,
             std::function<void (const std::error_code &, asio::ip::tcp::resolver::iterator)> handler)
         {
             socket_.asyncConnect(endPointIt, std::move(handler));
         }
+        virtual void asyncConnect(const asio::ip::tcp::endpoint &endPoint,
+            std::function<void (const std::error_code &)> handler)
+        {
+            socket_.asyncConnect(endPoint, std::move(handler));
+        }
         virtual std::error_code close()
         {
             return socket_.close();
         }
 
-        virtual void asyncWrite(std::vector<uint8_t> data,
+        // Thread-safe and lock-free; frames are written in the order they are given.
+        virtual void asyncWrite(IoChain data,
             std::function<void (const std::error_code &, size_t)> handler)
         {
+            Frame *frame = new Frame{std::move(data), std::move(handler), pending_.load()};
+            while(!pending_.compare_exchange_weak(frame->next_, frame))
             {
-                std::lock_guard<std::mutex> lock(bufferWriteLock_);
-                bufferToWrite_.emplace_back(std::move(data), std::move(handler));
             }
-            asyncWrite();
+            flush();
+        }
+
+    public:
+        template<typename Handler>
+        void asyncReadSomeDirect(const asio::mutable_buffers_1 &buffer, Handler &&handler)
+        {
+            socket_.asyncReadSomeDirect(buffer, std::forward<Handler>(handler));
+        }
+        template<typename Handler>
+        void asyncWaitReadableDirect(Handler &&handler)
+        {
+            socket_.asyncWaitReadableDirect(std::forward<Handler>(handler));
         }
 
     public:
@@ -136,71 +275,133 @@ namespace SudaGureum
         }
 
     private:
-        void asyncWrite()
+        // Whoever turns inWrite_ on takes every pending frame and writes them with one gather write.
+        void flush()
         {
-            std::lock_guard<std::mutex> lock(writeLock_); // do I really need this?
-
-            if(inWrite_.exchange(true))
+            for(;;)
             {
-                return;
-            }
+                if(inWrite_.exchange(true))
+                {
+                    return;
+                }
 
-            try
-            {
-                std::vector<uint8_t> *frame = nullptr;
-                if(!bufferToWrite_.empty())
+                Frame *frames = pending_.exchange(nullptr);
+                if(frames != nullptr)
                 {
-                    frame = &bufferToWrite_.front().first;
+                    write(frames);
+                    return;
                 }
 
-                if(frame && !frame->empty())
+                inWrite_ = false;
+                if(pending_.load() == nullptr) // otherwise pushed after the exchange, by one that saw inWrite_ on
                 {
-                    socket_.asyncWrite(
-                        asio::buffer(*frame, frame->size()),
-                        std::bind(
-                            std::mem_fn(&BufferedWriterSocket::handleWrite),
-                            this->shared_from_this(),
-                            StdAsioPlaceholders::error,
-                            StdAsioPlaceholders::bytesTransferred));
+                    return;
                 }
-                else
+            }
+        }
+
+        void write(Frame *frames) // newest first
+        {
+            for(Frame *frame = frames; frame != nullptr; frame = frame->next_)
+            {
+                inFlight_.emplace_back(frame);
+            }
+            std::reverse(inFlight_.begin(), inFlight_.end());
+
+            for(const auto &frame: inFlight_)
+            {
+                for(const IoBuffer &buffer: frame->data_.buffers())
                 {
-                    inWrite_ = false;
+                    buffersToWrite_.push_back(buffer.buffer());
                 }
             }
+
+            if(buffersToWrite_.empty())
+            {
+                handleWrite(std::error_code(), 0);
+                return;
+            }
+
+            try
+            {
+                socket_.asyncWriteDirect(buffersToWrite_,
+                    std::bind(
+                        std::mem_fn(&BufferedWriterSocket::handleWrite),
+                        this->shared_from_this(),
+                        StdAsioPlaceholders::error,
+                        StdAsioPlaceholders::bytesTransferred));
+            }
             catch(...)
             {
+                inFlight_.clear();
+                buffersToWrite_.clear();
                 inWrite_ = false;
                 throw;
             }
         }
 
-        void handleWrite(const std::error_code &ec, size_t bytesTransferred)
+        // Every frame of the write completes together, each with its own size.
+        void handleWrite(const std::error_code &ec, size_t /*bytesTransferred*/)
         {
-            auto handler = std::move(bufferToWrite_.front().second);
+            std::vector<std::unique_ptr<Frame>> written;
+            written.swap(inFlight_);
+            buffersToWrite_.clear();
+            inWrite_ = false;
 
+            for(auto &frame: written)
             {
-                std::lock_guard<std::mutex> lock(bufferWriteLock_);
-                assert(!bufferToWrite_.empty());
-                bufferToWrite_.pop_front();
+                frame->handler_(ec, ec ? 0 : frame->data_.size());
             }
 
-            inWrite_ = false;
-
-            handler(ec, bytesTransferred);
-
             if(!ec)
             {
-                asyncWrite();
+                flush();
             }
         }
 
     private:
         Socket socket_;
-        std::mutex bufferWriteLock_;
-        std::deque<std::pair<
-            std::vector<uint8_t>, std::function<void (const std::error_code &, size_t)>>> bufferToWrite_;
-        std::mutex writeLock_;
+        std::atomic<Frame *> pending_; // intrusive stack, newest first; pushed by any thread
         std::atomic<bool> inWrite_;
+        std::vector<std::unique_ptr<Frame>> inFlight_; // oldest first; owned by the writer while inWrite_ is on
+        std::vector<asio::const_buffer> buffersToWrite_;
     };
+
+    // Calls fn with the socket as its concrete type, e.g. a generic lambda using the ...Direct operations.
+    // fn is instantiated for every type the overload handles.
+    template<typename Fn>
+    void visitSocket(SocketBase &socket, Fn &&fn) // TcpSocket or TcpSslSocket
+    {
+        switch(socket.kind())
+        {
+        case SocketKind::Tcp:
+            fn(static_cast<TcpSocket &>(socket));
+            break;
+
+        case SocketKind::TcpSsl:
+            fn(static_cast<TcpSslSocket &>(socket));
+            break;
+
+        default:
+            throw(std::logic_error("visitSocket: BufferedWriterSocket given as SocketBase"));
+        }
+    }
+
+    template<typename Fn>
+    void visitSocket(BufferedWriterSocketBase &socket, Fn &&fn)
+    {
+        switch(socket.kind())
+        {
+        case SocketKind::BufferedTcp:
+            fn(static_cast<BufferedWriterSocket<TcpSocket> &>(socket));
+            break;
+
+        case SocketKind::BufferedTcpSsl:
+            fn(static_cast<BufferedWriterSocket<TcpSslSocket> &>(socket));
+            break;
+
+        default:
+            throw(std::logic_error("visitSocket: unknown BufferedWriterSocket"));
+        }
+    }
 }
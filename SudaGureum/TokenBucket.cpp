@@ -0,0 +1,61 @@
+﻿#include "Common.h"
+
+#include "TokenBucket.h"
+
+namespace SudaGureum
+{
+    TokenBucket::TokenBucket(double burst, double ratePerSec)
+        : burst_(std::max(burst, 1.0))
+        , rate_(ratePerSec)
+        , tokens_(burst_)
+        , lastRefill_(Clock::now())
+    {
+    }
+
+    bool TokenBucket::unlimited() const
+    {
+        return rate_ <= 0.0;
+    }
+
+    bool TokenBucket::tryConsume(double tokens, Clock::time_point now)
+    {
+        if(unlimited())
+            return true;
+
+        refill(now);
+        if(tokens_ < tokens)
+            return false;
+        tokens_ -= tokens;
+        return true;
+    }
+
+    void TokenBucket::consume(double tokens, Clock::time_point now)
+    {
+        if(unlimited())
+            return;
+
+        refill(now);
+        tokens_ -= tokens;
+    }
+
+    TokenBucket::Clock::duration TokenBucket::timeUntilAvailable(double tokens, Clock::time_point now)
+    {
+        if(unlimited())
+            return Clock::duration::zero();
+
+        refill(now);
+        if(tokens_ >= tokens)
+            return Clock::duration::zero();
+        return std::chrono::ceil<Clock::duration>(std::chrono::duration<double>((tokens - tokens_) / rate_));
+    }
+
+    void TokenBucket::refill(Clock::time_point now)
+    {
+        if(now <= lastRefill_)
+            return;
+
+        std::chrono::duration<double> elapsed = now - lastRefill_;
+        tokens_ = std::min(burst_, tokens_ + elapsed.count() * rate_);
+        lastRefill_ = now;
+    }
+}
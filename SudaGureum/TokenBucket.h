@@ -0,0 +1,34 @@
+﻿#pragma once
+
+namespace SudaGureum
+{
+    // Token bucket rate limiter; not thread-safe.
+    // A rate of 0 or less disables limiting.
+    class TokenBucket
+    {
+    public:
+        typedef std::chrono::steady_clock Clock;
+
+    public:
+        TokenBucket(double burst, double ratePerSec);
+
+    public:
+        bool unlimited() const;
+
+        // Takes tokens if available.
+        bool tryConsume(double tokens = 1.0, Clock::time_point now = Clock::now());
+        // Takes tokens unconditionally; the bucket may go into debt.
+        void consume(double tokens = 1.0, Clock::time_point now = Clock::now());
+        // Time to wait before tryConsume(tokens) would succeed.
+        Clock::duration timeUntilAvailable(double tokens = 1.0, Clock::time_point now = Clock::now());
+
+    private:
+        void refill(Clock::time_point now);
+
+    private:
+        double burst_;
+        double rate_;
+        double tokens_;
+        Clock::time_point lastRefill_;
+    };
+}
@@ -0,0 +1,194 @@
+﻿#include "Common.h"
+
+#include "TrafficTap.h"
+
+#include "Configure.h"
+#include "Default.h"
+#include "Log.h"
+
+namespace SudaGureum
+{
+    TrafficTap::TrafficTap(std::string name, size_t capacity, size_t sampleRate)
+        : name_(std::move(name))
+        , sampleRate_(sampleRate)
+        , mask_(std::bit_ceil(std::max<size_t>(capacity, 2)) - 1)
+        , slots_(new Slot[mask_ + 1])
+        , enqueuePos_(0)
+        , sampleCounter_(0)
+        , dropped_(0)
+        , dequeuePos_(0)
+    {
+        for(size_t i = 0; i <= mask_; ++ i)
+        {
+            slots_[i].sequence_.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    const std::string &TrafficTap::name() const
+    {
+        return name_;
+    }
+
+    size_t TrafficTap::dropped() const
+    {
+        return dropped_.load(std::memory_order_relaxed);
+    }
+
+    bool TrafficTap::record(Direction direction, std::string_view data)
+    {
+        if(sampleRate_ > 1 && sampleCounter_.fetch_add(1, std::memory_order_relaxed) % sampleRate_ != 0)
+            return false;
+
+        // bounded MPMC queue by Dmitry Vyukov, used with a single consumer
+        Slot *slot;
+        size_t pos = enqueuePos_.load(std::memory_order_relaxed);
+        for(;;)
+        {
+            slot = &slots_[pos & mask_];
+            size_t sequence = slot->sequence_.load(std::memory_order_acquire);
+            intptr_t diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(pos);
+            if(diff == 0)
+            {
+                if(enqueuePos_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed))
+                    break;
+            }
+            else if(diff < 0) // full
+            {
+                dropped_.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+            else
+            {
+                pos = enqueuePos_.load(std::memory_order_relaxed);
+            }
+        }
+
+        slot->record_.direction_ = direction;
+        slot->record_.time_ = std::chrono::system_clock::now();
+        slot->record_.data_.assign(data);
+        slot->sequence_.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    TrafficTapWriter::TrafficTapWriter()
+        : enabled_(Configure::instance().getAs("irc_traffic_tap", DefaultConfigureValue::IrcTrafficTap))
+        , capacity_(Configure::instance().getAs("irc_traffic_tap_capacity", DefaultConfigureValue::IrcTrafficTapCapacity))
+        , sampleRate_(Configure::instance().getAs("irc_traffic_tap_sample_rate", DefaultConfigureValue::IrcTrafficTapSampleRate))
+        , flushInterval_(Configure::instance().getAs("irc_traffic_tap_flush_interval_ms", DefaultConfigureValue::IrcTrafficTapFlushIntervalMs))
+        , stop_(false)
+    {
+        if(!enabled_)
+            return;
+
+        path_ = Configure::instance().get("log_path").value_or(DefaultConfigureValue::LogPath);
+        path_ /= "Traffic";
+        std::error_code ec;
+        if(!std::filesystem::create_directories(path_, ec) && ec)
+        {
+            Log::instance().warn("TrafficTapWriter: cannot create traffic directory, disabled: {}", ec.message());
+            enabled_ = false;
+            return;
+        }
+
+        thread_ = std::thread(std::bind(&TrafficTapWriter::run, this));
+    }
+
+    TrafficTapWriter::~TrafficTapWriter()
+    {
+        if(thread_.joinable())
+        {
+            {
+                std::lock_guard<std::mutex> lock(stopLock_);
+                stop_ = true;
+            }
+            stopCond_.notify_one();
+            thread_.join();
+        }
+    }
+
+    bool TrafficTapWriter::enabled() const
+    {
+        return enabled_;
+    }
+
+    std::shared_ptr<TrafficTap> TrafficTapWriter::create(std::string name)
+    {
+        if(!enabled_)
+            return nullptr;
+
+        auto tap = std::make_shared<TrafficTap>(std::move(name), capacity_, sampleRate_);
+        std::lock_guard<std::mutex> lock(tapsLock_);
+        taps_.push_back(tap);
+        return tap;
+    }
+
+    void TrafficTapWriter::run()
+    {
+        std::unique_lock<std::mutex> lock(stopLock_);
+        while(!stop_)
+        {
+            stopCond_.wait_for(lock, flushInterval_, [this]() { return stop_; });
+            lock.unlock();
+            flush();
+            lock.lock();
+        }
+    }
+
+    void TrafficTapWriter::flush()
+    {
+        std::vector<std::shared_ptr<TrafficTap>> taps;
+        {
+            std::lock_guard<std::mutex> lock(tapsLock_);
+            taps = taps_;
+        }
+
+        for(auto &tap: taps)
+        {
+            flush(*tap);
+        }
+        taps.clear();
+
+        // taps only referenced from here have no producers left; drain the tail and close them
+        std::lock_guard<std::mutex> lock(tapsLock_);
+        std::erase_if(taps_, [this](const std::shared_ptr<TrafficTap> &tap)
+        {
+            if(tap.use_count() > 1)
+                return false;
+            flush(*tap);
+            if(tap->dropped() > 0)
+                Log::instance().warn("TrafficTapWriter: {} records of {} were dropped", tap->dropped(), tap->name_);
+            return true;
+        });
+    }
+
+    void TrafficTapWriter::flush(TrafficTap &tap)
+    {
+        if(!tap.file_.is_open())
+        {
+            tap.file_.open(path_ / (tap.name_ + ".log"), std::ios::binary | std::ios::app);
+            if(!tap.file_)
+            {
+                Log::instance().warn("TrafficTapWriter: cannot open traffic file of {}", tap.name_);
+                tap.drain([](const TrafficTap::Record &) {});
+                return;
+            }
+        }
+
+        std::string out;
+        tap.drain([&out](const TrafficTap::Record &record)
+        {
+            auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(record.time_.time_since_epoch()).count();
+            out += std::format("{}.{:03} {} ", ms / 1000, ms % 1000,
+                record.direction_ == TrafficTap::Direction::Inbound ? "<<<" : ">>>");
+            out += record.data_;
+            if(record.data_.empty() || record.data_.back() != '\n')
+                out += '\n';
+        });
+
+        if(!out.empty())
+        {
+            tap.file_.write(out.data(), static_cast<std::streamsize>(out.size()));
+            tap.file_.flush();
+        }
+    }
+}
@@ -0,0 +1,117 @@
+﻿#pragma once
+
+#include "Singleton.h"
+
+namespace SudaGureum
+{
+    // Per-connection raw traffic recorder.
+    // Producers (I/O handlers) push wire bytes into a bounded lock-free ring; records are dropped, never waited for, when it is full.
+    // Only TrafficTapWriter consumes the ring, and all formatting happens there.
+    class TrafficTap
+    {
+    public:
+        enum class Direction : uint8_t
+        {
+            Inbound,
+            Outbound
+        };
+
+        struct Record
+        {
+            Direction direction_;
+            std::chrono::system_clock::time_point time_;
+            std::string data_;
+        };
+
+    private:
+        struct Slot
+        {
+            std::atomic<size_t> sequence_;
+            Record record_; // buffer is reused when the slot wraps around
+        };
+
+    private:
+        TrafficTap(const TrafficTap &) = delete;
+        TrafficTap &operator =(const TrafficTap &) = delete;
+
+    public:
+        TrafficTap(std::string name, size_t capacity, size_t sampleRate); // capacity is rounded up to a power of 2
+
+    public:
+        const std::string &name() const;
+        size_t dropped() const;
+
+        // Thread-safe and lock-free; returns false if the record is not sampled or the ring is full.
+        bool record(Direction direction, std::string_view data);
+
+        // Single consumer only; fn is called with each record in place.
+        template<typename Func>
+        size_t drain(Func &&fn)
+        {
+            size_t count = 0;
+            for(;;)
+            {
+                Slot &slot = slots_[dequeuePos_ & mask_];
+                size_t sequence = slot.sequence_.load(std::memory_order_acquire);
+                if(sequence != dequeuePos_ + 1)
+                    break;
+
+                fn(static_cast<const Record &>(slot.record_));
+                slot.sequence_.store(dequeuePos_ + mask_ + 1, std::memory_order_release);
+                ++ dequeuePos_;
+                ++ count;
+            }
+            return count;
+        }
+
+    private:
+        std::string name_;
+        size_t sampleRate_;
+        size_t mask_;
+        std::unique_ptr<Slot[]> slots_;
+        std::atomic<size_t> enqueuePos_;
+        std::atomic<size_t> sampleCounter_;
+        std::atomic<size_t> dropped_;
+        size_t dequeuePos_;
+
+        std::ofstream file_; // touched by TrafficTapWriter only
+
+        friend class TrafficTapWriter;
+    };
+
+    // Owns all taps and periodically flushes them into "<log_path>/Traffic/<name>.log" on its own thread.
+    class TrafficTapWriter : public Singleton<TrafficTapWriter>
+    {
+    private:
+        TrafficTapWriter();
+        ~TrafficTapWriter();
+
+    public:
+        bool enabled() const;
+
+        // Returns nullptr if the traffic tap is disabled.
+        std::shared_ptr<TrafficTap> create(std::string name);
+
+    private:
+        void run();
+        void flush();
+        void flush(TrafficTap &tap);
+
+    private:
+        bool enabled_;
+        size_t capacity_;
+        size_t sampleRate_;
+        std::chrono::milliseconds flushInterval_;
+        std::filesystem::path path_;
+
+        std::mutex tapsLock_;
+        std::vector<std::shared_ptr<TrafficTap>> taps_;
+
+        std::mutex stopLock_;
+        std::condition_variable stopCond_;
+        bool stop_;
+        std::thread thread_;
+
+        friend class Singleton<TrafficTapWriter>;
+    };
+}
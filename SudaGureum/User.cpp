@@ -46,7 +46,7 @@ namespace SudaGureum
         auto modifier = [this](Server &info)
         {
             info.ircClient_ = ircClientPool_.connect(info.host_, info.port_, info.encoding_,
-                info.nicknames_, info.ssl_,
+                info.nicknames_, info.ssl_, info.caps_, info.sasl_,
                 std::bind(&User::onIrcClientCreate, this, std::placeholders::_1));
         };
 
@@ -90,9 +90,11 @@ namespace SudaGureum
         ircClient.onServerMessage += bindEvent(&User::onIrcClientServerMessage);
         ircClient.onJoinChannel += bindEvent(&User::onIrcClientJoinChannel);
         ircClient.onPartChannel += bindEvent(&User::onIrcClientPartChannel);
+        ircClient.onChannelSynchronized += bindEvent(&User::onIrcClientChannelSynchronized);
         ircClient.onChannelMessage += bindEvent(&User::onIrcClientChannelMessage);
         ircClient.onChannelNotice += bindEvent(&User::onIrcClientChannelNotice);
         ircClient.onPersonalMessage += bindEvent(&User::onIrcClientPersonalMessage);
+        ircClient.onHistoryBatch += bindEvent(&User::onIrcClientHistoryBatch);
     }
 
     void User::onIrcClientConnect(std::weak_ptr<IrcClient> ircClient)
@@ -130,6 +132,10 @@ namespace SudaGureum
     {
     }
 
+    void User::onIrcClientChannelSynchronized(const IrcClient::ChannelSynchronizedArgs &args)
+    {
+    }
+
     void User::onIrcClientChannelMessage(const IrcClient::ChannelMessageArgs &args)
     {
     }
@@ -142,6 +148,23 @@ namespace SudaGureum
     {
     }
 
+    void User::onIrcClientHistoryBatch(const IrcClient::HistoryBatchArgs &args)
+    {
+        auto ircClientLock = args.ircClient_.lock();
+        if(!ircClientLock)
+        {
+            return;
+        }
+
+        auto info = serverInfo(ircClientLock.get());
+        if(info == nullptr)
+        {
+            return;
+        }
+
+        archive_.insert(info->name_, args.target_.str(), args.lines_);
+    }
+
     UserContext::UserContext()
     {
     }
@@ -189,7 +212,19 @@ namespace SudaGureum
 
     void Users::load(IrcClientPool &ircClientPool)
     {
-        // TODO: temporary; load from db
+        std::vector<UserEntry> entries = UserDB::instance().fetchUserEntries();
+        if(!entries.empty())
+        {
+            for(const UserEntry &entry: entries)
+            {
+                std::shared_ptr<User> user(new User(entry, ircClientPool));
+                user->connectToServers();
+                userMap_.emplace(entry.userId_, std::move(user));
+            }
+            return;
+        }
+
+        // TODO: temporary; until users are added to the db
 
         UserServerInfo info = {"Ozinger", "irc.ozinger.org", 16666, "UTF-8", {"SudaGureum1", "SudaGureum2"}, true, {"#HNO3"}};
         std::shared_ptr<User> user(new User(
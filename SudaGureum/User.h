@@ -15,6 +15,8 @@ namespace SudaGureum
         std::vector<std::string> nicknames_;
         bool ssl_;
         std::vector<std::string> channels_;
+        std::vector<std::string> caps_; // among IrcClient::SupportedCaps; all of them if empty
+        IrcClient::Sasl sasl_;
     };
 
     typedef boost::multi_index_container<
@@ -76,9 +78,11 @@ namespace SudaGureum
         void onIrcClientServerMessage(const IrcClient::ServerMessageArgs &args);
         void onIrcClientJoinChannel(const IrcClient::JoinChannelArgs &args);
         void onIrcClientPartChannel(const IrcClient::PartChannelArgs &args);
+        void onIrcClientChannelSynchronized(const IrcClient::ChannelSynchronizedArgs &args);
         void onIrcClientChannelMessage(const IrcClient::ChannelMessageArgs &args);
         void onIrcClientChannelNotice(const IrcClient::ChannelMessageArgs &args);
         void onIrcClientPersonalMessage(const IrcClient::PersonalMessageArgs &args);
+        void onIrcClientHistoryBatch(const IrcClient::HistoryBatchArgs &args);
 
     private:
         std::string userId_;
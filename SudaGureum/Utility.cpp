@@ -170,6 +170,81 @@ namespace SudaGureum
         return generateHttpDateTime(std::chrono::system_clock::to_time_t(time));
     }
 
+    std::optional<std::chrono::system_clock::time_point> parseIsoDateTime(std::string_view str)
+    {
+        size_t pos = 0;
+        auto number = [&str, &pos](size_t digits, char delimiter) -> std::optional<int>
+        {
+            if(pos + digits + 1 > str.size() || str[pos + digits] != delimiter)
+                return std::nullopt;
+
+            int value = 0;
+            for(size_t i = 0; i < digits; ++ i)
+            {
+                char ch = str[pos + i];
+                if(ch < '0' || ch > '9')
+                    return std::nullopt;
+                value = value * 10 + (ch - '0');
+            }
+            pos += digits + 1;
+            return value;
+        };
+
+        auto year = number(4, '-');
+        auto month = number(2, '-');
+        auto day = number(2, 'T');
+        auto hour = number(2, ':');
+        auto minute = number(2, ':');
+        if(!year || !month || !day || !hour || !minute || pos + 3 > str.size())
+            return std::nullopt;
+
+        std::optional<int> second;
+        std::chrono::milliseconds fraction(0);
+        if(str[pos + 2] == '.')
+        {
+            second = number(2, '.');
+            if(!second)
+                return std::nullopt;
+
+            // up to milliseconds; further digits are ignored
+            size_t digits = 0;
+            int value = 0;
+            for(; pos < str.size() && str[pos] >= '0' && str[pos] <= '9'; ++ pos, ++ digits)
+            {
+                if(digits < 3)
+                    value = value * 10 + (str[pos] - '0');
+            }
+            if(digits == 0)
+                return std::nullopt;
+            for(; digits < 3; ++ digits)
+            {
+                value *= 10;
+            }
+            fraction = std::chrono::milliseconds(value);
+            if(pos + 1 != str.size() || str[pos] != 'Z')
+                return std::nullopt;
+        }
+        else
+        {
+            second = number(2, 'Z');
+            if(!second || pos != str.size())
+                return std::nullopt;
+        }
+
+        std::chrono::year_month_day date{std::chrono::year(year.value()),
+            std::chrono::month(static_cast<unsigned>(month.value())), std::chrono::day(static_cast<unsigned>(day.value()))};
+        if(!date.ok() || hour.value() > 23 || minute.value() > 59 || second.value() > 60)
+            return std::nullopt;
+
+        return std::chrono::sys_days(date) + std::chrono::hours(hour.value()) + std::chrono::minutes(minute.value())
+            + std::chrono::seconds(second.value()) + fraction;
+    }
+
+    std::string generateIsoDateTime(const std::chrono::system_clock::time_point &time)
+    {
+        return std::format("{:%FT%T}Z", std::chrono::floor<std::chrono::milliseconds>(time));
+    }
+
     std::array<uint8_t, 20> hashSha1(const std::vector<uint8_t> &data)
     {
         std::array<uint8_t, 20> result;
@@ -45,7 +45,7 @@ namespace SudaGureum
         static_assert(std::is_same<ConstIterT, ConstEndIterT>::value, "type of cbegin(Range) and cend(Range) is not same");
 
         std::string encoded(ToBase64Iterator<ConstIterT>(std::ranges::cbegin(data)), ToBase64Iterator<ConstIterT>(std::ranges::cend(data)));
-        size_t padLen = (3 - encoded.size() % 3) % 3;
+        size_t padLen = (4 - encoded.size() % 4) % 4;
         encoded.append(padLen, '=');
         return encoded;
     }
@@ -57,6 +57,10 @@ namespace SudaGureum
     std::string generateHttpDateTime(time_t time);
     std::string generateHttpDateTime(const std::chrono::system_clock::time_point &time);
 
+    // YYYY-MM-DDThh:mm:ss[.sss]Z in UTC, as in IRCv3 server-time
+    std::optional<std::chrono::system_clock::time_point> parseIsoDateTime(std::string_view str);
+    std::string generateIsoDateTime(const std::chrono::system_clock::time_point &time);
+
     std::array<uint8_t, 20> hashSha1(const std::vector<uint8_t> &data);
     std::string hashSha1ToHexString(const std::vector<uint8_t> &data);
 
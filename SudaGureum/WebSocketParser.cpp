@@ -38,7 +38,7 @@ namespace SudaGureum
     {
     }
 
-    WebSocketResponse::WebSocketResponse(Command command, std::vector<uint8_t> rawData)
+    WebSocketResponse::WebSocketResponse(Command command, IoBuffer rawData)
         : command_(command)
         , rawData_(std::move(rawData))
     {
@@ -95,7 +95,7 @@ namespace SudaGureum
     {
     }
 
-    bool WebSocketParser::parse(const std::vector<uint8_t> &data,
+    bool WebSocketParser::parse(const IoBuffer &data,
         std::function<void (const WebSocketRequest &)> wscb,
         std::function<void (const SudaGureumRequest &)> sgcb)
     {
@@ -104,7 +104,7 @@ namespace SudaGureum
             return false;
         }
 
-        for(uint8_t ch: data)
+        for(uint8_t ch: data.span())
         {
             switch(state_)
             {
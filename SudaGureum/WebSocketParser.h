@@ -1,5 +1,6 @@
 ﻿#pragma once
 
+#include "IoBuffer.h"
 #include "Utility.h"
 
 namespace SudaGureum
@@ -45,11 +46,11 @@ namespace SudaGureum
         };
 
         Command command_;
-        std::vector<uint8_t> rawData_;
+        IoBuffer rawData_; // shared, not copied, into the frame
 
         WebSocketResponse();
         explicit WebSocketResponse(Command command);
-        WebSocketResponse(Command command, std::vector<uint8_t> rawData);
+        WebSocketResponse(Command command, IoBuffer rawData);
 
         WebSocketFrameOpcode opcode() const;
     };
@@ -94,7 +95,7 @@ namespace SudaGureum
         WebSocketParser();
 
     public:
-        bool parse(const std::vector<uint8_t> &data,
+        bool parse(const IoBuffer &data,
             std::function<void (const WebSocketRequest &)> wscb,
             std::function<void (const SudaGureumRequest &)> sgcb);
 
@@ -13,45 +13,60 @@ namespace SudaGureum
 {
     namespace
     {
-        std::vector<uint8_t> encodeFrame(WebSocketFrameOpcode opcode, const std::vector<uint8_t> &data)
+        IoChain encodeFrame(WebSocketFrameOpcode opcode, const IoBuffer &data)
         {
             // Don't use fragmented frame
+            // The payload is not copied; the frame is the header followed by the shared payload.
 
-            std::vector<uint8_t> frame;
-            frame.push_back(0x80 | static_cast<uint8_t>(opcode)); // final segment (1), reserved * 3 (000), opcode (XXXX)
+            IoBuffer header(IoBuffer::SizeClasses.front());
+            header.push_back(static_cast<char>(0x80 | static_cast<uint8_t>(opcode))); // final segment (1), reserved * 3 (000), opcode (XXXX)
 
             if(data.size() >= 0x10000)
             {
-                frame.push_back(0x7F); // non-masked (0), 7-bit fragment size for 64 bits extended (1111111)
+                header.push_back(0x7F); // non-masked (0), 7-bit fragment size for 64 bits extended (1111111)
                 uint64_t len = data.size();
                 len = boost::endian::native_to_big(len);
-                uint8_t *lenByBytes = reinterpret_cast<uint8_t *>(len);
-                frame.insert(frame.end(), lenByBytes, lenByBytes + sizeof(len));
+                header.append(&len, sizeof(len));
             }
             else if(data.size() >= 0x7E) // && data.size() < 0x10000
             {
-                frame.push_back(0x7E); // non-masked (0), 7-bit fragment size for 16 bits extended (1111110)
+                header.push_back(0x7E); // non-masked (0), 7-bit fragment size for 16 bits extended (1111110)
                 uint16_t len = static_cast<uint16_t>(data.size());
                 len = boost::endian::native_to_big(len);
-                uint8_t *lenByBytes = reinterpret_cast<uint8_t *>(len);
-                frame.insert(frame.end(), lenByBytes, lenByBytes + sizeof(len));
+                header.append(&len, sizeof(len));
             }
             else
             {
-                frame.push_back(static_cast<uint8_t>(data.size())); // non-masked (0), 7-bit fragment size for < 0x7E (XXXXXXX)
+                header.push_back(static_cast<char>(data.size())); // non-masked (0), 7-bit fragment size for < 0x7E (XXXXXXX)
             }
 
-            frame.insert(frame.end(), data.begin(), data.end());
-
-            return frame;
+            return IoChain{std::move(header), data};
         }
+
+        // rapidjson output stream writing straight into a pooled buffer
+        class IoBufferOutputStream
+        {
+        public:
+            typedef char Ch;
+
+        public:
+            explicit IoBufferOutputStream(IoBuffer &buffer) : buffer_(buffer) {}
+
+        public:
+            void Put(Ch ch) { buffer_.push_back(ch); }
+            void Flush() {}
+
+        private:
+            IoBuffer &buffer_;
+        };
     }
 
     const std::string WebSocketConnection::KeyConcatMagic = "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
 
     WebSocketConnection::WebSocketConnection(HttpServer &server, bool ssl)
         : server_(server)
-        , ios_(server.ios_)
+        , ios_(server.assignIoService())
+        , bufferToRead_()
         , closeReady_(false)
         , closeTimer_(ios_)
         , closeReceived_(false)
@@ -62,21 +77,18 @@ namespace SudaGureum
             socket_ = std::make_shared<BufferedWriterSocket<TcpSocket>>(ios_);
     }
 
-    WebSocketConnection::WebSocketConnection(HttpServer &server,
-        std::shared_ptr<BufferedWriterSocketBase> socket, const std::vector<uint8_t> &readBuffer)
+    WebSocketConnection::WebSocketConnection(HttpServer &server, asio::io_service &ios,
+        std::shared_ptr<BufferedWriterSocketBase> socket)
         : server_(server)
-        , ios_(server.ios_)
+        , ios_(ios) // the one of the upgraded HttpConnection
         , socket_(std::move(socket))
+        , bufferToRead_()
         , closeReady_(false)
         , closeTimer_(ios_)
         , closeReceived_(false)
     {
-        if(readBuffer.size() > bufferToRead_.size())
-        {
-            throw(std::logic_error("readBuffer is too large"));
-        }
-        std::copy(readBuffer.begin(), readBuffer.end(), bufferToRead_.begin());
-        // handleRead is called by HttpConnection because shared_from_this is not available here.
+        // start is called by HttpConnection with the bytes read after the upgrade request
+        // because shared_from_this is not available here.
     }
 
     WebSocketConnection::~WebSocketConnection()
@@ -84,7 +96,7 @@ namespace SudaGureum
         Log::instance().info("WebSocketConnection[{}]: connection closed", static_cast<void *>(this));
     }
 
-    void WebSocketConnection::sendRaw(std::vector<uint8_t> data)
+    void WebSocketConnection::sendRaw(IoChain data)
     {
         socket_->asyncWrite(std::move(data),
             std::bind(
@@ -105,14 +117,12 @@ namespace SudaGureum
         response.responseDoc_.AddMember("_reqid", response.id_, response.responseDoc_.GetAllocator());
         response.responseDoc_.AddMember("success", response.success_, response.responseDoc_.GetAllocator());
 
-        rapidjson::StringBuffer buffer;
-        rapidjson::Writer<rapidjson::StringBuffer> writer(buffer);
+        IoBuffer buffer(IoBuffer::SizeClasses[1]);
+        IoBufferOutputStream stream(buffer);
+        rapidjson::Writer<IoBufferOutputStream> writer(stream);
         response.responseDoc_.Accept(writer);
 
-        const uint8_t *data = reinterpret_cast<const uint8_t *>(buffer.GetString());
-
-        WebSocketResponse wsResponse(WebSocketResponse::Command::Text,
-            std::vector<uint8_t>(data, data + buffer.GetSize()));
+        WebSocketResponse wsResponse(WebSocketResponse::Command::Text, std::move(buffer));
         sendWebSocketResponse(wsResponse);
     }
 
@@ -125,15 +135,70 @@ namespace SudaGureum
                 StdAsioPlaceholders::error));
     }
 
-    void WebSocketConnection::read()
+    void WebSocketConnection::start(IoBuffer received)
     {
-        socket_->asyncReadSome(
-            asio::buffer(bufferToRead_),
-            std::bind(
-                std::mem_fn(&WebSocketConnection::handleRead),
-                shared_from_this(),
-                StdAsioPlaceholders::error,
-                StdAsioPlaceholders::bytesTransferred));
+        // asio::detached would swallow what procReceived or a request handler throws
+        asio::co_spawn(ios_, readLoop(shared_from_this(), std::move(received)),
+            [connection = static_cast<void *>(this)](std::exception_ptr e)
+            {
+                if(!e)
+                {
+                    return;
+                }
+
+                try
+                {
+                    std::rethrow_exception(e);
+                }
+                catch(const std::exception &ex)
+                {
+                    Log::instance().error("WebSocketConnection[{}]: read loop failed: {}", connection, ex.what());
+                }
+                catch(...)
+                {
+                    Log::instance().error("WebSocketConnection[{}]: read loop failed: unknown exception", connection);
+                }
+            });
+    }
+
+    // The coroutine holds the connection once for its whole life instead of every read holding it again.
+    asio::awaitable<void> WebSocketConnection::readLoop(std::shared_ptr<WebSocketConnection> /*self*/, IoBuffer received)
+    {
+        if(!procReceived(received))
+        {
+            co_return;
+        }
+        received = IoBuffer(); // may be a slice of the read buffer of the HttpConnection
+
+        while(!closeReceived_)
+        {
+            std::error_code ec;
+            if(bufferToRead_.waitReadable())
+            {
+                co_await socket_->waitReadable(ec);
+            }
+
+            size_t bytesTransferred = 0;
+            if(!ec)
+            {
+                bytesTransferred = co_await socket_->readSome(bufferToRead_.prepare(), ec);
+            }
+
+            if(ec)
+            {
+                Log::instance().warn("WebSocketConnection[{}]: read failed: {}", static_cast<void *>(this), ec.message());
+                if(!closeReady_)
+                {
+                    socket_->close(); // implies forcely canceling write
+                }
+                co_return;
+            }
+
+            if(!procReceived(bufferToRead_.commit(bytesTransferred)))
+            {
+                co_return;
+            }
+        }
     }
 
     void WebSocketConnection::close()
@@ -158,34 +223,21 @@ namespace SudaGureum
             return;
         }
 
-        read();
+        start(IoBuffer());
     }
 
-    void WebSocketConnection::handleRead(const std::error_code &ec, size_t bytesTransferred)
+    bool WebSocketConnection::procReceived(const IoBuffer &data)
     {
-        if(ec)
-        {
-            Log::instance().warn("WebSocketConnection[{}]: read failed: {}", static_cast<void *>(this), ec.message());
-            if(!closeReady_)
-            {
-                socket_->close(); // implies forcely canceling write
-            }
-            return;
-        }
-
-        if(!parser_.parse(std::vector<uint8_t>(bufferToRead_.begin(), bufferToRead_.begin() + bytesTransferred),
+        if(!parser_.parse(data,
             std::bind(&WebSocketConnection::procWebSocketRequest, this, std::placeholders::_1),
             std::bind(&WebSocketConnection::procSudaGureumRequest, this, std::placeholders::_1)))
         {
             Log::instance().warn("WebSocketConnection[{}]: read: invalid data received", static_cast<void *>(this));
             socket_->close();
-            return;
+            return false;
         }
 
-        if(!closeReceived_)
-        {
-            read();
-        }
+        return true;
     }
 
     void WebSocketConnection::handleWrite(const std::error_code &ec, size_t bytesTransferred)
@@ -215,7 +267,7 @@ namespace SudaGureum
         switch(request.command_)
         {
         case WebSocketRequest::Command::Ping:
-            sendWebSocketResponse(WebSocketResponse(WebSocketResponse::Command::Pong, request.rawData_));
+            sendWebSocketResponse(WebSocketResponse(WebSocketResponse::Command::Pong, IoBuffer::copyOf(request.rawData_)));
             break;
 
         case WebSocketRequest::Command::Close:
@@ -1,6 +1,7 @@
 ﻿#pragma once
 
 #include "MtIoService.h"
+#include "ReadBuffer.h"
 #include "Socket.h"
 #include "WebSocketParser.h"
 
@@ -39,8 +40,8 @@ namespace SudaGureum
         WebSocketConnection(HttpServer &server, bool ssl);
         // for HttpConnection
         // TODO: context
-        WebSocketConnection(HttpServer &server,
-            std::shared_ptr<BufferedWriterSocketBase> socket, const std::vector<uint8_t> &readBuffer);
+        WebSocketConnection(HttpServer &server, asio::io_service &ios,
+            std::shared_ptr<BufferedWriterSocketBase> socket);
 
     public:
         ~WebSocketConnection();
@@ -51,15 +52,18 @@ namespace SudaGureum
 
     private:
         void startSsl();
-        void read();
-        void sendRaw(std::vector<uint8_t> data);
+        void start(IoBuffer received); // begins readLoop
+        void sendRaw(IoChain data);
         void close();
 
+    private:
+        asio::awaitable<void> readLoop(std::shared_ptr<WebSocketConnection> self, IoBuffer received);
+
     private:
         void handleHandshake(const std::error_code &ec);
-        void handleRead(const std::error_code &ec, size_t bytesTransferred);
         void handleWrite(const std::error_code &ec, size_t bytesTransferred);
         void handleCloseTimeout(const std::error_code &ec);
+        bool procReceived(const IoBuffer &data); // false if the connection is to be closed
         void procWebSocketRequest(const WebSocketRequest &request);
         void procSudaGureumRequest(const SudaGureumRequest &request);
 
@@ -69,7 +73,7 @@ namespace SudaGureum
         std::shared_ptr<BufferedWriterSocketBase> socket_;
 
         WebSocketParser parser_;
-        std::array<uint8_t, 65536> bufferToRead_;
+        ReadBuffer bufferToRead_;
 
         bool closeReady_;
         asio::basic_waitable_timer<std::chrono::steady_clock> closeTimer_;